@@ -107,3 +107,35 @@ tuple_uint(Tuple *tuple) {
 		return 0;
 	}
 }
+
+const char *
+tuple_cstring(Tuple *tuple) {
+	if (!tuple) return 0;
+	if (tuple->type == TUPLE_CSTRING) return tuple->value->cstring;
+
+	APP_LOG(APP_LOG_LEVEL_ERROR,
+	    "Unexpected type %d for string dictionary entry %" PRIu32,
+	    (int)tuple->type, tuple->key);
+	return 0;
+}
+
+/* walks the dictionary once, calling every handler whose range matches */
+unsigned
+dict_dispatch(DictionaryIterator *iterator,
+    const struct dict_handler *handlers, size_t count, void *context) {
+	unsigned result = 0;
+
+	for (Tuple *tuple = dict_read_first(iterator);
+	    tuple;
+	    tuple = dict_read_next(iterator)) {
+		for (size_t i = 0; i < count; i += 1) {
+			if (tuple->key < handlers[i].first_key
+			    || tuple->key > handlers[i].last_key)
+				continue;
+			handlers[i].callback(tuple, context);
+			result += 1;
+		}
+	}
+
+	return result;
+}
@@ -16,8 +16,22 @@
 
 #include <pebble.h>
 
+/* called for each tuple whose key is within [first_key, last_key] */
+struct dict_handler {
+	uint32_t first_key;
+	uint32_t last_key;
+	void (*callback)(Tuple *tuple, void *context);
+};
+
 int32_t
 tuple_int(Tuple *tuple);
 
 uint32_t
 tuple_uint(Tuple *tuple);
+
+const char *
+tuple_cstring(Tuple *tuple);
+
+unsigned
+dict_dispatch(DictionaryIterator *iterator,
+    const struct dict_handler *handlers, size_t count, void *context);
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pebble.h>
+
+#include "global.h"
+#include "storage.h"
+
+/*
+ * Decayed usage counters, using forward decay: instead of decaying every
+ * counter as time passes, each new occurrence weighs twice as much as one
+ * a half-life earlier. Counters of other events never change when one is
+ * recorded, so the top list stays exact with a single insertion step.
+ * Once weights grow too large, every counter is halved once per elapsed
+ * half-life and the reference time moves forward. When a counter would
+ * overflow, all of them are halved and the reference time moves forward
+ * by one half-life, possibly ahead of the current time.
+ */
+
+#define HALF_LIFE (7 * 86400)
+#define BASE_WEIGHT 16
+#define MAX_PERIODS 4		/* half-lives before renormalization */
+#define STORE_PERIOD 8		/* records between table writes */
+
+struct __attribute__((__packed__)) frequency_table {
+	time_t epoch;
+	uint8_t top_count;
+	uint8_t top[FREQUENT_MAX];	/* indices, by decreasing score */
+	uint16_t score[STRLIST_MAX_SIZE];
+};
+
+_Static_assert(sizeof(struct frequency_table) <= PERSIST_DATA_MAX_LENGTH,
+    "frequency table does not fit in a persistent value");
+_Static_assert(sizeof(struct frequency_table)
+    == EVENT_FREQUENCY_STORAGE_SIZE,
+    "EVENT_FREQUENCY_STORAGE_SIZE does not match struct frequency_table");
+
+static struct frequency_table table;
+static uint8_t shown = 0;		/* configured size of the top list */
+static bool loaded = false;
+static bool dirty = false;
+static uint8_t unstored = 0;		/* records since the last write */
+
+static void
+load_table(void) {
+	int ret;
+
+	loaded = true;
+	shown = persist_read_int(KEY_FREQUENT_COUNT);
+	if (shown > FREQUENT_MAX) shown = FREQUENT_MAX;
+
+	ret = persist_read_data(KEY_EVENT_FREQUENCY, &table, sizeof table);
+	if (ret < (int)sizeof table || table.top_count > FREQUENT_MAX)
+		memset(&table, 0, sizeof table);
+}
+
+static void
+scale_down(unsigned shift) {
+	for (unsigned i = 0; i < STRLIST_MAX_SIZE; i += 1) {
+		table.score[i] = shift < 16 ? table.score[i] >> shift : 0;
+	}
+}
+
+static uint32_t
+weight(time_t time) {
+	int32_t age, periods;
+	uint32_t base;
+
+	if (!table.epoch) table.epoch = time;
+	age = time - table.epoch;
+	periods = age >= 0 ? age / HALF_LIFE
+	    : -((HALF_LIFE - 1 - age) / HALF_LIFE);
+
+	if (periods >= MAX_PERIODS) {
+		scale_down(periods);
+		table.epoch += periods * HALF_LIFE;
+		age -= periods * HALF_LIFE;
+		periods = 0;
+	}
+
+	/* the epoch is ahead of time after overflows, weights shrink then */
+	base = periods >= 0 ? BASE_WEIGHT << periods
+	    : -periods < 16 ? BASE_WEIGHT >> -periods : 0;
+	if (!base) base = 1;
+
+	/* linear interpolation between whole half-lives */
+	return base + base * (age - periods * HALF_LIFE) / HALF_LIFE;
+}
+
+/* moves index up the top list after its score increased */
+static void
+promote(uint8_t index) {
+	uint8_t pos;
+
+	for (pos = 0; pos < table.top_count && table.top[pos] != index;
+	    pos += 1);
+
+	if (pos >= table.top_count) {
+		if (table.top_count < FREQUENT_MAX) {
+			pos = table.top_count++;
+		} else if (table.score[index]
+		    > table.score[table.top[FREQUENT_MAX - 1]]) {
+			pos = FREQUENT_MAX - 1;
+		} else {
+			return;
+		}
+		table.top[pos] = index;
+	}
+
+	while (pos > 0
+	    && table.score[table.top[pos - 1]] < table.score[index]) {
+		table.top[pos] = table.top[pos - 1];
+		table.top[--pos] = index;
+	}
+}
+
+void
+event_frequency_record(uint8_t id, time_t time) {
+	const uint8_t index = id - 1;
+	uint32_t w;
+
+	/* ends of long events are not selected from the menu on their own */
+	if (!id || id >= 128 || index >= STRLIST_MAX_SIZE) return;
+	if (!loaded) load_table();
+
+	w = weight(time);
+	if (table.score[index] + w > UINT16_MAX) {
+		/* halving weights along with scores keeps them comparable */
+		scale_down(1);
+		table.epoch += HALF_LIFE;
+		w = weight(time);
+	}
+	table.score[index] += w;
+	promote(index);
+	dirty = true;
+
+	if (++unstored >= STORE_PERIOD) event_frequency_store();
+}
+
+static bool
+is_shown(uint8_t index) {
+	return index < event_names.count
+	    && STRLIST_UNSAFE_ITEM(event_names, index)[0] != '-'
+	    && event_profile_visible(index);
+}
+
+/* fills indices with the most frequent events shown by the menus */
+uint8_t
+event_frequency_top(uint8_t *indices, uint8_t size) {
+	uint8_t count = 0;
+
+	if (!loaded) load_table();
+	if (size > shown) size = shown;
+
+	for (uint8_t i = 0; i < table.top_count && count < size; i += 1) {
+		if (is_shown(table.top[i])) indices[count++] = table.top[i];
+	}
+
+	/* the profile may hide tracked events, the rest come from scores */
+	while (count < size) {
+		uint16_t best_score = 0;
+		uint8_t best = 0;
+
+		for (uint8_t i = 0; i < STRLIST_MAX_SIZE; i += 1) {
+			uint8_t j;
+
+			if (table.score[i] <= best_score || !is_shown(i))
+				continue;
+			for (j = 0; j < count && indices[j] != i; j += 1);
+			if (j < count) continue;
+			best_score = table.score[i];
+			best = i;
+		}
+
+		if (!best_score) break;
+		indices[count++] = best;
+	}
+
+	return count;
+}
+
+void
+event_frequency_configure(uint8_t count) {
+	if (!loaded) load_table();
+	shown = count < FREQUENT_MAX ? count : FREQUENT_MAX;
+	storage_write_int(KEY_FREQUENT_COUNT, shown);
+}
+
+/* forgets every counter, when indices no longer designate the same events */
+void
+event_frequency_reset(void) {
+	if (!loaded) load_table();
+	memset(&table, 0, sizeof table);
+	dirty = true;
+}
+
+void
+event_frequency_store(void) {
+	int ret;
+
+	if (!dirty) return;
+
+	ret = storage_write_data(KEY_EVENT_FREQUENCY, &table, sizeof table);
+	if (ret < 0) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Error %d while writing event frequencies", ret);
+	} else {
+		dirty = false;
+		unstored = 0;
+	}
+}
@@ -14,182 +14,902 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <inttypes.h>
 #include <pebble.h>
 
+#include "bitarray.h"
 #include "global.h"
+#include "storage.h"
+#include "strset.h"
 
+/* durations are found at read time by pairing ends with their begins */
 struct __attribute__((__packed__)) entry {
 	time_t time;
 	uint8_t id;
 };
 
-#define PAGE_LENGTH (PERSIST_DATA_MAX_LENGTH / sizeof(struct entry))
+_Static_assert(sizeof(struct entry) == LOG_ENTRY_SIZE,
+    "LOG_ENTRY_SIZE does not match struct entry");
 
-struct entry page[PAGE_LENGTH];
-uint16_t next_index = 0;
+/* time range and event indices of a segment, to skip it without reading */
+struct __attribute__((__packed__)) segment_summary {
+	time_t min_time;
+	time_t max_time;
+	BITARRAY_DECLARE(ids, STRLIST_MAX_SIZE);
+};
 
-void
-event_log_init(void) {
-	int ret = persist_read_data(KEY_EVENT_LOG, page, sizeof page);
+struct __attribute__((__packed__)) log_header {
+	uint32_t next_seq;
+	uint32_t sent_seq;	/* first entry not acknowledged by the phone */
+	struct segment_summary summary[LOG_SEGMENT_COUNT];
+};
+
+_Static_assert(sizeof(struct log_header) == LOG_HEADER_SIZE,
+    "LOG_HEADER_SIZE does not match struct log_header");
+
+struct __attribute__((__packed__)) open_interval {
+	uint32_t seq;
+	time_t time;
+	uint8_t index;
+};
+
+_Static_assert(sizeof(struct open_interval) == OPEN_INTERVAL_SIZE,
+    "OPEN_INTERVAL_SIZE does not match struct open_interval");
+
+/* first entry of each local day present in the log, rebuilt at init */
+struct __attribute__((__packed__)) day_boundary {
+	uint32_t seq;
+	uint16_t day;
+};
+
+/* the ring spans at most one day per entry */
+#define MAX_DAY_BOUNDARIES LOG_CAPACITY
+
+_Static_assert(MAX_DAY_BOUNDARIES <= UINT8_MAX,
+    "Day index count does not fit in day_count");
+
+/* pages of the day index, from when it was persisted */
+#define LEGACY_DAY_PAGES 4
+
+#define SEGMENT(seq) (((seq) / LOG_SEGMENT_LENGTH) % LOG_SEGMENT_COUNT)
+#define SLOT(seq) ((seq) % LOG_SEGMENT_LENGTH)
+#define RING_SLOT(seq) ((seq) % LOG_CAPACITY)
+
+static struct log_header header;
+static struct entry head[LOG_SEGMENT_LENGTH];
+
+_Static_assert(LOG_SEGMENT_COUNT * sizeof head == LOG_STORAGE_SIZE,
+    "LOG_STORAGE_SIZE does not match the log segments");
+static struct entry cache[PROFILE_LOG_CACHE][LOG_SEGMENT_LENGTH];
+static uint32_t cache_start[PROFILE_LOG_CACHE];
+static uint8_t cache_next = 0;
+static struct open_interval open_intervals[MAX_OPEN_INTERVALS];
+static uint8_t open_interval_count = 0;
+static struct day_boundary days[MAX_DAY_BOUNDARIES];
+static uint8_t day_count = 0;
+static uint32_t epoch = 0;
+static bool loaded = false;
+
+/* per-event bitmaps over ring slots, built once then updated by appends */
+typedef BITARRAY_DECLARE(slot_bitmap, LOG_CAPACITY);
+static slot_bitmap *slot_index = 0;
+
+static uint8_t
+entry_index(uint8_t id) {
+	return id >= 128 ? id - 128 : id - 1;
+}
+
+static void
+store_segment(uint32_t seq, const struct entry *entries) {
+	int ret = storage_write_data(KEY_EVENT_LOG + SEGMENT(seq),
+	    entries, sizeof head);
 
 	if (ret < 0) {
 		APP_LOG(APP_LOG_LEVEL_ERROR,
-		    "Error %d while reading event log",
-		    ret);
-	} else if ((size_t)ret < sizeof page) {
+		    "Error %d while writing event log segment %u",
+		    ret, (unsigned)SEGMENT(seq));
+	} else if ((size_t)ret < sizeof head) {
 		APP_LOG(APP_LOG_LEVEL_WARNING,
-		    "Short read of event log (%d/%zu)",
-		    ret, sizeof page);
+		    "Short write of event log segment (%d/%zu)",
+		    ret, sizeof head);
 	}
 }
 
-void
-record_event(uint8_t id) {
-	const time_t ev_time = time(0);
-	const char *title = 0;
+static bool
+load_segment(uint32_t seq, struct entry *entries) {
+	int ret = persist_read_data(KEY_EVENT_LOG + SEGMENT(seq),
+	    entries, sizeof head);
 
-	if (!id) return;
-	page[next_index].time = ev_time;
-	page[next_index].id = id;
-	next_index = (next_index + 1) % PAGE_LENGTH;
-
-	if (id <= event_names.count) {
-		uint8_t long_id = long_event_id[id - 1];
-		title = long_id > 0
-		    ? STRLIST_UNSAFE_ITEM(event_begins, long_id - 1)
-		    : STRLIST_UNSAFE_ITEM(event_names, id - 1);
-	} else if (id >= 128 && id - 128 < event_names.count) {
-		uint8_t long_id = long_event_id[id - 128];
-		title = long_id > 0
-		    ? STRLIST_UNSAFE_ITEM(event_ends, long_id - 1)
-		    : STRLIST_UNSAFE_ITEM(event_names, id - 128);
-	}
-	if (title) send_recorded_event(ev_time, id, title);
-
-	int ret = persist_write_data(KEY_EVENT_LOG, page, sizeof page);
 	if (ret < 0) {
 		APP_LOG(APP_LOG_LEVEL_ERROR,
-		    "Error %d while writing event log",
+		    "Error %d while reading event log segment %u",
+		    ret, (unsigned)SEGMENT(seq));
+		memset(entries, 0, sizeof head);
+		return false;
+	} else if ((size_t)ret != sizeof head) {
+		/* segments are always written whole, so it is another layout */
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Unexpected size of event log segment (%d/%zu)",
+		    ret, sizeof head);
+		memset(entries, 0, sizeof head);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+store_header(void) {
+	int ret = storage_write_data(KEY_EVENT_LOG_HEADER,
+	    &header, sizeof header);
+
+	if (ret < 0) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Error %d while writing event log header",
 		    ret);
-	} else if ((size_t)ret < sizeof page) {
+	}
+}
+
+/* number of leading boundaries whose day is entirely evicted */
+static uint8_t
+obsolete_days(void) {
+	const uint32_t begin = event_log_begin();
+	uint8_t result = 0;
+
+	while (result + 1 < day_count && days[result + 1].seq <= begin)
+		result += 1;
+	return result;
+}
+
+static void
+update_day_index(uint32_t seq, time_t time) {
+	const uint16_t day = local_day(time);
+	uint8_t obsolete;
+
+	if (day_count && days[day_count - 1].day == day) return;
+
+	obsolete = obsolete_days();
+	if (!obsolete && day_count >= MAX_DAY_BOUNDARIES) {
 		APP_LOG(APP_LOG_LEVEL_WARNING,
-		    "Short write of event log (%d/%zu)",
-		    ret, sizeof page);
+		    "Log day index full, dropping its oldest day");
+		obsolete = 1;
 	}
+
+	if (obsolete) {
+		day_count -= obsolete;
+		memmove(days, days + obsolete, day_count * sizeof *days);
+	}
+
+	days[day_count++] = (struct day_boundary){ .seq = seq, .day = day };
 }
 
+static uint16_t
+interval_minutes(time_t begin, time_t end) {
+	const uint32_t minutes = end > begin ? (end - begin) / 60 : 0;
 
-static const char *no_event_message = "No event logged.";
+	return minutes < LOG_NO_DURATION ? minutes : LOG_NO_DURATION - 1;
+}
 
+/* entry stored at seq, without looking for the duration of ends */
 static bool
-rebuild_menu(SimpleMenuSection *section, struct string_list *subtitles) {
-	SimpleMenuItem *items;
-	char buffer[32];
-	struct tm *tm;
+read_entry(uint32_t seq, struct log_entry *result) {
+	const uint32_t start = seq - SLOT(seq);
+	const struct entry *entry;
+	unsigned i;
+
+	if (!loaded) event_log_init();
+	if (seq >= header.next_seq || seq < event_log_begin()) return false;
+
+	if (start == header.next_seq - SLOT(header.next_seq)) {
+		entry = head + SLOT(seq);
+	} else {
+		for (i = 0; i < PROFILE_LOG_CACHE && cache_start[i] != start;
+		    i += 1);
+		if (i >= PROFILE_LOG_CACHE) {
+			i = cache_next;
+			cache_next = (cache_next + 1) % PROFILE_LOG_CACHE;
+			cache_start[i] = load_segment(seq, cache[i])
+			    ? start : UINT32_MAX;
+		}
+		entry = cache[i] + SLOT(seq);
+	}
+
+	/* slots left empty by a failed read or an imported older log */
+	if (!entry->time) return false;
+
+	result->seq = seq;
+	result->time = entry->time;
+	result->id = entry->id;
+	result->duration = LOG_NO_DURATION;
+	return true;
+}
+
+/* latest entry of the event at index before seq, skipping segments */
+static bool
+find_previous(uint32_t seq, uint8_t index, struct log_entry *result) {
+	const uint32_t begin = event_log_begin();
+
+	while (seq > begin) {
+		seq -= 1;
+		if (index < STRLIST_MAX_SIZE && !BITARRAY_TEST(
+		    header.summary[SEGMENT(seq)].ids, index)) {
+			seq -= SLOT(seq);
+			continue;
+		}
+		if (read_entry(seq, result) && entry_index(result->id) == index)
+			return true;
+	}
+
+	return false;
+}
+
+/* earliest entry of the event at index from seq onwards */
+static bool
+find_next(uint32_t seq, uint8_t index, struct log_entry *result) {
+	while (seq < header.next_seq) {
+		if (index < STRLIST_MAX_SIZE && !BITARRAY_TEST(
+		    header.summary[SEGMENT(seq)].ids, index)) {
+			seq += LOG_SEGMENT_LENGTH - SLOT(seq);
+			continue;
+		}
+		if (read_entry(seq, result) && entry_index(result->id) == index)
+			return true;
+		seq += 1;
+	}
+
+	return false;
+}
+
+/*
+ * Aggregates the entries of the segment about to be overwritten by seq.
+ * An interval is rolled up with the first of its entries to be evicted:
+ * its duration comes with its begin when the end is still in the ring,
+ * and with its end when both are evicted together. Ends whose begin was
+ * evicted earlier were accounted for then, or when they were recorded.
+ * Entries of partitioned events are kept there with their duration.
+ */
+static void
+roll_up_segment(uint32_t seq) {
+	struct entry evicted[LOG_SEGMENT_LENGTH];
+	struct log_entry next;
+	uint16_t duration;
+	unsigned i, j;
+
+	if (seq < LOG_CAPACITY || !load_segment(seq, evicted)) return;
+
+	for (i = 0; i < LOG_SEGMENT_LENGTH; i += 1) {
+		const uint8_t index = entry_index(evicted[i].id);
+
+		if (!evicted[i].time) continue;
+		duration = LOG_NO_DURATION;
+
+		if (evicted[i].id >= 128) {
+			for (j = i; j > 0
+			    && entry_index(evicted[j - 1].id) != index; j -= 1);
+			if (j > 0 && evicted[j - 1].id < 128)
+				duration = interval_minutes(
+				    evicted[j - 1].time, evicted[i].time);
+		} else {
+			for (j = i + 1; j < LOG_SEGMENT_LENGTH
+			    && entry_index(evicted[j].id) != index; j += 1);
+			if (j >= LOG_SEGMENT_LENGTH
+			    && find_next(event_log_begin(), index, &next)
+			    && next.id >= 128)
+				log_rollup_add(next.time, next.id,
+				    interval_minutes(evicted[i].time,
+				      next.time));
+		}
+
+		log_rollup_add(evicted[i].time, evicted[i].id, duration);
+		log_partition_keep(&(struct log_entry){
+		    .seq = seq - LOG_CAPACITY + i,
+		    .time = evicted[i].time,
+		    .id = evicted[i].id,
+		    .duration = duration,
+		});
+	}
+
+	log_rollup_store();
+	log_partition_store();
+}
+
+/* forgets the slots of the segment starting at seq in the event index */
+static void
+unindex_segment(uint32_t seq, const struct segment_summary *summary) {
+	const uint32_t first = RING_SLOT(seq);
+
+	for (uint8_t i = 0; i < STRLIST_MAX_SIZE; i += 1) {
+		if (!BITARRAY_TEST(summary->ids, i)) continue;
+		for (uint32_t slot = first; slot < first + LOG_SEGMENT_LENGTH;
+		    slot += 1)
+			BITARRAY_CLEAR(slot_index[i], slot);
+	}
+}
+
+/* appends in memory, storing the head segment is left to the caller */
+static struct entry *
+append_entry(time_t time, uint8_t id) {
+	const uint32_t seq = header.next_seq;
+	struct segment_summary *summary = header.summary + SEGMENT(seq);
+	struct entry *entry;
+
+	if (SLOT(seq) == 0) {
+		roll_up_segment(seq);
+		if (slot_index) unindex_segment(seq, summary);
+		memset(head, 0, sizeof head);
+		memset(summary, 0, sizeof *summary);
+		summary->min_time = summary->max_time = time;
+		for (unsigned i = 0; i < PROFILE_LOG_CACHE; i += 1) {
+			if (SEGMENT(cache_start[i]) == SEGMENT(seq))
+				cache_start[i] = UINT32_MAX;
+		}
+	}
+
+	entry = head + SLOT(seq);
+	entry->time = time;
+	entry->id = id;
+	if (time < summary->min_time) summary->min_time = time;
+	if (time > summary->max_time) summary->max_time = time;
+	if (entry_index(id) < STRLIST_MAX_SIZE) {
+		BITARRAY_SET(summary->ids, entry_index(id));
+		if (slot_index)
+			BITARRAY_SET(slot_index[entry_index(id)],
+			    RING_SLOT(seq));
+	}
+	header.next_seq += 1;
+	update_day_index(seq, time);
+	return entry;
+}
+
+/* entries stored before sequence numbers, 5 bytes each in a single page */
+struct __attribute__((__packed__)) legacy_entry {
+	time_t time;
+	uint8_t id;
+};
+
+static void
+import_legacy_log(void) {
+	struct legacy_entry legacy[PERSIST_DATA_MAX_LENGTH
+	    / sizeof(struct legacy_entry)];
+	uint16_t count, first = 0;
 	int ret;
-	uint16_t first = 0, last = 0;
-
-	strlist_reset(subtitles);
-
-	for (uint16_t i = 0; i < PAGE_LENGTH; i += 1) {
-		if (!page[i].time) break;
-		tm = localtime(&page[i].time);
-		ret = strftime(buffer, sizeof buffer, "%Y-%m-%d %H:%M:%S", tm);
-		if (!ret) break;
-		strlist_append(subtitles, buffer);
-
-		if (i && first == 0) {
-			if (page[i].time < page[i - 1].time) {
-				last = i - 1;
-				first = i;
-			} else {
-				last = i;
-			}
+
+	ret = persist_read_data(KEY_EVENT_LOG, legacy, sizeof legacy);
+	if (ret <= 0) return;
+
+	for (count = 0; count < ret / sizeof *legacy; count += 1) {
+		if (!legacy[count].time) break;
+		if (count && !first
+		    && legacy[count].time < legacy[count - 1].time)
+			first = count;
+	}
+
+	for (uint16_t i = 0; i < count; i += 1) {
+		const struct legacy_entry *old = legacy + (first + i) % count;
+		append_entry(old->time, old->id);
+		if (SLOT(header.next_seq) == 0)
+			store_segment(header.next_seq - 1, head);
+	}
+
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Imported %" PRIu16 " legacy log entries", count);
+}
+
+/* entries of the previous segment layout, with the duration of ends */
+struct __attribute__((__packed__)) wide_entry {
+	time_t time;
+	uint8_t id;
+	uint16_t duration;
+};
+
+#define WIDE_SEGMENT_LENGTH \
+	(PERSIST_DATA_MAX_LENGTH / sizeof(struct wide_entry))
+#define WIDE_SEGMENT_SIZE (WIDE_SEGMENT_LENGTH * sizeof(struct wide_entry))
+
+_Static_assert(WIDE_SEGMENT_SIZE != sizeof head,
+    "previous log layout cannot be told apart");
+
+static bool
+has_wide_log(void) {
+	for (unsigned i = 0; i < LOG_SEGMENT_COUNT; i += 1) {
+		if (persist_get_size(KEY_EVENT_LOG + i) == WIDE_SEGMENT_SIZE)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Moves the entries of the previous layout to the same sequence numbers.
+ * Its ring is smaller, so the oldest slots of the new one stay empty until
+ * they are overwritten.
+ */
+static void
+import_wide_log(void) {
+	const uint32_t end = header.next_seq;
+	const uint32_t others = (LOG_SEGMENT_COUNT - 1) * WIDE_SEGMENT_LENGTH;
+	const uint32_t head_start = end - end % WIDE_SEGMENT_LENGTH;
+	const uint32_t begin = head_start >= others ? head_start - others : 0;
+	struct wide_entry (*wide)[WIDE_SEGMENT_LENGTH];
+	struct segment_summary *summary;
+
+	wide = calloc(LOG_SEGMENT_COUNT, sizeof *wide);
+	if (!wide) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Unable to allocate %zu bytes to import the event log",
+		    LOG_SEGMENT_COUNT * sizeof *wide);
+		return;
+	}
+
+	for (unsigned i = 0; i < LOG_SEGMENT_COUNT; i += 1)
+		persist_read_data(KEY_EVENT_LOG + i, wide[i], sizeof *wide);
+
+	memset(head, 0, sizeof head);
+	memset(header.summary, 0, sizeof header.summary);
+	header.next_seq = begin;
+
+	for (uint32_t seq = begin; seq < end; seq += 1) {
+		const struct wide_entry *old = wide[(seq / WIDE_SEGMENT_LENGTH)
+		    % LOG_SEGMENT_COUNT] + seq % WIDE_SEGMENT_LENGTH;
+
+		summary = header.summary + SEGMENT(seq);
+		if (seq == begin)
+			summary->min_time = summary->max_time = old->time;
+		append_entry(old->time, old->id);
+		if (SLOT(header.next_seq) == 0) store_segment(seq, head);
+	}
+
+	if (SLOT(header.next_seq)) store_segment(header.next_seq, head);
+	store_header();
+
+	/* segments holding only older entries are emptied */
+	memset(wide, 0, sizeof head);
+	for (unsigned i = 0; i < LOG_SEGMENT_COUNT; i += 1) {
+		if (persist_get_size(KEY_EVENT_LOG + i) == sizeof head)
+			continue;
+		storage_write_data(KEY_EVENT_LOG + i, wide, sizeof head);
+	}
+	free(wide);
+
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Imported %" PRIu32 " log entries of the previous layout",
+	    end - begin);
+}
+
+uint32_t
+event_log_begin(void) {
+	const uint32_t others = (LOG_SEGMENT_COUNT - 1) * LOG_SEGMENT_LENGTH;
+	uint32_t head_start;
+
+	if (!loaded) event_log_init();
+	head_start = header.next_seq - SLOT(header.next_seq);
+	return head_start >= others ? head_start - others : 0;
+}
+
+uint32_t
+event_log_end(void) {
+	if (!loaded) event_log_init();
+	return header.next_seq;
+}
+
+/* entry at seq, with the duration of ends whose begin is still logged */
+bool
+event_log_read(uint32_t seq, struct log_entry *result) {
+	struct log_entry begin;
+
+	if (!read_entry(seq, result)) return false;
+
+	if (result->id >= 128
+	    && find_previous(seq, entry_index(result->id), &begin)
+	    && begin.id < 128)
+		result->duration = interval_minutes(begin.time, result->time);
+	return true;
+}
+
+uint32_t
+event_log_epoch(void) {
+	if (!loaded) event_log_init();
+	return epoch;
+}
+
+uint32_t
+event_log_sent(void) {
+	if (!loaded) event_log_init();
+	return header.sent_seq;
+}
+
+void
+event_log_mark_sent(uint32_t seq) {
+	if (!loaded) event_log_init();
+	if (seq <= header.sent_seq) return;
+	header.sent_seq = seq;
+	store_header();
+}
+
+uint8_t
+event_log_day_count(void) {
+	if (!loaded) event_log_init();
+	return day_count - obsolete_days();
+}
+
+/* index 0 being the oldest day still in the log */
+bool
+event_log_day(uint8_t index, struct log_day *result) {
+	const uint32_t begin = event_log_begin();
+	const uint8_t i = index + obsolete_days();
+
+	if (i >= day_count) return false;
+
+	result->day = days[i].day;
+	result->first = days[i].seq > begin ? days[i].seq : begin;
+	result->end = i + 1 < day_count ? days[i + 1].seq : header.next_seq;
+	return true;
+}
+
+/*
+ * Rebuilds the day index from the ring. Segments whose time range lies
+ * within the last day found hold no boundary, so they are not read.
+ */
+static void
+load_day_index(void) {
+	struct log_entry entry;
+	uint32_t seq = event_log_begin();
+
+	day_count = 0;
+	while (seq < header.next_seq) {
+		const struct segment_summary *summary
+		    = header.summary + SEGMENT(seq);
+		const uint16_t last_day = day_count ? days[day_count - 1].day
+		    : UINT16_MAX;
+
+		if (local_day(summary->min_time) == last_day
+		    && local_day(summary->max_time) == last_day) {
+			seq += LOG_SEGMENT_LENGTH - SLOT(seq);
+			continue;
 		}
+
+		if (read_entry(seq, &entry))
+			update_day_index(seq, entry.time);
+		seq += 1;
 	}
 
-	if (subtitles->count) {
-		items = calloc(subtitles->count, sizeof *items);
-		if (!items) return false;
-	} else {
-		items = calloc(1, sizeof *items);
-		if (!items) return false;
-		items[0] = (SimpleMenuItem) { .title = no_event_message };
-	}
-
-	free((void *)section->items);
-	section->items = items;
-	section->title = 0;
-	if (!subtitles->count) {
-		section->num_items = 1;
-		return true;
-	}
-	section->num_items = 0;
-
-	for (uint16_t j = last;; j = (j + PAGE_LENGTH - 1) % PAGE_LENGTH) {
-		uint16_t i = section->num_items;
-		section->num_items += 1;
-		if (page[j].id && page[j].id <= event_names.count) {
-			uint8_t long_id = long_event_id[page[j].id - 1];
-			items[i] = (SimpleMenuItem) {
-			    .title = long_id > 0
-			    ? STRLIST_UNSAFE_ITEM(event_begins, long_id - 1)
-			    : STRLIST_UNSAFE_ITEM(event_names, page[j].id - 1),
-			    .subtitle = STRLIST_UNSAFE_ITEM(*subtitles, j)
-			};
-		} else if (page[j].id >= 128
-		    && page[j].id - 128 < event_names.count) {
-			uint8_t long_id = long_event_id[page[j].id - 128];
-			items[i] = (SimpleMenuItem) {
-			    .title = long_id > 0
-			    ? STRLIST_UNSAFE_ITEM(event_ends, long_id - 1)
-			    : STRLIST_UNSAFE_ITEM(event_names, page[j].id-128),
-			    .subtitle = STRLIST_UNSAFE_ITEM(*subtitles, j)
-			};
+	if (persist_exists(KEY_LEGACY_LOG_DAYS))
+		storage_delete(KEY_LEGACY_LOG_DAYS);
+	for (uint8_t page = 0; page < LEGACY_DAY_PAGES; page += 1) {
+		if (persist_exists(KEY_EVENT_LOG_DAYS + page))
+			storage_delete(KEY_EVENT_LOG_DAYS + page);
+	}
+}
+
+/* first sequence number at or after from, assuming time-ordered entries */
+static uint32_t
+lower_bound(time_t from) {
+	const uint32_t begin = event_log_begin();
+	const uint32_t segments = (header.next_seq - begin
+	    + LOG_SEGMENT_LENGTH - 1) / LOG_SEGMENT_LENGTH;
+	uint32_t low = 0, high = segments, mid;
+	struct log_entry entry;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (header.summary[SEGMENT(begin + mid * LOG_SEGMENT_LENGTH)]
+		    .max_time < from) {
+			low = mid + 1;
 		} else {
-			items[i] = (SimpleMenuItem) {
-			    .title = STRLIST_UNSAFE_ITEM(*subtitles, j)
-			};
+			high = mid;
 		}
-		if (j == first) break;
+	}
+
+	if (low >= segments) return header.next_seq;
+
+	low = begin + low * LOG_SEGMENT_LENGTH;
+	high = low + LOG_SEGMENT_LENGTH;
+	if (high > header.next_seq) high = header.next_seq;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (!read_entry(mid, &entry) || entry.time < from) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+void
+event_log_query_start(struct log_query *query,
+    time_t from, time_t to, uint8_t index) {
+	if (!loaded) event_log_init();
+	query->seq = lower_bound(from);
+	query->end = header.next_seq;
+	query->to = to;
+	query->index = index;
+}
+
+bool
+event_log_query_next(struct log_query *query, struct log_entry *entry) {
+	while (query->seq < query->end) {
+		const struct segment_summary *summary
+		    = header.summary + SEGMENT(query->seq);
+
+		if (summary->min_time > query->to) break;
+
+		if (query->index != INVALID_INDEX
+		    && (query->index >= STRLIST_MAX_SIZE
+		      || !BITARRAY_TEST(summary->ids, query->index))) {
+			query->seq += LOG_SEGMENT_LENGTH - SLOT(query->seq);
+			continue;
+		}
+
+		if (!event_log_read(query->seq++, entry)) continue;
+		if (entry->time > query->to) break;
+
+		if (query->index == INVALID_INDEX
+		    || entry_index(entry->id) == query->index)
+			return true;
+	}
+
+	query->seq = query->end;
+	return false;
+}
+
+uint16_t
+event_log_query(time_t from, time_t to, uint8_t index,
+    bool (*callback)(const struct log_entry *entry, void *context),
+    void *context) {
+	struct log_query query;
+	struct log_entry entry;
+	uint16_t result = 0;
+
+	event_log_query_start(&query, from, to, index);
+	while (event_log_query_next(&query, &entry)) {
+		result += 1;
+		if (callback && !callback(&entry, context)) break;
+	}
+
+	return result;
+}
+
+/* reads the whole ring once, appends keep the index up to date afterwards */
+static bool
+build_slot_index(void) {
+	struct log_entry entry;
+
+	slot_index = calloc(STRLIST_MAX_SIZE, sizeof *slot_index);
+	if (!slot_index) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Unable to allocate %zu bytes for the event index",
+		    STRLIST_MAX_SIZE * sizeof *slot_index);
+		return false;
+	}
+
+	for (uint32_t seq = event_log_begin(); seq < header.next_seq;
+	    seq += 1) {
+		if (read_entry(seq, &entry)
+		    && entry_index(entry.id) < STRLIST_MAX_SIZE)
+			BITARRAY_SET(slot_index[entry_index(entry.id)],
+			    RING_SLOT(seq));
 	}
 
 	return true;
 }
 
-static Window *window;
-static SimpleMenuLayer *menu_layer;
-static SimpleMenuSection menu_section;
-static struct string_list subtitles;
+/* marks in matches (relative to event_log_begin()) entries of an event */
+uint16_t
+event_log_filter(uint8_t index, unsigned char *matches) {
+	uint32_t begin;
+	uint16_t result = 0;
+
+	memset(matches, 0, BITARRAY_SIZE(LOG_CAPACITY));
+	if (index >= STRLIST_MAX_SIZE) return 0;
+	if (!loaded) event_log_init();
+	if (!slot_index && !build_slot_index()) return 0;
+
+	begin = event_log_begin();
+	for (uint32_t seq = begin; seq < header.next_seq; seq += 1) {
+		if (!BITARRAY_TEST(slot_index[index], RING_SLOT(seq))) continue;
+		BITARRAY_SET(matches, seq - begin);
+		result += 1;
+	}
+
+	return result;
+}
 
 static void
-window_load(Window *window) {
-	Layer *window_layer = window_get_root_layer(window);
-	GRect bounds = layer_get_bounds(window_layer);
+store_open_intervals(void) {
+	int ret;
 
-	if (!rebuild_menu(&menu_section, &subtitles)) return;
-		/* TODO: display error */
+	if (!open_interval_count) {
+		storage_delete(KEY_OPEN_INTERVALS);
+		return;
+	}
 
-	menu_layer = simple_menu_layer_create(bounds, window,
-	    &menu_section, 1, 0);
-	layer_add_child(window_layer, simple_menu_layer_get_layer(menu_layer));
+	ret = storage_write_data(KEY_OPEN_INTERVALS, open_intervals,
+	    open_interval_count * sizeof *open_intervals);
+	if (ret < 0) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Error %d while writing open intervals",
+		    ret);
+	}
 }
 
+/* nonce telling the phone that sequence numbers restarted */
 static void
-window_unload(Window *window) {
-	simple_menu_layer_destroy(menu_layer);
-	free((void *)menu_section.items);
-	menu_section.items = 0;
+new_epoch(void) {
+	time_t now;
+	uint16_t ms;
+	int ret;
+
+	time_ms(&now, &ms);
+	epoch = (uint32_t)now * 1000u + ms;
+	if (!epoch) epoch = 1;
+
+	ret = storage_write_int(KEY_EVENT_LOG_EPOCH, epoch);
+	if (ret < 0) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Error %d while writing event log epoch", ret);
+	}
 }
 
 void
-push_log_menu(void) {
-	if (!window) {
-		window = window_create();
-		window_set_window_handlers(window, (WindowHandlers) {
-		    .load = &window_load,
-		    .unload = &window_unload,
-		});
+event_log_init(void) {
+	int ret;
+
+	if (loaded) return;
+	loaded = true;
+
+	for (unsigned i = 0; i < PROFILE_LOG_CACHE; i += 1)
+		cache_start[i] = UINT32_MAX;
+
+	ret = persist_read_data(KEY_EVENT_LOG_HEADER, &header, sizeof header);
+	if (ret != sizeof header) {
+		memset(&header, 0, sizeof header);
+		import_legacy_log();
+		store_segment(header.next_seq, head);
+		store_header();
+		new_epoch();
+	} else if (has_wide_log()) {
+		import_wide_log();
+	} else if (SLOT(header.next_seq)) {
+		load_segment(header.next_seq, head);
+	}
+
+	if (!epoch && persist_exists(KEY_EVENT_LOG_EPOCH))
+		epoch = (uint32_t)persist_read_int(KEY_EVENT_LOG_EPOCH);
+	if (!epoch) new_epoch();
+
+	load_day_index();
+
+	ret = persist_read_data(KEY_OPEN_INTERVALS,
+	    open_intervals, sizeof open_intervals);
+	open_interval_count = ret > 0 ? ret / sizeof *open_intervals : 0;
+}
+
+static struct open_interval *
+find_interval(uint8_t index) {
+	for (uint8_t i = 0; i < open_interval_count; i += 1) {
+		if (open_intervals[i].index == index)
+			return open_intervals + i;
+	}
+	return 0;
+}
+
+static void
+open_interval(uint8_t index, uint32_t seq, time_t time) {
+	if (find_interval(index)) return;
+
+	if (open_interval_count >= MAX_OPEN_INTERVALS) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Too many open intervals, event %" PRIu8 " not tracked",
+		    index);
+		return;
+	}
+
+	open_intervals[open_interval_count++] = (struct open_interval){
+	    .seq = seq,
+	    .time = time,
+	    .index = index,
+	};
+	store_open_intervals();
+}
+
+/* returns the duration of the closed interval, or -1 if none was open */
+static int32_t
+close_interval(uint8_t index, time_t time) {
+	struct open_interval *interval = find_interval(index);
+	int32_t result;
+
+	if (!interval) return -1;
+
+	result = time > interval->time ? time - interval->time : 0;
+	*interval = open_intervals[--open_interval_count];
+	store_open_intervals();
+	return result;
+}
+
+time_t
+event_log_running_since(uint8_t index) {
+	const struct open_interval *interval;
+
+	if (!loaded) event_log_init();
+	interval = find_interval(index);
+	return interval ? interval->time : 0;
+}
+
+/*
+ * Occurrences of index within [from, to), with the total duration in
+ * seconds of its closed intervals added to *duration when not null.
+ * Evicted entries are counted from their rollups, so days at the edges
+ * of the range are included whole, and older weeks or 28-day periods in
+ * proportion.
+ */
+uint16_t
+event_log_count(uint8_t index, time_t from, time_t to, uint32_t *duration) {
+	struct log_query query;
+	struct log_entry entry;
+	uint16_t result;
+
+	if (from >= to) return 0;
+
+	result = log_rollup_count(index, local_day(from), local_day(to - 1),
+	    duration);
+
+	event_log_query_start(&query, from, to - 1, index);
+	while (event_log_query_next(&query, &entry)) {
+		if (entry.id < 128) {
+			result += 1;
+		} else if (duration && entry.duration != LOG_NO_DURATION) {
+			*duration += entry.duration * 60u;
+		}
 	}
-	window_stack_push(window, true);
+
+	return result;
 }
+
+void
+record_event(uint8_t id) {
+	const time_t ev_time = time(0);
+	const bool is_end = (id >= 128);
+	const uint8_t index = entry_index(id);
+	const uint32_t start_ms = metrics_now_ms();
+	struct log_entry begin;
+	int32_t duration = -1;
+
+	if (!id) return;
+	if (!loaded) event_log_init();
+
+	if (is_end) {
+		duration = close_interval(index, ev_time);
+	} else if (index < event_names.count && long_event_id[index]) {
+		open_interval(index, header.next_seq, ev_time);
+	}
+
+	append_entry(ev_time, id);
+
+	/* an interval whose begin left the ring is only known from here */
+	if (duration >= 0 && !(find_previous(header.next_seq - 1, index, &begin)
+	    && begin.id < 128)) {
+		log_rollup_add(ev_time, id, interval_minutes(0, duration));
+		log_rollup_store();
+	}
+
+	event_stats_record(id, ev_time, duration);
+	event_frequency_record(id, ev_time);
+
+	if (transport != TRANSPORT_BATCHED)
+		header.sent_seq = header.next_seq;
+
+	store_segment(header.next_seq - 1, head);
+	store_header();
+
+	if (transport == TRANSPORT_BATCHED) {
+		outbox_flush();
+	} else {
+		outbox_send_latest();
+	}
+
+	metrics_tap(start_ms);
+}
+
+
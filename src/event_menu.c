@@ -19,6 +19,7 @@
 
 #include "bitarray.h"
 #include "global.h"
+#include "storage.h"
 #include "strlist.h"
 #include "strset.h"
 
@@ -27,27 +28,41 @@
 #define SUBTITLE_LENGTH 20
 
 struct event_menu_context {
-	SimpleMenuLayer *menu_layer;
-	SimpleMenuSection section;
+	MenuLayer *menu_layer;
 	SimpleMenuItem *items;
+	uint16_t num_items;
 	char *subtitles;
 	uint8_t *ids;
 	unsigned extra_items;
 	uint8_t filter_id;
+	bool has_frequent;	/* top-level menu, frequent events first */
+	uint8_t frequent_count;
+	uint8_t frequent[FREQUENT_MAX];
+	char frequent_subtitles[FREQUENT_MAX * SUBTITLE_LENGTH];
 };
 
 static const char *no_event_message = "No event configured.";
-static time_t event_last_seen[64];
+static const char *frequent_header = "Frequent";
 static BITARRAY_DECLARE(long_event_running, 128);
+static bool running_loaded = false;
 
 static void
 set_subtitle(char *subtitle, uint16_t id) {
-	if (!event_last_seen[id]) {
+	time_t last_seen;
+
+	/* filled when the staged initialization rebuilds the main menu */
+	if (!event_stats_ready()) {
+		subtitle[0] = 0;
+		return;
+	}
+
+	last_seen = event_stats_last_seen(id);
+	if (!last_seen) {
 		strncpy(subtitle, "unknown", SUBTITLE_LENGTH);
 		return;
 	}
 
-	struct tm *tm = localtime(&event_last_seen[id]);
+	struct tm *tm = localtime(&last_seen);
 	size_t result = strftime(subtitle,
 	    SUBTITLE_LENGTH,
 	    SUBTITLE_FORMAT,
@@ -60,20 +75,73 @@ set_subtitle(char *subtitle, uint16_t id) {
 	}
 }
 
-static void
-update_last_seen(uint16_t id) {
-	event_last_seen[id] = time(0);
-	persist_write_data(KEY_EVENT_LAST_SEEN,
-	    event_last_seen, sizeof event_last_seen);
+_Static_assert(sizeof long_event_running % sizeof(uint32_t) == 0,
+    "running bitmap is not made of whole words");
+_Static_assert(sizeof long_event_running == RUNNING_EVENTS_STORAGE_SIZE,
+    "RUNNING_EVENTS_STORAGE_SIZE does not match the running bitmap");
+
+void
+event_menu_init(void) {
+	int ret;
+
+	if (running_loaded) return;
+	running_loaded = true;
+
+	ret = persist_read_data(KEY_LONG_EVENT_RUNNING,
+	    long_event_running, sizeof long_event_running);
+	if (ret < 0) memset(long_event_running, 0, sizeof long_event_running);
+}
+
+/* drawing does not load the bitmap, staged init reloads the menus after */
+static bool
+is_running(uint8_t index) {
+	return running_loaded && BITARRAY_TEST(long_event_running, index);
+}
+
+/* fills indices with running long events, scanning the bitmap by words */
+uint8_t
+event_menu_running(uint8_t *indices, uint8_t size) {
+	uint8_t count = 0;
+	uint32_t word;
+
+	if (!running_loaded) event_menu_init();
+	for (unsigned w = 0; w < sizeof long_event_running && count < size;
+	    w += sizeof word) {
+		memcpy(&word, long_event_running + w, sizeof word);
+		while (word && count < size) {
+			indices[count++] = w * CHAR_BIT + __builtin_ctz(word);
+			word &= word - 1;
+		}
+	}
+
+	return count;
 }
 
 static void
 toggle_long_event_running(uint16_t id) {
 	BITARRAY_TOGGLE(long_event_running, id);
-	persist_write_data(KEY_LONG_EVENT_RUNNING,
+	storage_write_data(KEY_LONG_EVENT_RUNNING,
 	    long_event_running, sizeof long_event_running);
 }
 
+/* records the event at index as if its main row had been selected */
+void
+event_menu_record(uint8_t index) {
+	bool running;
+
+	if (index >= event_names.count) return;
+
+	if (!long_event_id[index]) {
+		record_event(index + 1);
+		return;
+	}
+
+	event_menu_init();
+	running = is_running(index);
+	record_event(index + (running ? 128 : 1));
+	toggle_long_event_running(index);
+}
+
 static bool
 check_callback_context(int index, struct event_menu_context *context) {
 	if (!context) return false;
@@ -111,6 +179,28 @@ do_enter_submenu(int index, void *void_context) {
 	push_event_menu(id);
 }
 
+/* refreshes the frequent section in place, without rebuilding items */
+void
+event_menu_refresh_frequent(struct event_menu_context *context) {
+	const uint8_t old_count = context->frequent_count;
+
+	if (!context->has_frequent) return;
+
+	context->frequent_count = event_frequency_top(context->frequent,
+	    FREQUENT_MAX);
+	for (uint8_t i = 0; i < context->frequent_count; i += 1) {
+		set_subtitle(context->frequent_subtitles + i * SUBTITLE_LENGTH,
+		    context->frequent[i]);
+	}
+
+	if (!context->menu_layer) return;
+	if (context->frequent_count != old_count) {
+		menu_layer_reload_data(context->menu_layer);
+	} else {
+		layer_mark_dirty(menu_layer_get_layer(context->menu_layer));
+	}
+}
+
 static void
 do_record_short_event(int index, void *void_context) {
 	struct event_menu_context *context = void_context;
@@ -125,12 +215,11 @@ do_record_short_event(int index, void *void_context) {
 	subtitle = context->subtitles + corrected_index * SUBTITLE_LENGTH;
 
 	record_event(id + 1);
-	update_last_seen(id);
 	set_subtitle(subtitle, id);
+	event_menu_refresh_frequent(context);
 
 	if (context->menu_layer)
-		layer_mark_dirty(simple_menu_layer_get_layer
-		    (context->menu_layer));
+		layer_mark_dirty(menu_layer_get_layer(context->menu_layer));
 }
 
 static void
@@ -145,16 +234,33 @@ do_record_long_event(int index, void *void_context) {
 	corrected_index = (unsigned)index - context->extra_items;
 	secondary = (context->ids[corrected_index] >= 128);
 	id = context->ids[corrected_index] - (secondary ? 128 : 1);
-	running = BITARRAY_TEST(long_event_running, id);
+	event_menu_init();
+	running = is_running(id);
 
 	record_event(id + (secondary == running ? 1 : 128));
 	if (!secondary) toggle_long_event_running(id);
-	update_last_seen(id);
-	event_menu_rebuild(context);
+
+	/* both rows of a long event share the same subtitle buffer */
+	set_subtitle((char *)context->items[index].subtitle, id);
+	event_menu_refresh_frequent(context);
 
 	if (context->menu_layer)
-		layer_mark_dirty(simple_menu_layer_get_layer
-		    (context->menu_layer));
+		layer_mark_dirty(menu_layer_get_layer(context->menu_layer));
+}
+
+/* updates the subtitle of the top-level row of the event at index */
+static void
+update_row_subtitle(struct event_menu_context *context, uint8_t index) {
+	for (unsigned j = context->extra_items; j < context->num_items; j++) {
+		const SimpleMenuItem *item = context->items + j;
+
+		if (context->ids[j - context->extra_items] == index + 1
+		    && (item->callback == &do_record_short_event
+		     || item->callback == &do_record_long_event)) {
+			set_subtitle((char *)item->subtitle, index);
+			return;
+		}
+	}
 }
 
 bool
@@ -162,7 +268,7 @@ event_menu_rebuild(struct event_menu_context *context) {
 	SimpleMenuItem *items;
 	char *subtitles;
 	uint8_t *ids;
-	uint16_t size = 0, num_items;
+	uint16_t size = 0, secondary = 0, num_items;
 	const char *cur_prefix;
 	unsigned cur_prefix_length;
 	unsigned separator_length = strlen(directory_separator);
@@ -175,7 +281,7 @@ event_menu_rebuild(struct event_menu_context *context) {
 		const char *title = name;
 		const char *suffix;
 
-		if (name[0] == '-') continue;
+		if (name[0] == '-' || !event_profile_visible(i)) continue;
 		if (name[0] == '+') title = name + 1;
 		if (filter && strncmp(title, filter, filter_length) != 0) {
 			continue;
@@ -198,15 +304,16 @@ event_menu_rebuild(struct event_menu_context *context) {
 			cur_prefix = STRLIST_ITEM(event_prefixes, id);
 		}
 
-		if (name[0] == '+') {
-			size += 1;
+		/* long events shown here get a second row after the others */
+		if (name[0] == '+' && !cur_prefix) {
+			secondary += 1;
 		}
 	}
 
+	size += secondary;
 	num_items = (size ? size : 1) + context->extra_items;
 
-	if (context->section.num_items == num_items
-	    && context->items) {
+	if (context->num_items == num_items && context->items) {
 		items = context->items;
 		subtitles = context->subtitles;
 		ids = context->ids;
@@ -215,8 +322,8 @@ event_menu_rebuild(struct event_menu_context *context) {
 		if (!items) {
 			APP_LOG(APP_LOG_LEVEL_ERROR,
 			    "Unable to realloc event menu items from %"
-			    PRIu32 " to %" PRIu16,
-			    context->section.num_items, num_items);
+			    PRIu16 " to %" PRIu16,
+			    context->num_items, num_items);
 			return false;
 		}
 
@@ -226,8 +333,8 @@ event_menu_rebuild(struct event_menu_context *context) {
 		if (!subtitles) {
 			APP_LOG(APP_LOG_LEVEL_ERROR,
 			    "Unable to realloc subtitles from %"
-			    PRIu32 " to %" PRIu16,
-			    context->section.num_items, num_items);
+			    PRIu16 " to %" PRIu16,
+			    context->num_items, num_items);
 			free(items);
 			return false;
 		}
@@ -238,8 +345,8 @@ event_menu_rebuild(struct event_menu_context *context) {
 		if (!ids) {
 			APP_LOG(APP_LOG_LEVEL_ERROR,
 			    "Unable to realloc ids from %"
-			    PRIu32 " to %" PRIu16,
-			    context->section.num_items, num_items);
+			    PRIu16 " to %" PRIu16,
+			    context->num_items, num_items);
 			free(items);
 			free(subtitles);
 			return false;
@@ -248,9 +355,8 @@ event_menu_rebuild(struct event_menu_context *context) {
 		context->items = items;
 		context->subtitles = subtitles;
 		context->ids = ids;
-		context->section.num_items = num_items;
+		context->num_items = num_items;
 	}
-	context->section.items = items;
 
 	if (!size) {
 		items[context->extra_items] = (SimpleMenuItem){
@@ -260,7 +366,8 @@ event_menu_rebuild(struct event_menu_context *context) {
 	}
 
 	cur_prefix = 0;
-	for (uint16_t i = 0, j = context->extra_items;
+	for (uint16_t i = 0, j = context->extra_items,
+	    other_j = context->extra_items + size - secondary;
 	    i < event_names.count;
 	    i++) {
 		const char *name = STRLIST_UNSAFE_ITEM(event_names, i);
@@ -268,7 +375,7 @@ event_menu_rebuild(struct event_menu_context *context) {
 		char *subtitle;
 		char *suffix;
 
-		if (name[0] == '-') {
+		if (name[0] == '-' || !event_profile_visible(i)) {
 			continue;
 		}
 		if (name[0] == '+') title = name + 1;
@@ -305,32 +412,24 @@ event_menu_rebuild(struct event_menu_context *context) {
 		set_subtitle(subtitle, i);
 
 		if (name[0] == '+') {
-			uint8_t long_id = long_event_id[i] - 1;
-			uint8_t other_j = context->extra_items + size
-			    - long_event_count + long_id;
-			bool running = BITARRAY_TEST(long_event_running, i);
-
+			/* both rows are still filled, none is left unset */
 			if (long_event_id[i] == 0) {
 				APP_LOG(APP_LOG_LEVEL_ERROR,
 				    "long_event_id[%" PRIu16 "] is 0 "
 				    "even though name starts with '+'",
 				    i);
-				continue;
 			}
 
 			ids[j - context->extra_items] = i + 1;
 			ids[other_j - context->extra_items] = i + 128;
 
+			/* titles depend on running state, see draw_row */
 			items[j] = (SimpleMenuItem){
 			    .callback = &do_record_long_event,
-			    .title = STRLIST_UNSAFE_ITEM(running
-			      ? event_ends : event_begins, long_id),
 			    .subtitle = subtitle,
 			};
-			items[other_j] = (SimpleMenuItem){
+			items[other_j++] = (SimpleMenuItem){
 			    .callback = &do_record_long_event,
-			    .title = STRLIST_UNSAFE_ITEM(running
-			      ? event_begins : event_ends, long_id),
 			    .subtitle = subtitle,
 			};
 			j++;
@@ -348,6 +447,145 @@ event_menu_rebuild(struct event_menu_context *context) {
 }
 
 
+static bool
+is_frequent_section(const struct event_menu_context *context,
+    uint16_t section_index) {
+	return context->frequent_count && section_index == 0;
+}
+
+static uint16_t
+get_num_sections(MenuLayer *menu_layer, void *void_context) {
+	struct event_menu_context *context = void_context;
+
+	(void)menu_layer;
+	return context->frequent_count ? 2 : 1;
+}
+
+static uint16_t
+get_num_rows(MenuLayer *menu_layer, uint16_t section_index,
+    void *void_context) {
+	struct event_menu_context *context = void_context;
+
+	(void)menu_layer;
+	if (is_frequent_section(context, section_index))
+		return context->frequent_count;
+	return context->num_items;
+}
+
+static int16_t
+get_header_height(MenuLayer *menu_layer, uint16_t section_index,
+    void *void_context) {
+	struct event_menu_context *context = void_context;
+
+	(void)menu_layer;
+	return is_frequent_section(context, section_index)
+	    ? MENU_CELL_BASIC_HEADER_HEIGHT : 0;
+}
+
+static void
+draw_header(GContext *ctx, const Layer *cell_layer, uint16_t section_index,
+    void *void_context) {
+	struct event_menu_context *context = void_context;
+
+	if (is_frequent_section(context, section_index))
+		menu_cell_basic_header_draw(ctx, cell_layer, frequent_header);
+}
+
+static void
+draw_frequent_row(GContext *ctx, const Layer *cell_layer, uint16_t row,
+    struct event_menu_context *context) {
+	char buffer[TITLE_LENGTH];
+	const uint8_t index = context->frequent[row];
+	const bool ends = long_event_id[index] && is_running(index);
+
+	menu_cell_basic_draw(ctx, cell_layer,
+	    event_title(buffer, sizeof buffer, index + (ends ? 128 : 1)),
+	    context->frequent_subtitles + row * SUBTITLE_LENGTH, 0);
+}
+
+static void
+draw_row(GContext *ctx, const Layer *cell_layer, MenuIndex *cell_index,
+    void *void_context) {
+	struct event_menu_context *context = void_context;
+	const SimpleMenuItem *item;
+	char buffer[TITLE_LENGTH];
+	const char *title;
+
+	if (is_frequent_section(context, cell_index->section)) {
+		if (cell_index->row < context->frequent_count)
+			draw_frequent_row(ctx, cell_layer, cell_index->row,
+			    context);
+		return;
+	}
+
+	if (cell_index->row >= context->num_items) return;
+	item = context->items + cell_index->row;
+	title = item->title;
+
+	if (!title && cell_index->row >= context->extra_items) {
+		uint8_t raw_id
+		    = context->ids[cell_index->row - context->extra_items];
+		bool secondary = (raw_id >= 128);
+		uint8_t id = raw_id - (secondary ? 128 : 1);
+		bool running = is_running(id);
+
+		title = event_title(buffer, sizeof buffer,
+		    id + (secondary == running ? 1 : 128));
+	}
+
+	menu_cell_basic_draw(ctx, cell_layer, title, item->subtitle,
+	    item->icon);
+}
+
+static void
+select_click(MenuLayer *menu_layer, MenuIndex *cell_index,
+    void *void_context) {
+	struct event_menu_context *context = void_context;
+	const SimpleMenuItem *item;
+
+	(void)menu_layer;
+
+	if (is_frequent_section(context, cell_index->section)) {
+		uint8_t index;
+
+		if (cell_index->row >= context->frequent_count) return;
+		index = context->frequent[cell_index->row];
+		event_menu_record(index);
+		update_row_subtitle(context, index);
+		event_menu_refresh_frequent(context);
+		return;
+	}
+
+	if (cell_index->row >= context->num_items) return;
+	item = context->items + cell_index->row;
+	if (item->callback) item->callback(cell_index->row, context);
+}
+
+static void
+select_long_click(MenuLayer *menu_layer, MenuIndex *cell_index,
+    void *void_context) {
+	struct event_menu_context *context = void_context;
+	const SimpleMenuItem *item;
+	uint8_t raw_id;
+
+	(void)menu_layer;
+
+	if (is_frequent_section(context, cell_index->section)) {
+		if (cell_index->row < context->frequent_count)
+			push_event_log_menu(context->frequent[cell_index->row]);
+		return;
+	}
+
+	if (cell_index->row < context->extra_items
+	    || cell_index->row >= context->num_items) return;
+	item = context->items + cell_index->row;
+	if (item->callback != &do_record_short_event
+	    && item->callback != &do_record_long_event) return;
+
+	raw_id = context->ids[cell_index->row - context->extra_items];
+	push_event_log_menu(raw_id - (raw_id >= 128 ? 128 : 1));
+}
+
 struct event_menu_context *
 event_menu_build(Window *parent, unsigned extra_items,
     SimpleMenuItem *items, uint8_t filter_id) {
@@ -358,14 +596,13 @@ event_menu_build(Window *parent, unsigned extra_items,
 	if (!items) extra_items = 0;
 
 	context->menu_layer = 0;
-	context->section.title = 0;
-	context->section.items = 0;
-	context->section.num_items = 0;
+	context->num_items = 0;
 	context->subtitles = 0;
 	context->extra_items = extra_items;
 	context->items = 0;
 	context->ids = 0;
 	context->filter_id = filter_id;
+	context->has_frequent = (filter_id == INVALID_INDEX);
 
 	if (!event_menu_rebuild(context)) {
 		free(context);
@@ -377,19 +614,52 @@ event_menu_build(Window *parent, unsigned extra_items,
 	Layer *window_layer = window_get_root_layer(parent);
 	GRect bounds = layer_get_bounds(window_layer);
 
-	context->menu_layer = simple_menu_layer_create(bounds, parent,
-	    &context->section, 1, context);
+	context->menu_layer = menu_layer_create(bounds);
+	menu_layer_set_callbacks(context->menu_layer, context,
+	    (MenuLayerCallbacks) {
+		.get_num_sections = &get_num_sections,
+		.get_num_rows = &get_num_rows,
+		.get_header_height = &get_header_height,
+		.draw_header = &draw_header,
+		.draw_row = &draw_row,
+		.select_click = &select_click,
+		.select_long_click = &select_long_click,
+	    });
+	menu_layer_set_click_config_onto_window(context->menu_layer, parent);
 	layer_add_child(window_layer,
-	    simple_menu_layer_get_layer(context->menu_layer));
+	    menu_layer_get_layer(context->menu_layer));
+	event_menu_refresh_frequent(context);
+	metrics_sample_heap();
 	return context;
 }
 
+/* rebuilds the items under the existing layer, keeping its selection */
+bool
+event_menu_reload(struct event_menu_context *context, unsigned extra_items,
+    SimpleMenuItem *items) {
+	if (!items) extra_items = 0;
+
+	/* ids are sized without extra items, so a new count reallocates */
+	if (extra_items != context->extra_items) {
+		context->extra_items = extra_items;
+		context->num_items = 0;
+	}
+
+	if (!event_menu_rebuild(context)) return false;
+	if (extra_items > 0)
+		memcpy(context->items, items, extra_items * sizeof *items);
+
+	event_menu_refresh_frequent(context);
+	menu_layer_reload_data(context->menu_layer);
+	return true;
+}
+
 void
 event_menu_destroy(struct event_menu_context *context) {
-	simple_menu_layer_destroy(context->menu_layer);
-	free((void *)context->section.items);
-	context->section.items = 0;
-	context->section.num_items = 0;
+	menu_layer_destroy(context->menu_layer);
+	free(context->items);
+	context->items = 0;
+	context->num_items = 0;
 	free(context->subtitles);
 	free(context->ids);
 	free(context);
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pebble.h>
+
+#include "bitarray.h"
+#include "global.h"
+#include "storage.h"
+#include "strset.h"
+
+/*
+ * Event profiles select which configured events the menus show, e.g. for
+ * work days or travel. They share the event list, so log entries, stats
+ * and the phone keep using the same indices whatever the active profile.
+ * Only the directory prefixes depend on the profile: they are rebuilt
+ * from the event names on activation, and the previously active ones are
+ * kept in memory, so that switching back and forth only swaps two lists.
+ * Profile 0 shows every event and uses the main derived tables.
+ */
+
+struct __attribute__((__packed__)) event_profile {
+	char name[EVENT_PROFILE_NAME_LENGTH];
+	BITARRAY_DECLARE(visible, STRLIST_MAX_SIZE);
+};
+
+_Static_assert(sizeof(struct event_profile) == EVENT_PROFILE_WIRE_SIZE,
+    "EVENT_PROFILE_WIRE_SIZE does not match struct event_profile");
+
+/* profiles stored along with the hash of their prefix snapshot */
+struct __attribute__((__packed__)) hashed_profile {
+	struct event_profile profile;
+	uint32_t prefixes_hash;
+};
+
+_Static_assert(EVENT_PROFILE_MAX * sizeof(uint32_t)
+    < sizeof(struct event_profile),
+    "event profile layouts cannot be told apart");
+
+static const char *all_events_name = "All Events";
+
+static struct event_profile profiles[EVENT_PROFILE_MAX];
+static uint8_t profile_count = 0;
+static uint8_t active = 0;
+static struct string_list spare_prefixes = {0};
+static uint8_t spare_profile = INVALID_INDEX;
+
+_Static_assert(sizeof profiles == EVENT_PROFILE_STORAGE_SIZE,
+    "EVENT_PROFILE_STORAGE_SIZE does not match the profile table");
+
+static bool
+is_visible(uint8_t profile, uint8_t index) {
+	return !profile || profile > profile_count
+	    || BITARRAY_TEST(profiles[profile - 1].visible, index);
+}
+
+/* adds every prefix to the set when not null, returns their total size */
+static size_t
+walk_prefixes(struct string_list *prefixes, uint8_t profile) {
+	const unsigned separator_length = strlen(directory_separator);
+	size_t result = 0;
+
+	for (uint8_t i = 0; i < event_names.count; i += 1) {
+		const char *name = STRLIST_UNSAFE_ITEM(event_names, i);
+		const char *title = name;
+		const char *suffix;
+
+		if (name[0] == '-' || !is_visible(profile, i)) continue;
+		if (name[0] == '+') title = name + 1;
+
+		suffix = title - 1;
+		while (1) {
+			suffix = strstr(suffix + 1, directory_separator);
+			if (!suffix) break;
+
+			result += suffix + separator_length - title + 1;
+			if (prefixes) strset_include_reserved(prefixes,
+			    title, suffix + separator_length - title);
+		}
+	}
+
+	return result;
+}
+
+/* directory prefixes of the events shown by profile, in one allocation */
+void
+event_profile_prefixes(struct string_list *prefixes, uint8_t profile) {
+	size_t size;
+	char *data;
+
+	strlist_reset(prefixes);
+	if (!directory_separator[0]) return;
+
+	size = 1 + walk_prefixes(0, profile);
+	if (size == 1) return;
+
+	data = size <= UINT16_MAX ? malloc(size) : 0;
+	if (!data) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Unable to allocate %zu bytes for prefixes", size);
+		return;
+	}
+
+	data[0] = 0;
+	free(prefixes->data);
+	prefixes->data = data;
+	prefixes->size = 1;
+	walk_prefixes(prefixes, profile);
+
+	/* duplicates leave room at the end, given back at once */
+	data = realloc(prefixes->data, prefixes->size);
+	if (data) prefixes->data = data;
+}
+
+static void
+store_profiles(void) {
+	int ret = storage_write_data(KEY_EVENT_PROFILES,
+	    profiles, profile_count * sizeof *profiles);
+
+	if (ret < 0) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Error %d while writing event profiles", ret);
+	}
+}
+
+/* drops the hashes of prefix snapshots, which are no longer stored */
+static void
+import_hashed_profiles(void) {
+	struct hashed_profile hashed[EVENT_PROFILE_MAX];
+	int ret;
+
+	ret = persist_read_data(KEY_EVENT_PROFILES, hashed, sizeof hashed);
+	profile_count = ret > 0 ? ret / sizeof *hashed : 0;
+	for (uint8_t i = 0; i < profile_count; i += 1)
+		profiles[i] = hashed[i].profile;
+
+	store_profiles();
+	APP_LOG(APP_LOG_LEVEL_INFO, "Imported %u event profiles",
+	    (unsigned)profile_count);
+}
+
+/* makes profile active, its prefixes taking the place of the active ones */
+static void
+switch_prefixes(uint8_t profile) {
+	const struct string_list previous = event_prefixes;
+
+	/* the previous list becomes the spare one, either way */
+	event_prefixes = spare_prefixes;
+	spare_prefixes = previous;
+
+	if (spare_profile != profile)
+		event_profile_prefixes(&event_prefixes, profile);
+
+	spare_profile = active;
+	active = profile;
+}
+
+void
+event_profile_activate(uint8_t profile) {
+	const uint32_t start_ms = metrics_now_ms();
+
+	if (profile > profile_count) profile = 0;
+	if (profile == active) return;
+
+	switch_prefixes(profile);
+	storage_write_int(KEY_ACTIVE_PROFILE, active);
+	metrics_switch(start_ms);
+}
+
+void
+event_profile_init(void) {
+	uint8_t saved;
+	int ret;
+
+	ret = persist_get_size(KEY_EVENT_PROFILES);
+	if (ret > 0 && ret % sizeof *profiles) {
+		import_hashed_profiles();
+	} else {
+		ret = persist_read_data(KEY_EVENT_PROFILES,
+		    profiles, sizeof profiles);
+		profile_count = ret > 0 ? ret / sizeof *profiles : 0;
+	}
+
+	/* event_prefixes holds the main derived table at this point */
+	active = 0;
+	saved = persist_read_int(KEY_ACTIVE_PROFILE);
+	if (saved && saved <= profile_count) switch_prefixes(saved);
+}
+
+/* reapplies the active profile once the main derived tables changed */
+void
+event_profile_reload(void) {
+	const uint8_t profile = active;
+
+	strlist_reset(&spare_prefixes);
+	spare_profile = INVALID_INDEX;
+	active = 0;
+	if (profile) switch_prefixes(profile);
+}
+
+/* stores profile definitions received from the phone */
+void
+event_profile_configure(const uint8_t *const *data, uint8_t count) {
+	const uint8_t profile = active;
+
+	if (count > EVENT_PROFILE_MAX) count = EVENT_PROFILE_MAX;
+	memset(profiles, 0, sizeof profiles);
+
+	profile_count = 0;
+	for (uint8_t i = 0; i < count; i += 1) {
+		if (!data[i]) continue;
+		memcpy(profiles + profile_count, data[i],
+		    EVENT_PROFILE_WIRE_SIZE);
+		profiles[profile_count].name[EVENT_PROFILE_NAME_LENGTH - 1] = 0;
+		profile_count += 1;
+	}
+
+	store_profiles();
+
+	/* prefixes of the previous definitions are all stale */
+	strlist_reset(&spare_prefixes);
+	spare_profile = INVALID_INDEX;
+	if (!profile) return;
+
+	event_profile_prefixes(&event_prefixes, 0);
+	active = 0;
+	if (profile <= profile_count) switch_prefixes(profile);
+}
+
+bool
+event_profile_visible(uint8_t index) {
+	return is_visible(active, index);
+}
+
+uint8_t
+event_profile_count(void) {
+	return profile_count;
+}
+
+uint8_t
+event_profile_active(void) {
+	return active;
+}
+
+const char *
+event_profile_name(uint8_t profile) {
+	if (!profile || profile > profile_count) return all_events_name;
+	return profiles[profile - 1].name;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pebble.h>
+
+#include "global.h"
+#include "storage.h"
+
+#define STORE_PERIOD 8		/* records between page writes */
+
+struct __attribute__((__packed__)) event_stats {
+	time_t last_seen;
+	uint32_t total_duration;
+};
+
+#define STATS_PER_PAGE (PERSIST_DATA_MAX_LENGTH / sizeof(struct event_stats))
+#define STATS_PAGE_COUNT \
+	((STRLIST_MAX_SIZE + STATS_PER_PAGE - 1) / STATS_PER_PAGE)
+
+/* the last page only holds the stats of existing event indices */
+#define PAGE_STATS(page) ((page) < STATS_PAGE_COUNT - 1 ? STATS_PER_PAGE \
+	: STRLIST_MAX_SIZE - (STATS_PAGE_COUNT - 1) * STATS_PER_PAGE)
+
+_Static_assert(sizeof(struct event_stats) == EVENT_STATS_SIZE,
+    "EVENT_STATS_SIZE does not match struct event_stats");
+_Static_assert(STATS_PAGE_COUNT <= EVENT_STATS_PAGES,
+    "event stats do not fit in their key range");
+_Static_assert(STATS_PAGE_COUNT <= 8, "dirty pages do not fit in a byte");
+
+/* previous layout, with per-day counts of the last week */
+struct __attribute__((__packed__)) day_stats {
+	time_t last_seen;
+	uint32_t total_duration;
+	uint16_t day;
+	uint8_t day_count[7];
+};
+
+#define DAY_STATS_PER_PAGE \
+	(PERSIST_DATA_MAX_LENGTH / sizeof(struct day_stats))
+
+_Static_assert(DAY_STATS_PER_PAGE * sizeof(struct day_stats)
+    != STATS_PER_PAGE * sizeof(struct event_stats),
+    "event stats layouts cannot be told apart");
+
+static struct event_stats stats[STATS_PAGE_COUNT * STATS_PER_PAGE];
+static bool loaded = false;
+static uint8_t dirty_pages = 0;
+static uint8_t unstored = 0;		/* records since the last write */
+
+static void
+store_page(unsigned page) {
+	int ret = storage_write_data(KEY_EVENT_STATS + page,
+	    stats + page * STATS_PER_PAGE,
+	    PAGE_STATS(page) * sizeof *stats);
+
+	if (ret < 0) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Error %d while writing event stats page %u",
+		    ret, page);
+	} else {
+		dirty_pages &= ~(1u << page);
+	}
+}
+
+/* seed last seen times from the table used before event stats existed */
+static void
+import_last_seen(void) {
+	time_t last_seen[64];
+	int ret;
+
+	ret = persist_read_data(KEY_EVENT_LAST_SEEN,
+	    last_seen, sizeof last_seen);
+	if (ret <= 0) return;
+
+	for (unsigned i = 0; i < ret / sizeof *last_seen; i += 1) {
+		stats[i].last_seen = last_seen[i];
+	}
+
+	for (unsigned page = 0; page < STATS_PAGE_COUNT; page += 1) {
+		store_page(page);
+	}
+	storage_delete(KEY_EVENT_LAST_SEEN);
+}
+
+/* converts the pages of the previous layout, dropping per-day counts */
+static void
+import_day_stats(void) {
+	struct day_stats page_stats[DAY_STATS_PER_PAGE];
+	unsigned index = 0;
+	int ret;
+
+	for (unsigned page = 0; page < EVENT_STATS_PAGES; page += 1) {
+		ret = persist_read_data(KEY_EVENT_STATS + page,
+		    page_stats, sizeof page_stats);
+		for (unsigned i = 0; ret > 0 && i < DAY_STATS_PER_PAGE
+		    && index < STRLIST_MAX_SIZE; i += 1, index += 1) {
+			stats[index].last_seen = page_stats[i].last_seen;
+			stats[index].total_duration
+			    = page_stats[i].total_duration;
+		}
+	}
+
+	/* old pages take more than the range holds, so they go first */
+	for (unsigned page = 0; page < EVENT_STATS_PAGES; page += 1) {
+		if (persist_exists(KEY_EVENT_STATS + page))
+			storage_delete(KEY_EVENT_STATS + page);
+	}
+	for (unsigned page = 0; page < STATS_PAGE_COUNT; page += 1) {
+		store_page(page);
+	}
+	APP_LOG(APP_LOG_LEVEL_INFO, "Imported event stats of the previous"
+	    " layout");
+}
+
+void
+event_stats_init(void) {
+	bool found = false;
+	int ret;
+
+	if (loaded) return;
+	loaded = true;
+
+	if (persist_get_size(KEY_EVENT_STATS)
+	    == DAY_STATS_PER_PAGE * sizeof(struct day_stats)) {
+		import_day_stats();
+		return;
+	}
+
+	for (unsigned page = 0; page < STATS_PAGE_COUNT; page += 1) {
+		ret = persist_read_data(KEY_EVENT_STATS + page,
+		    stats + page * STATS_PER_PAGE,
+		    STATS_PER_PAGE * sizeof *stats);
+		if (ret > 0) found = true;
+	}
+
+	if (!found) import_last_seen();
+}
+
+bool
+event_stats_ready(void) {
+	return loaded;
+}
+
+/* the table is written every STORE_PERIOD records and on exit */
+void
+event_stats_record(uint8_t id, time_t time, int32_t duration) {
+	const bool is_end = (id >= 128);
+	const uint8_t index = is_end ? id - 128 : id - 1;
+	struct event_stats *s;
+
+	if (!id || index >= STRLIST_MAX_SIZE) return;
+	if (!loaded) event_stats_init();
+	s = stats + index;
+	s->last_seen = time;
+	if (is_end && duration > 0) s->total_duration += duration;
+
+	dirty_pages |= 1u << (index / STATS_PER_PAGE);
+	if (++unstored >= STORE_PERIOD) event_stats_store();
+}
+
+void
+event_stats_store(void) {
+	for (unsigned page = 0; page < STATS_PAGE_COUNT; page += 1) {
+		if (dirty_pages & (1u << page)) store_page(page);
+	}
+	unstored = 0;
+}
+
+time_t
+event_stats_last_seen(uint8_t index) {
+	if (!loaded) event_stats_init();
+	return index < STRLIST_MAX_SIZE ? stats[index].last_seen : 0;
+}
+
+uint32_t
+event_stats_total_duration(uint8_t index) {
+	if (!loaded) event_stats_init();
+	return index < STRLIST_MAX_SIZE ? stats[index].total_duration : 0;
+}
@@ -16,12 +16,37 @@
 
 #include "global.h"
 
+#pragma message PROFILE_SUMMARY
+
 struct string_list event_names = {0};
-struct string_list event_begins = {0};
-struct string_list event_ends = {0};
 struct string_list event_prefixes = {0};
 uint8_t long_event_id[STRLIST_MAX_SIZE] = {0};
 uint8_t long_event_count = 0;
 char begin_prefix[PREFIX_LENGTH] = "Start of ";
 char end_prefix[PREFIX_LENGTH] = "End of ";
 char directory_separator[PREFIX_LENGTH] = "";
+uint8_t transport = TRANSPORT_IMMEDIATE;
+
+/* title of the event logged as id, composed into buffer for long events */
+const char *
+event_title(char *buffer, size_t size, uint8_t id) {
+	const bool is_end = (id >= 128);
+	const uint8_t index = is_end ? id - 128 : id - 1;
+	const char *name;
+
+	if (!id || index >= event_names.count) return 0;
+
+	name = STRLIST_UNSAFE_ITEM(event_names, index);
+	if (!long_event_id[index]) return name;
+
+	snprintf(buffer, size, "%s%s",
+	    is_end ? end_prefix : begin_prefix, name + 1);
+	return buffer;
+}
+
+/* number of days since the epoch, in local time */
+uint16_t
+local_day(time_t time) {
+	struct tm *tm = localtime(&time);
+	return (time + tm->tm_gmtoff) / 86400;
+}
@@ -18,35 +18,254 @@
 
 #include <pebble.h>
 
+#include "keys.h"
+#include "profile.h"
+#include "storage.h"
 #include "strlist.h"
 
-#define PREFIX_LENGTH 32
+#define PREFIX_LENGTH 24
+#define TITLE_LENGTH PROFILE_TITLE_LENGTH
 
-#define KEY_EVENT_LOG		 100
-#define KEY_EVENT_LAST_SEEN	 200
-#define KEY_LONG_EVENT_RUNNING	 210
-#define KEY_RECORD_TIME		 500
-#define KEY_RECORD_TITLE	 510
-#define KEY_BEGIN_PREFIX	 901
-#define KEY_END_PREFIX		 902
-#define KEY_DIRECTORY_SEPARATOR	 910
-#define KEY_EVENT_NAMES		1000
+#define LOG_ENTRY_SIZE 5
+#define LOG_SEGMENT_LENGTH (PERSIST_DATA_MAX_LENGTH / LOG_ENTRY_SIZE)
+#define LOG_SEGMENT_COUNT 4
+#define LOG_CAPACITY (LOG_SEGMENT_LENGTH * LOG_SEGMENT_COUNT)
+#define LOG_NO_DURATION UINT16_MAX
+#define LOG_STORAGE_SIZE \
+	(LOG_SEGMENT_COUNT * LOG_SEGMENT_LENGTH * LOG_ENTRY_SIZE)
+
+/* sequence pair and time range with an event bitmap for each segment */
+#define LOG_HEADER_SIZE (2 * sizeof(uint32_t) + LOG_SEGMENT_COUNT \
+	* (2 * sizeof(time_t) + (STRLIST_MAX_SIZE + 7) / 8))
+
+#define MAX_OPEN_INTERVALS 8
+#define OPEN_INTERVAL_SIZE 9
+#define OPEN_INTERVALS_STORAGE_SIZE (MAX_OPEN_INTERVALS * OPEN_INTERVAL_SIZE)
+
+#define ROLLUP_STORAGE_SIZE PERSIST_DATA_MAX_LENGTH
+
+#define KEPT_ENTRY_SIZE 11
+#define LOG_PARTITION_PAGE_LENGTH \
+	((PERSIST_DATA_MAX_LENGTH - 1) / KEPT_ENTRY_SIZE)
+#define LOG_PARTITION_PAGES 2
+#define LOG_PARTITION_CAPACITY \
+	(LOG_PARTITION_PAGES * LOG_PARTITION_PAGE_LENGTH)
+#define LOG_PARTITION_SPEC_LENGTH 64
+#define LOG_PARTITION_STORAGE_SIZE (LOG_PARTITION_PAGES \
+	* (1 + LOG_PARTITION_PAGE_LENGTH * KEPT_ENTRY_SIZE))
+
+/* three prefix strings, the partition spec and five integers */
+#define SETTINGS_STORAGE_SIZE \
+	(3 * PREFIX_LENGTH + LOG_PARTITION_SPEC_LENGTH + 5 * sizeof(int32_t))
+
+#define RUNNING_EVENTS_STORAGE_SIZE (128 / 8)
+
+#define EVENT_STATS_PAGES 8
+#define EVENT_STATS_SIZE 8
+#define EVENT_STATS_STORAGE_SIZE (STRLIST_MAX_SIZE * EVENT_STATS_SIZE)
+
+#define FREQUENT_MAX 5
+
+/* epoch, top list and a score for each event */
+#define EVENT_FREQUENCY_STORAGE_SIZE (sizeof(time_t) + 1 + FREQUENT_MAX \
+	+ STRLIST_MAX_SIZE * sizeof(uint16_t))
+
+#define EVENT_PROFILE_MAX 4
+#define EVENT_PROFILE_NAME_LENGTH 16
+#define EVENT_PROFILE_WIRE_SIZE \
+	(EVENT_PROFILE_NAME_LENGTH + (STRLIST_MAX_SIZE + 7) / 8)
+#define EVENT_PROFILE_STORAGE_SIZE \
+	(EVENT_PROFILE_MAX * EVENT_PROFILE_WIRE_SIZE)
+
+/* what is left of the budget, names dropped from the end beyond it */
+#define EVENT_NAMES_MAX_SIZE 1016
+#define EVENT_NAMES_STORAGE_SIZE (sizeof(int32_t) + EVENT_NAMES_MAX_SIZE)
+
+/* size key followed by as many pages as the whole budget could hold */
+#define STRLIST_KEY_COUNT (1 + STORAGE_BUDGET / PERSIST_DATA_MAX_LENGTH)
 
 extern struct string_list event_names;
-extern struct string_list event_begins;
-extern struct string_list event_ends;
 extern struct string_list event_prefixes;
 extern uint8_t long_event_id[STRLIST_MAX_SIZE];
 extern uint8_t long_event_count;
 extern char begin_prefix[PREFIX_LENGTH];
 extern char end_prefix[PREFIX_LENGTH];
 extern char directory_separator[PREFIX_LENGTH];
+extern uint8_t transport;
 
 struct event_menu_context;
 
+struct log_entry {
+	uint32_t seq;
+	time_t time;
+	uint8_t id;
+	uint16_t duration;
+};
+
+struct log_day {
+	uint16_t day;
+	uint32_t first;
+	uint32_t end;
+};
+
+struct log_query {
+	uint32_t seq;
+	uint32_t end;
+	time_t to;
+	uint8_t index;
+};
+
+const char *
+event_title(char *buffer, size_t size, uint8_t id);
+
+uint16_t
+local_day(time_t time);
+
 void
 event_log_init(void);
 
+uint32_t
+event_log_begin(void);
+
+uint32_t
+event_log_end(void);
+
+bool
+event_log_read(uint32_t seq, struct log_entry *entry);
+
+uint32_t
+event_log_epoch(void);
+
+uint32_t
+event_log_sent(void);
+
+void
+event_log_mark_sent(uint32_t seq);
+
+void
+event_log_query_start(struct log_query *query,
+    time_t from, time_t to, uint8_t index);
+
+bool
+event_log_query_next(struct log_query *query, struct log_entry *entry);
+
+uint16_t
+event_log_query(time_t from, time_t to, uint8_t index,
+    bool (*callback)(const struct log_entry *entry, void *context),
+    void *context);
+
+uint16_t
+event_log_filter(uint8_t index, unsigned char *matches);
+
+uint8_t
+event_log_day_count(void);
+
+bool
+event_log_day(uint8_t index, struct log_day *day);
+
+time_t
+event_log_running_since(uint8_t index);
+
+uint16_t
+event_log_count(uint8_t index, time_t from, time_t to, uint32_t *duration);
+
+void
+log_rollup_add(time_t time, uint8_t id, uint16_t duration);
+
+void
+log_rollup_store(void);
+
+uint16_t
+log_rollup_count(uint8_t index, uint16_t first_day, uint16_t last_day,
+    uint32_t *duration);
+
+void
+log_partition_init(void);
+
+void
+log_partition_configure(const char *spec);
+
+void
+log_partition_keep(const struct log_entry *entry);
+
+void
+log_partition_store(void);
+
+uint16_t
+log_partition_count(uint32_t before);
+
+bool
+log_partition_next(uint32_t *before, struct log_entry *entry);
+
+bool
+log_partition_prev(uint32_t *after, struct log_entry *entry);
+
+void
+event_stats_init(void);
+
+bool
+event_stats_ready(void);
+
+void
+event_stats_record(uint8_t id, time_t time, int32_t duration);
+
+time_t
+event_stats_last_seen(uint8_t index);
+
+uint32_t
+event_stats_total_duration(uint8_t index);
+
+void
+event_stats_store(void);
+
+void
+event_profile_init(void);
+
+void
+event_profile_prefixes(struct string_list *prefixes, uint8_t profile);
+
+void
+event_profile_activate(uint8_t profile);
+
+void
+event_profile_reload(void);
+
+void
+event_profile_configure(const uint8_t *const *data, uint8_t count);
+
+bool
+event_profile_visible(uint8_t index);
+
+uint8_t
+event_profile_count(void);
+
+uint8_t
+event_profile_active(void);
+
+const char *
+event_profile_name(uint8_t profile);
+
+void
+event_frequency_record(uint8_t id, time_t time);
+
+uint8_t
+event_frequency_top(uint8_t *indices, uint8_t size);
+
+void
+event_frequency_configure(uint8_t count);
+
+void
+event_frequency_reset(void);
+
+void
+event_frequency_store(void);
+
+void
+event_menu_init(void);
+
+uint8_t
+event_menu_running(uint8_t *indices, uint8_t size);
+
 struct event_menu_context *
 event_menu_build(Window *parent, unsigned extra_items,
     SimpleMenuItem *items, uint8_t filter_id);
@@ -54,9 +273,19 @@ event_menu_build(Window *parent, unsigned extra_items,
 bool
 event_menu_rebuild(struct event_menu_context *context);
 
+void
+event_menu_refresh_frequent(struct event_menu_context *context);
+
+bool
+event_menu_reload(struct event_menu_context *context, unsigned extra_items,
+    SimpleMenuItem *items);
+
 void
 event_menu_destroy(struct event_menu_context *context);
 
+void
+event_menu_record(uint8_t index);
+
 void
 push_event_menu(uint8_t filter_id);
 
@@ -66,11 +295,53 @@ push_main_menu(void);
 void
 push_log_menu(void);
 
+void
+push_event_log_menu(uint8_t index);
+
+void
+push_stats_menu(void);
+
+void
+push_running_menu(void);
+
+void
+push_profile_menu(void);
+
 void
 record_event(uint8_t id);
 
-bool
-send_recorded_event(time_t time, uint8_t id, const char *title);
+void
+outbox_init(void);
+
+void
+outbox_deinit(void);
+
+void
+outbox_flush(void);
+
+void
+outbox_send_latest(void);
+
+void
+outbox_pull(uint32_t seq, time_t from, time_t to);
+
+void
+outbox_send_names(void);
 
 void
 update_main_menu(void);
+
+uint32_t
+metrics_now_ms(void);
+
+void
+metrics_sample_heap(void);
+
+void
+metrics_tap(uint32_t start_ms);
+
+void
+metrics_switch(uint32_t start_ms);
+
+void
+metrics_report(void);
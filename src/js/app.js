@@ -19,6 +19,12 @@ const settings = {  /* "name in local storage": "form input parameter" */
    "begin-prefix":  "bpre",
    "end-prefix":    "epre",
    "dir-sep":       "dsep",
+   "transport":     "tr",
+   "background-worker": "bgw",
+   "quick-event":   "qev",
+   "frequent-count": "freq",
+   "event-profiles": "prof",
+   "log-partitions": "lpart",
 };
 
 var cfg_endpoint = null;
@@ -30,12 +36,32 @@ var cfg_sign_field_format = "";
 var cfg_sign_key = "";
 var cfg_sign_key_format = "";
 
+const ARCHIVE_CHUNK_RECORDS = 32;
+const ARCHIVE_MAX_CHUNKS = 64;
+const LEGACY_CHUNK_LINES = 128;
+const RETRY_DELAY_MS = 30000;
+const STATS_PERIOD = 100;
+const QUEUE_STORE_PERIOD = 32;
+const MESSAGE_ATTEMPTS = 3;
+const PROFILE_MAX = 4;
+const PROFILE_NAME_LENGTH = 16;
+const EVENT_MAX = 83;
+
 var to_send = [];
+var to_send_done = 0;
 var senders = [new XMLHttpRequest(), new XMLHttpRequest()];
 var i_sender = 1;
+var replay_sender = new XMLHttpRequest();
+var replay_end = 0;
+var archive_chunk = null;
+var archive_index = -1;
+var names_received = null;
+var retry_timer = null;
+var upload_stats = { lines: 0, since: 0, peak_queue: 0, bytes_stored: 0 };
+var link_stats = { records: 0, duplicates: 0, lost: 0 };
 var jsSHA = require("/src/js/sha.js");
 
-function sendPayload(payload) {
+function formData(payload) {
    var data = new FormData();
    data.append(cfg_data_field, payload);
 
@@ -55,37 +81,524 @@ function sendPayload(payload) {
       }
    }
 
+   return data;
+}
+
+function sendPayload(payload) {
    i_sender = 1 - i_sender;
    senders[i_sender].open("POST", cfg_endpoint, true);
-   senders[i_sender].send(data);
+   senders[i_sender].send(formData(payload));
+}
+
+/* localStorage writes of the upload paths, accounted in upload_stats */
+function storeItem(key, value) {
+   var str = String(value);
+   upload_stats.bytes_stored += key.length + str.length;
+   localStorage.setItem(key, str);
 }
 
 function sendHead() {
    if (to_send.length < 1) return;
    sendPayload(to_send[0].split(";")[1]);
+   senders[i_sender].entry = to_send[0];
+}
+
+function logUploadStats() {
+   var elapsed = (Date.now() - upload_stats.since) / 1000;
+   console.log("Uploaded " + upload_stats.lines + " lines"
+    + (elapsed > 0 ? ", " + (upload_stats.lines / elapsed).toFixed(1)
+      + " lines/s" : "")
+    + ", queue peak " + upload_stats.peak_queue
+    + ", " + upload_stats.bytes_stored + " bytes stored");
+}
+
+/* upload line of an entry, duration being in seconds when present */
+function entryLine(time, id, title, seconds) {
+   var line = new Date(time * 1000).toISOString().replace(/\.\d+Z$/, "Z")
+    + "," + id + "," + title;
+   if (seconds !== undefined) {
+      line += "," + seconds;
+   }
+   return line;
+}
+
+/*
+ * Recent enqueued entries, as JSON chunks of ARCHIVE_CHUNK_RECORDS entries
+ * [time, id, title index, seconds?] with a table of the chunk titles.
+ * Only the last ARCHIVE_MAX_CHUNKS chunks are kept, older ones being
+ * pruned first when localStorage is full.
+ */
+function archiveCount() {
+   return parseInt(localStorage.getItem("archiveCount") || "0", 10);
+}
+
+function archiveFirst() {
+   return parseInt(localStorage.getItem("archiveFirst") || "0", 10);
+}
+
+function archiveLines(begin, end) {
+   var index = Math.floor(begin / ARCHIVE_CHUNK_RECORDS);
+   var offset = begin - index * ARCHIVE_CHUNK_RECORDS;
+   var stored = localStorage.getItem("archiveChunk-" + index);
+   var chunk = stored ? JSON.parse(stored) : { t: [], r: [] };
+
+   return chunk.r.slice(offset, offset + Math.min(end - begin,
+    ARCHIVE_CHUNK_RECORDS - offset)).map(function(entry) {
+      return entryLine(entry[0], entry[1], chunk.t[entry[2]], entry[3]);
+   });
 }
 
-function enqueue(key, line) {
-   to_send.push(key + ";" + line);
-   localStorage.setItem("toSend", to_send.join("|"));
+/* drops the oldest chunk, unless it is the one being filled */
+function pruneArchive() {
+   var first = archiveFirst();
+
+   if (first + ARCHIVE_CHUNK_RECORDS > archiveCount()) return false;
+   localStorage.removeItem("archiveChunk-" + first / ARCHIVE_CHUNK_RECORDS);
+   storeItem("archiveFirst", first + ARCHIVE_CHUNK_RECORDS);
+   return true;
+}
+
+function storeChunk(key, value) {
+   try {
+      storeItem(key, value);
+      return true;
+   } catch (e) {
+      return false;
+   }
+}
+
+function archive(time, id, title, seconds) {
+   var count = archiveCount();
+   var index = Math.floor(count / ARCHIVE_CHUNK_RECORDS);
+   var key = "archiveChunk-" + index;
+
+   if (count % ARCHIVE_CHUNK_RECORDS === 0) {
+      archive_chunk = { t: [], r: [] };
+   } else if (archive_index !== index) {
+      var stored = localStorage.getItem(key);
+      archive_chunk = stored ? JSON.parse(stored) : { t: [], r: [] };
+   }
+   archive_index = index;
+
+   var title_index = archive_chunk.t.indexOf(title);
+   if (title_index < 0) {
+      title_index = archive_chunk.t.length;
+      archive_chunk.t.push(title);
+   }
+
+   var entry = [time, id, title_index];
+   if (seconds !== undefined) entry.push(seconds);
+   archive_chunk.r.push(entry);
+
+   while (!storeChunk(key, JSON.stringify(archive_chunk))) {
+      if (!pruneArchive()) {
+         console.log("Archive: storage full, entry not archived");
+         archive_chunk.r.pop();
+         return;
+      }
+   }
+   storeItem("archiveCount", count + 1);
+
+   while (index + 1 - archiveFirst() / ARCHIVE_CHUNK_RECORDS
+    > ARCHIVE_MAX_CHUNKS && pruneArchive());
+}
+
+/* converts the plain-text archive chunks of earlier versions */
+function migrateArchive() {
+   var lines = localStorage.getItem("archiveLines");
+   if (lines === null) return;
+
+   if (localStorage.getItem("replayEnd") !== null) {
+      console.log("Archive: replay of the previous format abandoned");
+      localStorage.removeItem("replayPos");
+      localStorage.removeItem("replayEnd");
+   }
+
+   for (var chunk = 0; chunk * LEGACY_CHUNK_LINES < parseInt(lines, 10);
+    chunk += 1) {
+      var stored = localStorage.getItem("archive-" + chunk);
+      localStorage.removeItem("archive-" + chunk);
+      if (!stored) continue;
+
+      stored.split("\n").forEach(function(line) {
+         var fields = line.split(",");
+         if (fields.length < 3) return;
+         archive(Date.parse(fields[0]) / 1000, parseInt(fields[1], 10),
+          fields[2], fields.length > 3 ? parseInt(fields[3], 10) : undefined);
+      });
+   }
+
+   localStorage.removeItem("archiveLines");
+   console.log("Archive: converted " + lines + " lines");
+}
+
+/* replays the archive up to replay_end, one chunk per signed request */
+function replayNext() {
+   var pos = parseInt(localStorage.getItem("replayPos") || "0", 10);
+   if (pos < archiveFirst()) {
+      console.log("Replay: " + (archiveFirst() - pos) + " lines pruned");
+      pos = archiveFirst();
+   }
+   if (pos >= replay_end) {
+      console.log("Replay complete, " + replay_end + " lines sent");
+      localStorage.removeItem("replayPos");
+      localStorage.removeItem("replayEnd");
+      return;
+   }
+
+   var lines = archiveLines(pos, replay_end);
+   if (lines.length < 1) {
+      console.log("Replay: archive chunk missing at line " + pos);
+      storeItem("replayPos", pos + ARCHIVE_CHUNK_RECORDS
+       - pos % ARCHIVE_CHUNK_RECORDS);
+      replayNext();
+      return;
+   }
+
+   replay_sender.batchEnd = pos + lines.length;
+   replay_sender.open("POST", cfg_endpoint, true);
+   replay_sender.send(formData(lines.join("\n")));
+}
+
+function replayError() {
+   console.log("Replay stopped: " + this.statusText);
+}
+
+function replayDone() {
+   if (this.status < 200 || this.status >= 300) {
+      console.log("Replay stopped: " + this.status + " " + this.statusText);
+      return;
+   }
+   storeItem("replayPos", this.batchEnd);
+   console.log("Replay: " + this.batchEnd + "/" + replay_end + " lines");
+   replayNext();
+}
+
+function startReplay() {
+   replay_end = archiveCount();
+   storeItem("replayPos", archiveFirst());
+   storeItem("replayEnd", replay_end);
+   console.log("Replaying " + (replay_end - archiveFirst())
+    + " archived lines");
+   replayNext();
+}
+
+function enqueue(record) {
+   var title = eventTitle(record.id);
+   var seconds = (record.flags & 1) ? record.duration * 60 : undefined;
+
+   archive(record.time, record.id, title, seconds);
+   to_send.push(record.time + ";"
+    + entryLine(record.time, record.id, title, seconds));
+   if (to_send.length > upload_stats.peak_queue) {
+      upload_stats.peak_queue = to_send.length;
+   }
    if (to_send.length === 1) {
       sendHead();
    }
 }
 
+/*
+ * Stores the upload queue, once per batch of enqueued records. Uploaded
+ * lines only update toSendDone, the count of stored lines already sent,
+ * and the queue is rewritten every QUEUE_STORE_PERIOD of them.
+ */
+function storeQueue() {
+   storeItem("toSend", to_send.join("|"));
+   if (to_send_done > 0) localStorage.removeItem("toSendDone");
+   to_send_done = 0;
+}
+
+function uploadError() {
+   console.log("Upload failed: " + this.status + " " + this.statusText);
+   if (retry_timer === null) {
+      retry_timer = setTimeout(function() {
+         retry_timer = null;
+         sendHead();
+      }, RETRY_DELAY_MS);
+   }
+}
+
 function uploadDone() {
+   if (this.status < 200 || this.status >= 300) {
+      uploadError.call(this);
+      return;
+   }
+
+   /* a late answer for a line already acknowledged must not shift another */
+   if (to_send.length < 1 || to_send[0] !== this.entry) {
+      console.log("Ignoring answer for a line no longer queued");
+      return;
+   }
+
    var sent_key = to_send.shift().split(";")[0];
-   localStorage.setItem("toSend", to_send.join("|"));
-   localStorage.setItem("lastSent", sent_key);
+   to_send_done += 1;
+   if (to_send_done >= QUEUE_STORE_PERIOD || to_send.length === 0) {
+      storeQueue();
+   } else {
+      storeItem("toSendDone", to_send_done);
+   }
+   storeItem("lastSent", sent_key);
+
+   if (upload_stats.lines === 0) upload_stats.since = Date.now();
+   upload_stats.lines += 1;
+   if (upload_stats.lines % STATS_PERIOD === 0 || to_send.length === 0) {
+      logUploadStats();
+   }
+
    sendHead();
 }
 
-function uploadError() { console.log(this.statusText); }
+function eventTitle(id) {
+   var names = (localStorage.getItem("event-list") || "").split(",");
+   var is_end = (id >= 128);
+   var name = names[is_end ? id - 128 : id - 1];
+
+   if (!name) return "";
+   if (name.charAt(0) !== "+") return name;
+
+   var prefix = localStorage.getItem(is_end ? "end-prefix" : "begin-prefix");
+   if (prefix === null) prefix = is_end ? "End of " : "Start of ";
+   return prefix + name.substring(1);
+}
+
+/* "Work=Work/|Caffeine, Travel=Travel/" into the packed watch records */
+function encodeProfiles(spec, events) {
+   var result = [];
+   var items = spec ? spec.split(",") : [];
+
+   for (var i = 0; i < items.length && result.length < PROFILE_MAX; i++) {
+      var sep = items[i].indexOf("=");
+      if (sep < 0) continue;
+      var name = items[i].substring(0, sep).trim();
+      var prefixes = items[i].substring(sep + 1).split("|").map(function(p) {
+         return p.trim();
+      }).filter(function(p) { return p !== ""; });
+      var bytes = [];
+
+      /* UTF-8, NUL-terminated and padded */
+      name = unescape(encodeURIComponent(name));
+      for (var j = 0; j < PROFILE_NAME_LENGTH; j++) {
+         bytes.push(j < PROFILE_NAME_LENGTH - 1 && j < name.length
+          ? name.charCodeAt(j) : 0);
+      }
+      for (j = 0; j < Math.ceil(EVENT_MAX / 8); j++) {
+         bytes.push(0);
+      }
+      for (j = 0; j < events.length && j < EVENT_MAX; j++) {
+         var title = events[j].replace(/^[+-]/, "");
+         if (prefixes.some(function(p) { return title.indexOf(p) === 0; })) {
+            bytes[PROFILE_NAME_LENGTH + (j >> 3)] |= 1 << (j & 7);
+         }
+      }
+      result.push(bytes);
+   }
+
+   return result;
+}
+
+function readUint32(bytes, offset) {
+   return (bytes[offset] | (bytes[offset + 1] << 8)
+    | (bytes[offset + 2] << 16)) + bytes[offset + 3] * 16777216;
+}
+
+/* version byte then fixed-size records, see src/outbox.c */
+function decodeRecords(bytes) {
+   var result = [];
+   if (bytes[0] !== 1) {
+      console.log("Unsupported record version " + bytes[0]);
+      return result;
+   }
+   for (var i = 1; i + 12 <= bytes.length; i += 12) {
+      result.push({
+         seq: readUint32(bytes, i),
+         time: readUint32(bytes, i + 4),
+         id: bytes[i + 8],
+         flags: bytes[i + 9],
+         duration: bytes[i + 10] | (bytes[i + 11] << 8),
+      });
+   }
+   return result;
+}
+
+/* a new epoch means the watch log restarted its sequence numbers */
+function checkEpoch(epoch) {
+   var stored = localStorage.getItem("logEpoch");
+
+   if (epoch === undefined || stored === String(epoch)) return;
+   if (stored !== null) {
+      console.log("Link: watch log epoch changed, resetting sequence");
+      localStorage.removeItem("lastSeq");
+      localStorage.removeItem("pullSeq");
+      localStorage.removeItem("pullAfter");
+      localStorage.removeItem("pullFrom");
+      localStorage.removeItem("pullTo");
+   }
+   storeItem("logEpoch", epoch);
+}
+
+function enqueueRecords(bytes) {
+   var str_last_seq = localStorage.getItem("lastSeq");
+   var last_seq = str_last_seq ? parseInt(str_last_seq, 10) : -1;
+   var records = decodeRecords(bytes);
+   var anomalies = link_stats.duplicates + link_stats.lost;
+
+   for (var i = 0; i < records.length; i += 1) {
+      link_stats.records += 1;
+      if (records[i].seq <= last_seq) {
+         link_stats.duplicates += 1;
+         continue;
+      }
+      if (last_seq >= 0 && records[i].seq > last_seq + 1) {
+         link_stats.lost += records[i].seq - last_seq - 1;
+      }
+      enqueue(records[i]);
+      last_seq = records[i].seq;
+   }
+
+   storeQueue();
+   storeItem("lastSeq", last_seq);
+   if (link_stats.duplicates + link_stats.lost === anomalies) return;
+   console.log("Link: " + link_stats.records + " records received, "
+    + link_stats.duplicates + " duplicates, " + link_stats.lost + " lost");
+}
+
+/* sends a message to the watch, retrying with a growing delay on failure */
+function sendMessage(dict, what, attempt, start) {
+   if (attempt === undefined) attempt = 0;
+   if (start === undefined) start = Date.now();
+
+   Pebble.sendAppMessage(dict, function() {
+      console.log(what + " sent in " + (Date.now() - start) + " ms"
+       + (attempt > 0 ? " after " + attempt + " retries" : ""));
+   }, function() {
+      if (attempt + 1 >= MESSAGE_ATTEMPTS) {
+         console.log(what + " failed after " + MESSAGE_ATTEMPTS + " attempts");
+         return;
+      }
+      setTimeout(function() {
+         sendMessage(dict, what, attempt + 1, start);
+      }, 1000 * (attempt + 1));
+   });
+}
+
+/* streaming pull of entries already sent by the watch, see src/outbox.c */
+function requestPull(seq) {
+   var dict = { 530: seq };
+   var from = localStorage.getItem("pullFrom");
+   var to = localStorage.getItem("pullTo");
+
+   if (from !== null) dict[531] = parseInt(from, 10);
+   if (to !== null) dict[532] = parseInt(to, 10);
+
+   /* the watch sends its event names first, to title the pulled lines */
+   if (localStorage.getItem("event-list") === null) dict[540] = 1;
+
+   storeItem("pullSeq", seq);
+   sendMessage(dict, "Pull request from " + seq);
+}
+
+/* time of the latest line uploaded or queued, null if there is none */
+function lastUploadTime() {
+   var str_last_sent = localStorage.getItem("lastSent");
+   var result = str_last_sent ? parseInt(str_last_sent, 10) : null;
+
+   for (var i = 0; i < to_send.length; i += 1) {
+      var time = parseInt(to_send[i].split(";")[0], 10);
+      if (result === null || time > result) result = time;
+   }
+   return result;
+}
+
+/* without an explicit start, lines already uploaded are not pulled again */
+function startPull(from, to) {
+   var str_last_seq = localStorage.getItem("lastSeq");
+   storeItem("pullAfter", str_last_seq ? str_last_seq : -1);
+   if (from === undefined && lastUploadTime() !== null) {
+      from = lastUploadTime() + 1;
+   }
+   if (from !== undefined) storeItem("pullFrom", from);
+   if (to !== undefined) storeItem("pullTo", to);
+   requestPull(0);
+}
+
+function receivePull(payload) {
+   var str_expected = localStorage.getItem("pullSeq");
+   if (str_expected === null) return;
+
+   var expected = parseInt(str_expected, 10);
+   var after = parseInt(localStorage.getItem("pullAfter"), 10);
+   var begin = payload[536];
+   var end = payload[537];
+   var records = decodeRecords(payload[535]);
+
+   if (end <= expected && end < payload[538]) return;
+   if (begin > expected) {
+      console.log("Pull: " + (begin - expected)
+       + " entries no longer on the watch");
+   }
+
+   for (var i = 0; i < records.length; i += 1) {
+      if (records[i].seq < begin || records[i].seq >= end
+       || (i > 0 && records[i].seq <= records[i - 1].seq)) {
+         console.log("Pull: inconsistent chunk, restarting from " + expected);
+         storeQueue();
+         requestPull(expected);
+         return;
+      }
+      if (records[i].seq < expected || records[i].seq <= after) continue;
+      enqueue(records[i]);
+   }
+   storeQueue();
+
+   if (end >= payload[538]) {
+      var str_last_seq = localStorage.getItem("lastSeq");
+      if (str_last_seq === null || parseInt(str_last_seq, 10) < end - 1) {
+         storeItem("lastSeq", end - 1);
+      }
+      console.log("Pull complete up to " + end);
+      localStorage.removeItem("pullSeq");
+      localStorage.removeItem("pullAfter");
+      localStorage.removeItem("pullFrom");
+      localStorage.removeItem("pullTo");
+   } else {
+      storeItem("pullSeq", end);
+   }
+}
+
+/* event names sent by the watch on request, over as many messages */
+function receiveNames(payload) {
+   var count = payload[1000];
+
+   if (names_received === null || names_received.length !== count) {
+      names_received = new Array(count);
+   }
+   if (payload[901] !== undefined) {
+      localStorage.setItem("begin-prefix", payload[901]);
+   }
+   if (payload[902] !== undefined) {
+      localStorage.setItem("end-prefix", payload[902]);
+   }
+   for (var i = 0; i < count; i += 1) {
+      if (payload[1001 + i] !== undefined) {
+         names_received[i] = payload[1001 + i];
+      }
+   }
+
+   for (i = 0; i < count; i += 1) {
+      if (names_received[i] === undefined) return;
+   }
+   localStorage.setItem("event-list", names_received.join(","));
+   console.log("Received " + count + " event names from the watch");
+   names_received = null;
+}
 
 senders[0].addEventListener("load", uploadDone);
 senders[0].addEventListener("error", uploadError);
 senders[1].addEventListener("load", uploadDone);
 senders[1].addEventListener("error", uploadError);
+replay_sender.addEventListener("load", replayDone);
+replay_sender.addEventListener("error", replayError);
 
 function encodeStored(names) {
    var result = "?v=dev";
@@ -120,6 +633,8 @@ function encodeStored(names) {
 Pebble.addEventListener("ready", function() {
    var str_to_send = localStorage.getItem("toSend");
    to_send = str_to_send ? str_to_send.split("|") : [];
+   to_send_done = parseInt(localStorage.getItem("toSendDone") || "0", 10);
+   to_send.splice(0, to_send_done);
 
    var str_extra_fields = localStorage.getItem("extra-fields");
    cfg_extra_fields = str_extra_fields ? str_extra_fields.split(",") : [];
@@ -132,15 +647,28 @@ Pebble.addEventListener("ready", function() {
    cfg_sign_key = localStorage.getItem("cfgSignKey");
    cfg_sign_key_format = localStorage.getItem("cfgSignKeyFormat");
 
+   migrateArchive();
+
    if (to_send.length >= 1) {
       sendHead();
    }
 
+   if (localStorage.getItem("pullSeq") !== null) {
+      requestPull(parseInt(localStorage.getItem("pullSeq"), 10));
+   } else if (localStorage.getItem("lastSeq") === null) {
+      startPull();
+   }
+
+   if (localStorage.getItem("replayEnd") !== null) {
+      replay_end = parseInt(localStorage.getItem("replayEnd"), 10);
+      replayNext();
+   }
+
    console.log("Life-Log PebbleKit JS ready!");
 });
 
 Pebble.addEventListener("showConfiguration", function() {
-   Pebble.openURL("https://cdn.rawgit.com/faelys/life-log/v1.0/config.html" + encodeStored(settings));
+   Pebble.openURL("https://cdn.rawgit.com/faelys/life-log/v1.1/config.html" + encodeStored(settings));
 });
 
 Pebble.addEventListener("webviewclosed", function(e) {
@@ -191,6 +719,10 @@ Pebble.addEventListener("webviewclosed", function(e) {
       localStorage.setItem("cfgSignKeyFormat", cfg_sign_key_format);
    }
 
+   if (configData.resend && cfg_endpoint) {
+      startReplay();
+   }
+
    const eventArray = configData["event-list"] !== "" ? configData["event-list"].split(",") : [];
 
    var dict = {
@@ -206,20 +738,54 @@ Pebble.addEventListener("webviewclosed", function(e) {
    if (configData["dir-sep"] !== null) {
       dict[910] = configData["dir-sep"];
    }
+   if (configData.transport) {
+      dict[920] = parseInt(configData.transport, 10);
+   }
+   if (configData["background-worker"] !== undefined) {
+      dict[980] = parseInt(configData["background-worker"], 10) || 0;
+   }
 
    for (var i = 0; i < eventArray.length; i++) {
       dict[1001 + i] = eventArray[i];
    }
 
-   Pebble.sendAppMessage(dict, function() {
-      console.log("Send successful: " + JSON.stringify(dict));
-   }, function() {
-      console.log("Send failed!");
-   });
+   if (configData["quick-event"] !== undefined) {
+      var quick = configData["quick-event"];
+      var quick_index = eventArray.indexOf(quick);
+      if (quick_index < 0) quick_index = eventArray.indexOf("+" + quick);
+      dict[930] = quick_index + 1;
+   }
+
+   if (configData["frequent-count"] !== undefined) {
+      dict[950] = parseInt(configData["frequent-count"], 10) || 0;
+   }
+
+   if (configData["event-profiles"] !== undefined) {
+      var profiles = encodeProfiles(configData["event-profiles"], eventArray);
+      dict[960] = profiles.length;
+      for (i = 0; i < profiles.length; i++) {
+         dict[961 + i] = profiles[i];
+      }
+   }
+
+   if (configData["log-partitions"] !== undefined) {
+      dict[940] = configData["log-partitions"];
+   }
+
+   sendMessage(dict, "Configuration");
 });
 
 Pebble.addEventListener("appmessage", function(e) {
-   if (e.payload[500] && e.payload[510]) {
-      enqueue(e.payload[500], e.payload[510]);
+   if (e.payload[1000] !== undefined) {
+      receiveNames(e.payload);
+   }
+   if (e.payload[520] || e.payload[535]) {
+      checkEpoch(e.payload[521]);
+   }
+   if (e.payload[520]) {
+      enqueueRecords(e.payload[520]);
+   }
+   if (e.payload[535]) {
+      receivePull(e.payload);
    }
 });
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * Persistent storage and AppMessage keys, along with the values of the
+ * settings stored under them. Included by the background worker too, so
+ * this header must not depend on anything from the app.
+ */
+
+#define TRANSPORT_IMMEDIATE	0
+#define TRANSPORT_BATCHED	1
+
+#define KEY_EVENT_LOG		 100
+#define KEY_EVENT_LOG_HEADER	 120
+#define KEY_OPEN_INTERVALS	 121
+#define KEY_LEGACY_LOG_DAYS	 122
+#define KEY_LEGACY_ROLLUP	 123
+#define KEY_EVENT_LOG_DAYS	 124
+#define KEY_EVENT_LOG_EPOCH	 128
+#define KEY_LEGACY_BUCKETS	 129
+#define KEY_STORAGE_TOTALS	 130
+#define KEY_EVENT_ROLLUP	 131
+#define KEY_PARTITION_LOG	 140
+#define KEY_EVENT_LAST_SEEN	 200
+#define KEY_LONG_EVENT_RUNNING	 210
+#define KEY_EVENT_STATS		 220
+#define KEY_EVENT_FREQUENCY	 230
+#define KEY_RECORD_BATCH	 520
+#define KEY_RECORD_EPOCH	 521
+#define KEY_PULL_REQUEST	 530
+#define KEY_PULL_FROM		 531
+#define KEY_PULL_TO		 532
+#define KEY_PULL_BATCH		 535
+#define KEY_PULL_BEGIN		 536
+#define KEY_PULL_END		 537
+#define KEY_PULL_TARGET		 538
+#define KEY_NAMES_REQUEST	 540
+#define KEY_BEGIN_PREFIX	 901
+#define KEY_END_PREFIX		 902
+#define KEY_DIRECTORY_SEPARATOR	 910
+#define KEY_TRANSPORT		 920
+#define KEY_QUICK_EVENT		 930
+#define KEY_LOG_PARTITIONS	 940
+#define KEY_FREQUENT_COUNT	 950
+#define KEY_EVENT_PROFILE_COUNT	 960
+#define KEY_ACTIVE_PROFILE	 970
+#define KEY_BACKGROUND_WORKER	 980
+#define KEY_EVENT_NAMES		1000
+#define KEY_LEGACY_DERIVED	2000
+#define KEY_LEGACY_LONG_EVENT_ID 2001
+#define KEY_LEGACY_PREFIXES	2300
+#define KEY_EVENT_PROFILES	2350
+#define KEY_LEGACY_PROFILE_PREFIXES 2400
+
+/* profiles that had a prefix snapshot under KEY_LEGACY_PROFILE_PREFIXES */
+#define LEGACY_PROFILE_COUNT	4
+
+/* pages under KEY_PARTITION_LOG before their number was fixed */
+#define LEGACY_PARTITION_PAGES	4
@@ -3,226 +3,509 @@
 
 #include "dict_tools.h"
 #include "global.h"
+#include "simple_dialog.h"
+#include "storage.h"
 #include "strlist.h"
 #include "strset.h"
 
+/* legacy ranges hold nothing, their keys are only ever deleted */
+static const struct storage_range storage_ranges[] = {
+	{ "event log", KEY_EVENT_LOG, LOG_SEGMENT_COUNT, LOG_STORAGE_SIZE },
+	{ "log header", KEY_EVENT_LOG_HEADER, 1, LOG_HEADER_SIZE },
+	{ "open intervals", KEY_OPEN_INTERVALS, 1,
+	    OPEN_INTERVALS_STORAGE_SIZE },
+	{ "legacy log tables", KEY_LEGACY_LOG_DAYS,
+	    KEY_EVENT_LOG_EPOCH - KEY_LEGACY_LOG_DAYS, 0 },
+	{ "log epoch", KEY_EVENT_LOG_EPOCH, 1, sizeof(int32_t) },
+	{ "legacy buckets", KEY_LEGACY_BUCKETS, 1, 0 },
+	{ "storage totals", KEY_STORAGE_TOTALS, 1, STORAGE_TOTALS_SIZE },
+	{ "log rollups", KEY_EVENT_ROLLUP, 1, ROLLUP_STORAGE_SIZE },
+	{ "log partitions", KEY_PARTITION_LOG,
+	    LOG_PARTITION_PAGES, LOG_PARTITION_STORAGE_SIZE },
+	{ "legacy partition pages", KEY_PARTITION_LOG + LOG_PARTITION_PAGES,
+	    LEGACY_PARTITION_PAGES - LOG_PARTITION_PAGES, 0 },
+	{ "legacy last seen", KEY_EVENT_LAST_SEEN, 1, 0 },
+	{ "running events", KEY_LONG_EVENT_RUNNING, 1,
+	    RUNNING_EVENTS_STORAGE_SIZE },
+	{ "event stats", KEY_EVENT_STATS, EVENT_STATS_PAGES,
+	    EVENT_STATS_STORAGE_SIZE },
+	{ "event frequency", KEY_EVENT_FREQUENCY, 1,
+	    EVENT_FREQUENCY_STORAGE_SIZE },
+	{ "settings", KEY_BEGIN_PREFIX,
+	    KEY_BACKGROUND_WORKER - KEY_BEGIN_PREFIX + 1,
+	    SETTINGS_STORAGE_SIZE },
+	{ "event names", KEY_EVENT_NAMES, STRLIST_KEY_COUNT,
+	    EVENT_NAMES_STORAGE_SIZE },
+	{ "legacy derived tables", KEY_LEGACY_DERIVED,
+	    KEY_LEGACY_LONG_EVENT_ID - KEY_LEGACY_DERIVED + 1, 0 },
+	{ "legacy prefixes", KEY_LEGACY_PREFIXES, STRLIST_KEY_COUNT, 0 },
+	{ "event profiles", KEY_EVENT_PROFILES, 1,
+	    EVENT_PROFILE_STORAGE_SIZE },
+	{ "legacy profile prefixes", KEY_LEGACY_PROFILE_PREFIXES,
+	    LEGACY_PROFILE_COUNT * STRLIST_KEY_COUNT, 0 },
+};
+
+/* sized in global.h, so the same on every platform profile */
+_Static_assert(LOG_STORAGE_SIZE + LOG_HEADER_SIZE
+    + OPEN_INTERVALS_STORAGE_SIZE + sizeof(int32_t) + STORAGE_TOTALS_SIZE
+    + ROLLUP_STORAGE_SIZE + LOG_PARTITION_STORAGE_SIZE
+    + RUNNING_EVENTS_STORAGE_SIZE + EVENT_STATS_STORAGE_SIZE
+    + EVENT_FREQUENCY_STORAGE_SIZE + SETTINGS_STORAGE_SIZE
+    + EVENT_NAMES_STORAGE_SIZE + EVENT_PROFILE_STORAGE_SIZE
+    <= STORAGE_BUDGET,
+    "storage ranges hold more than the budget");
+
 static void
 preprocess_long_events(void) {
-	char buffer[128];
-	unsigned separator_length = strlen(directory_separator);
-
 	long_event_count = 0;
-	strlist_reset(&event_begins);
-	strlist_reset(&event_ends);
-	strlist_reset(&event_prefixes);
-
 	for (uint8_t i = 0; i < event_names.count; i += 1) {
 		const char *name = STRLIST_UNSAFE_ITEM(event_names, i);
 
-		if (separator_length > 0) {
-			const char *title = name;
-			const char *suffix;
+		long_event_id[i] = (name[0] == '+') ? ++long_event_count : 0;
+	}
 
-			if (name[0] == '-') continue;
-			if (name[0] == '+') title = name + 1;
+	event_profile_prefixes(&event_prefixes, 0);
+}
 
-			suffix = title - 1;
-			while (1) {
-				suffix = strstr(suffix + 1,
-				    directory_separator);
-				if (!suffix) break;
+/* snapshots of the derived tables, dropped since they are cheap to build */
+static void
+delete_legacy_snapshots(void) {
+	for (uint32_t key = KEY_LEGACY_DERIVED;
+	    key <= KEY_LEGACY_LONG_EVENT_ID; key += 1) {
+		if (persist_exists(key)) storage_delete(key);
+	}
 
-				strset_include(&event_prefixes,
-				    title, suffix + separator_length - title);
-			}
-		}
+	for (unsigned list = 0; list <= LEGACY_PROFILE_COUNT; list += 1) {
+		const uint32_t first = list ? KEY_LEGACY_PROFILE_PREFIXES
+		    + (list - 1) * STRLIST_KEY_COUNT : KEY_LEGACY_PREFIXES;
 
-		if (name[0] != '+') {
-			long_event_id[i] = 0;
-			continue;
+		if (!persist_exists(first)) continue;
+		for (uint32_t key = first; key < first + STRLIST_KEY_COUNT;
+		    key += 1) {
+			if (persist_exists(key)) storage_delete(key);
 		}
+	}
+}
 
-		long_event_id[i] = ++long_event_count;
+static time_t launch_time;
+static uint16_t launch_time_ms;
 
-		snprintf(buffer, sizeof buffer, "%s%s", begin_prefix, name + 1);
-		strlist_append(&event_begins, buffer);
+static uint32_t
+ms_since_launch(void) {
+	time_t now;
+	uint16_t now_ms;
 
-		snprintf(buffer, sizeof buffer, "%s%s", end_prefix, name + 1);
-		strlist_append(&event_ends, buffer);
-	}
+	time_ms(&now, &now_ms);
+	return (uint32_t)(now - launch_time) * 1000u + now_ms - launch_time_ms;
 }
 
+#define STAGED_INIT_DELAY_MS 50
+
+/* second stage of init, for state the first frame does not need */
 static void
-inbox_received_handler(DictionaryIterator *iterator, void *context) {
-	Tuple *tuple;
-	bool events_updated = false;
+load_deferred_state(void *data) {
+	(void)data;
+	event_log_init();
+	log_partition_init();
+	event_stats_init();
+	event_menu_init();
+	delete_legacy_snapshots();
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Deferred state loaded %" PRIu32 " ms after launch",
+	    ms_since_launch());
+
+	outbox_flush();
+	update_main_menu();
+}
+
+static void
+log_first_frame(void *data) {
+	(void)data;
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "First frame %" PRIu32 " ms after launch", ms_since_launch());
+	APP_LOG(APP_LOG_LEVEL_INFO, PROFILE_SUMMARY ", %u bytes of heap free",
+	    (unsigned)heap_bytes_free());
+	app_timer_register(STAGED_INIT_DELAY_MS, &load_deferred_state, 0);
+}
 
+/* what a configuration message brings, gathered in one dictionary pass */
+struct inbox_state {
+	const char *names[STRLIST_MAX_SIZE];
+	int16_t name_count;
+	bool events_updated;
+	const uint8_t *profiles[EVENT_PROFILE_MAX];
+	int16_t profile_count;
+	bool names_requested;
+	bool pull_requested;
+	uint32_t pull_seq;
+	time_t pull_from;
+	time_t pull_to;
+};
+
+static void
+log_tuple(Tuple *tuple, void *context) {
 	(void)context;
 
-	for (tuple = dict_read_first(iterator);
-	    tuple;
-	    tuple = dict_read_next(iterator)) {
-		switch (tuple->type) {
-		    case TUPLE_CSTRING:
-			APP_LOG(APP_LOG_LEVEL_INFO,
-			    "got string %" PRIu32 ": \"%s\"",
-			    tuple->key, tuple->value->cstring);
-			break;
-		    case TUPLE_INT:
-			APP_LOG(APP_LOG_LEVEL_INFO,
-			    "got signed %" PRIu32 ": %" PRId32,
-			    tuple->key, tuple_int(tuple));
-			break;
-		    case TUPLE_UINT:
-			APP_LOG(APP_LOG_LEVEL_INFO,
-			    "got unsigned %" PRIu32 ": %" PRIu32,
-			    tuple->key, tuple_uint(tuple));
-			break;
-		    default:
-			APP_LOG(APP_LOG_LEVEL_INFO,
-			    "got tuple %" PRIu32 " of unknown type %d",
-			    tuple->key, (int)tuple->type);
-			break;
-		}
+	switch (tuple->type) {
+	    case TUPLE_CSTRING:
+		APP_LOG(APP_LOG_LEVEL_INFO,
+		    "got string %" PRIu32 ": \"%s\"",
+		    tuple->key, tuple->value->cstring);
+		break;
+	    case TUPLE_INT:
+		APP_LOG(APP_LOG_LEVEL_INFO,
+		    "got signed %" PRIu32 ": %" PRId32,
+		    tuple->key, tuple_int(tuple));
+		break;
+	    case TUPLE_UINT:
+		APP_LOG(APP_LOG_LEVEL_INFO,
+		    "got unsigned %" PRIu32 ": %" PRIu32,
+		    tuple->key, tuple_uint(tuple));
+		break;
+	    default:
+		APP_LOG(APP_LOG_LEVEL_INFO,
+		    "got tuple %" PRIu32 " of unknown type %d",
+		    tuple->key, (int)tuple->type);
+		break;
 	}
+}
 
-	tuple = dict_find(iterator, KEY_EVENT_NAMES);
-	if (tuple && (tuple->type == TUPLE_UINT || tuple->type == TUPLE_INT)) {
-		strlist_set_from_dict(&event_names, iterator,
-		    KEY_EVENT_NAMES + 1, tuple->value->uint8);
-		strlist_store(&event_names, KEY_EVENT_NAMES);
-		events_updated = true;
-	} else if (tuple) {
+static void
+handle_event_count(Tuple *tuple, void *context) {
+	struct inbox_state *state = context;
+
+	if (tuple->type != TUPLE_UINT && tuple->type != TUPLE_INT) {
 		APP_LOG(APP_LOG_LEVEL_ERROR,
 		    "Unexpected type %d for event count",
 		    (int)tuple->type);
+		return;
 	}
 
-	tuple = dict_find(iterator, KEY_BEGIN_PREFIX);
-	if (tuple && tuple->type == TUPLE_CSTRING) {
-		strncpy(begin_prefix, tuple->value->cstring,
-		    sizeof begin_prefix);
-		begin_prefix[sizeof begin_prefix - 1] = 0;
-		persist_write_string(KEY_BEGIN_PREFIX, begin_prefix);
-		events_updated = true;
-	}
+	state->name_count = tuple_uint(tuple);
+}
+
+static void
+handle_event_name(Tuple *tuple, void *context) {
+	struct inbox_state *state = context;
 
-	tuple = dict_find(iterator, KEY_END_PREFIX);
-	if (tuple && tuple->type == TUPLE_CSTRING) {
-		strncpy(end_prefix, tuple->value->cstring,
-		    sizeof end_prefix);
-		end_prefix[sizeof end_prefix - 1] = 0;
-		persist_write_string(KEY_END_PREFIX, end_prefix);
-		events_updated = true;
+	state->names[tuple->key - KEY_EVENT_NAMES - 1] = tuple_cstring(tuple);
+}
+
+static void
+handle_string_setting(Tuple *tuple, void *context) {
+	struct inbox_state *state = context;
+	const char *value = tuple_cstring(tuple);
+	char *buffer;
+
+	switch (tuple->key) {
+	    case KEY_BEGIN_PREFIX:
+		buffer = begin_prefix;
+		break;
+	    case KEY_END_PREFIX:
+		buffer = end_prefix;
+		break;
+	    case KEY_DIRECTORY_SEPARATOR:
+		buffer = directory_separator;
+		break;
+	    default:
+		return;
 	}
 
-	tuple = dict_find(iterator, KEY_DIRECTORY_SEPARATOR);
-	if (tuple && tuple->type == TUPLE_CSTRING) {
-		strncpy(directory_separator, tuple->value->cstring,
-		    sizeof directory_separator);
-		directory_separator[sizeof directory_separator - 1] = 0;
-		persist_write_string(KEY_DIRECTORY_SEPARATOR,
-		    directory_separator);
-		events_updated = true;
+	if (!value) return;
+	strncpy(buffer, value, PREFIX_LENGTH);
+	buffer[PREFIX_LENGTH - 1] = 0;
+	storage_write_string(tuple->key, buffer);
+	state->events_updated = true;
+}
+
+/*
+ * The background worker only matters while entries await acknowledgement,
+ * and it takes over the screen to send them, so the user has to ask for it.
+ */
+static void
+update_worker(void) {
+	const bool wanted = (transport == TRANSPORT_BATCHED
+	    && persist_read_int(KEY_BACKGROUND_WORKER));
+	AppWorkerResult result;
+
+	if (wanted == app_worker_is_running()) return;
+
+	result = wanted ? app_worker_launch() : app_worker_kill();
+	if (result != APP_WORKER_RESULT_SUCCESS
+	    && result != APP_WORKER_RESULT_ASKING_CONFIRMATION) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Unable to %s background worker: %d",
+		    wanted ? "launch" : "kill", (int)result);
 	}
+}
 
-	if (events_updated)
-		preprocess_long_events();
+static void
+handle_transport(Tuple *tuple, void *context) {
+	uint8_t new_transport = tuple_uint(tuple);
 
-	update_main_menu();
+	(void)context;
+	if (new_transport == TRANSPORT_BATCHED
+	    && transport != TRANSPORT_BATCHED)
+		event_log_mark_sent(event_log_end());
+	transport = new_transport;
+	storage_write_int(KEY_TRANSPORT, transport);
+	update_worker();
+	outbox_flush();
 }
 
-static size_t
-recorded_event_image(char *buffer, size_t max_size,
-    time_t time, uint8_t id, const char *title) {
-	struct tm *tm;
-	size_t ret;
-	int i;
+static void
+handle_background_worker(Tuple *tuple, void *context) {
+	(void)context;
+	storage_write_int(KEY_BACKGROUND_WORKER, tuple_uint(tuple) != 0);
+	update_worker();
+}
 
-	tm = gmtime(&time);
-	if (!tm) {
-		APP_LOG(APP_LOG_LEVEL_ERROR, "recorded_event_image: "
-		    "Unable to get UTC time for %" PRIi32, time);
-		return 0;
+static void
+handle_quick_event(Tuple *tuple, void *context) {
+	(void)context;
+	storage_write_int(KEY_QUICK_EVENT, tuple_uint(tuple));
+}
+
+static void
+handle_log_partitions(Tuple *tuple, void *context) {
+	const char *value = tuple_cstring(tuple);
+
+	(void)context;
+	if (value) log_partition_configure(value);
+}
+
+static void
+handle_frequent_count(Tuple *tuple, void *context) {
+	(void)context;
+	event_frequency_configure(tuple_uint(tuple));
+}
+
+static void
+handle_event_profile(Tuple *tuple, void *context) {
+	struct inbox_state *state = context;
+	const uint32_t index = tuple->key - KEY_EVENT_PROFILE_COUNT - 1;
+
+	if (tuple->key == KEY_EVENT_PROFILE_COUNT) {
+		state->profile_count = tuple_uint(tuple);
+	} else if (tuple->type == TUPLE_BYTE_ARRAY
+	    && tuple->length == EVENT_PROFILE_WIRE_SIZE) {
+		state->profiles[index] = tuple->value->data;
+	} else {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Ignoring event profile %" PRIu32 " of unexpected size %u",
+		    index, (unsigned)tuple->length);
 	}
+}
 
-	ret = strftime(buffer, max_size, "%FT%TZ", tm);
-	if (!ret) {
-		APP_LOG(APP_LOG_LEVEL_ERROR, "recorded_event_image: "
-		    "Unable to build RFC-3339 representation of %" PRIi32,
-		    time);
-		return 0;
+static void
+handle_pull(Tuple *tuple, void *context) {
+	struct inbox_state *state = context;
+
+	switch (tuple->key) {
+	    case KEY_PULL_REQUEST:
+		state->pull_requested = true;
+		state->pull_seq = tuple_uint(tuple);
+		break;
+	    case KEY_PULL_FROM:
+		state->pull_from = tuple_uint(tuple);
+		break;
+	    case KEY_PULL_TO:
+		state->pull_to = tuple_uint(tuple);
+		break;
 	}
+}
 
-	if (ret >= max_size) {
-		APP_LOG(APP_LOG_LEVEL_ERROR, "recorded_event_image: "
-		    "Unexpected returned value %zu of strftime on buffer %zu",
-		    ret, max_size);
-		return 0;
+static void
+handle_names_request(Tuple *tuple, void *context) {
+	struct inbox_state *state = context;
+
+	(void)tuple;
+	state->names_requested = true;
+}
+
+static const struct dict_handler inbox_handlers[] = {
+	{ 0, UINT32_MAX, &log_tuple },
+	{ KEY_EVENT_NAMES, KEY_EVENT_NAMES, &handle_event_count },
+	{ KEY_EVENT_NAMES + 1, KEY_EVENT_NAMES + STRLIST_MAX_SIZE,
+	    &handle_event_name },
+	{ KEY_BEGIN_PREFIX, KEY_DIRECTORY_SEPARATOR, &handle_string_setting },
+	{ KEY_TRANSPORT, KEY_TRANSPORT, &handle_transport },
+	{ KEY_QUICK_EVENT, KEY_QUICK_EVENT, &handle_quick_event },
+	{ KEY_LOG_PARTITIONS, KEY_LOG_PARTITIONS, &handle_log_partitions },
+	{ KEY_FREQUENT_COUNT, KEY_FREQUENT_COUNT, &handle_frequent_count },
+	{ KEY_EVENT_PROFILE_COUNT, KEY_EVENT_PROFILE_COUNT + EVENT_PROFILE_MAX,
+	    &handle_event_profile },
+	{ KEY_BACKGROUND_WORKER, KEY_BACKGROUND_WORKER,
+	    &handle_background_worker },
+	{ KEY_PULL_REQUEST, KEY_PULL_TO, &handle_pull },
+	{ KEY_NAMES_REQUEST, KEY_NAMES_REQUEST, &handle_names_request },
+};
+
+/* whether the received names differ from the current ones */
+static bool
+names_changed(const struct inbox_state *state) {
+	const unsigned count = state->name_count < STRLIST_MAX_COUNT
+	    ? state->name_count : STRLIST_MAX_COUNT;
+
+	if (count != event_names.count) return true;
+
+	for (uint8_t i = 0; i < event_names.count; i += 1) {
+		if (!state->names[i] || strcmp(state->names[i],
+		    STRLIST_UNSAFE_ITEM(event_names, i)) != 0)
+			return true;
 	}
 
-	i = snprintf(buffer + ret, max_size - ret,
-	    ",%" PRIu8 ",%s", id, title);
+	return false;
+}
 
-	if (i <= 0) {
-		APP_LOG(APP_LOG_LEVEL_ERROR, "recorded_event_image: "
-		    "Unexpected return value %d from snprintf", i);
-		return 0;
+/* drops the trailing names that do not fit in their storage range */
+static void
+fit_names(struct inbox_state *state) {
+	size_t size = 1;
+	int16_t count = 0;
+
+	while (count < state->name_count && count < STRLIST_MAX_COUNT) {
+		const char *name = state->names[count];
+		const size_t length = name && name[0] ? strlen(name) + 1 : 0;
+
+		if (size + length > EVENT_NAMES_MAX_SIZE) {
+			APP_LOG(APP_LOG_LEVEL_WARNING,
+			    "Only %" PRIi16 " of %" PRIi16 " event names fit"
+			    " in %u bytes", count, state->name_count,
+			    (unsigned)EVENT_NAMES_MAX_SIZE);
+			break;
+		}
+		size += length;
+		count += 1;
 	}
 
-	return ret + i;
+	state->name_count = count;
 }
 
-bool
-send_recorded_event(time_t time, uint8_t id, const char *title) {
-	AppMessageResult msg_result;
-	DictionaryIterator *iter;
-	DictionaryResult dict_result;
-	char buffer[256];
-	bool result = true;
-	size_t sz;
+static void
+inbox_received_handler(DictionaryIterator *iterator, void *context) {
+	struct inbox_state state = {
+	    .name_count = -1,
+	    .profile_count = -1,
+	    .pull_from = INT32_MIN,
+	    .pull_to = INT32_MAX,
+	};
 
-	msg_result = app_message_outbox_begin(&iter);
-	if (msg_result) {
-		APP_LOG(APP_LOG_LEVEL_ERROR,
-		    "send_event: app_message_outbox_begin returned %d",
-		    (int)msg_result);
-		return false;
+	(void)context;
+
+	dict_dispatch(iterator, inbox_handlers,
+	    sizeof inbox_handlers / sizeof *inbox_handlers, &state);
+
+	if (state.name_count >= 0) {
+		fit_names(&state);
+		if (names_changed(&state)) event_frequency_reset();
+		strlist_set(&event_names, state.names,
+		    state.name_count < STRLIST_MAX_COUNT
+		    ? state.name_count : STRLIST_MAX_COUNT);
+		strlist_store(&event_names, KEY_EVENT_NAMES);
+		state.events_updated = true;
 	}
 
-	dict_result = dict_write_int(iter, KEY_RECORD_TIME,
-	    &time, sizeof time, true);
-	if (dict_result != DICT_OK) {
-		APP_LOG(APP_LOG_LEVEL_ERROR,
-		    "send_event: [%d] unable to add data time %" PRIi32,
-		    (int)dict_result, time);
-		result = false;
+	if (state.names_requested) {
+		outbox_send_names();
 	}
 
-	sz = recorded_event_image(buffer, sizeof buffer, time, id, title);
+	if (state.pull_requested) {
+		outbox_pull(state.pull_seq, state.pull_from, state.pull_to);
+	}
 
-	dict_result = dict_write_cstring(iter, KEY_RECORD_TITLE,
-	    sz ? buffer : title);
-	if (dict_result != DICT_OK) {
-		APP_LOG(APP_LOG_LEVEL_ERROR,
-		    "send_event: [%d] unable to add data line \"%s\"",
-		    (int)dict_result, title);
-		result = false;
+	if (state.events_updated) {
+		preprocess_long_events();
+		event_profile_reload();
+	}
+
+	if (state.profile_count >= 0) {
+		event_profile_configure(state.profiles,
+		    state.profile_count < EVENT_PROFILE_MAX
+		    ? state.profile_count : EVENT_PROFILE_MAX);
 	}
 
-	msg_result = app_message_outbox_send();
-	if (msg_result) {
+	update_main_menu();
+}
+
+#define QUICK_LAUNCH_LINGER_MS 3000
+
+/* event index plus one to record right away, or zero for the menus */
+static uint32_t
+quick_launch_event(void) {
+	switch (launch_reason()) {
+	    case APP_LAUNCH_QUICK_LAUNCH:
+		return persist_read_int(KEY_QUICK_EVENT);
+	    case APP_LAUNCH_TIMELINE_ACTION:
+		return launch_get_args();
+	    default:
+		return 0;
+	}
+}
+
+/* the menus are only built when the user stays in the app */
+static void
+finish_quick_launch(void *data) {
+	(void)data;
+	push_main_menu();
+	dismiss_simple_dialog(false);
+}
+
+static void
+quick_record(uint8_t index) {
+	char title_buffer[TITLE_LENGTH];
+	char message[TITLE_LENGTH + 16];
+	struct log_entry entry;
+	const char *title = 0;
+	const uint32_t end = event_log_end();
+
+	event_menu_record(index);
+	if (event_log_end() == end || !event_log_read(end, &entry)) {
 		APP_LOG(APP_LOG_LEVEL_ERROR,
-		    "send_event: app_mesage_outbox_send returned %d",
-		    (int)msg_result);
-		result = false;
+		    "Unable to quick-record event %u", (unsigned)index);
+		push_main_menu();
+		return;
 	}
 
-	return result;
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Quick record persisted %" PRIu32 " ms after launch",
+	    ms_since_launch());
+
+	title = event_title(title_buffer, sizeof title_buffer, entry.id);
+	snprintf(message, sizeof message, "Recorded\n%s", title ? title : "");
+	push_simple_dialog(message, false);
+	app_timer_register(QUICK_LAUNCH_LINGER_MS, &finish_quick_launch, 0);
+}
+
+#define SYNC_POLL_MS 1000
+#define SYNC_TIMEOUT_MS 30000
+
+/* launched by the worker: exits once pending entries are acknowledged */
+static void
+poll_background_sync(void *data) {
+	(void)data;
+
+	if (event_log_sent() < event_log_end()
+	    && ms_since_launch() < SYNC_TIMEOUT_MS) {
+		app_timer_register(SYNC_POLL_MS, &poll_background_sync, 0);
+		return;
+	}
+
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Background sync done after %" PRIu32 " ms, %" PRIu32 " pending",
+	    ms_since_launch(), event_log_end() - event_log_sent());
+	dismiss_simple_dialog(false);
 }
 
 static void
 init(void) {
+	uint32_t quick_event;
+
+	time_ms(&launch_time, &launch_time_ms);
+	quick_event = quick_launch_event();
+	storage_init(storage_ranges,
+	    sizeof storage_ranges / sizeof *storage_ranges);
+
 	persist_read_string(KEY_BEGIN_PREFIX,
 	    begin_prefix, sizeof begin_prefix);
 	begin_prefix[sizeof begin_prefix - 1] = 0;
@@ -231,18 +514,36 @@ init(void) {
 	persist_read_string(KEY_DIRECTORY_SEPARATOR,
 	    directory_separator, sizeof directory_separator);
 	directory_separator[sizeof directory_separator - 1] = 0;
+	transport = persist_read_int(KEY_TRANSPORT);
 	strlist_load(&event_names, KEY_EVENT_NAMES);
 	preprocess_long_events();
-	event_log_init();
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Derived tables built after %" PRIu32 " ms", ms_since_launch());
+	event_profile_init();
 
 	app_message_register_inbox_received(inbox_received_handler);
-	app_message_open(8192, 512);
-
-	push_main_menu();
+	outbox_init();
+	app_message_open(PROFILE_INBOX_SIZE, PROFILE_OUTBOX_SIZE);
+
+	update_worker();
+
+	if (launch_reason() == APP_LAUNCH_WORKER) {
+		push_simple_dialog("Sending pending events", true);
+		app_timer_register(SYNC_POLL_MS, &poll_background_sync, 0);
+	} else if (quick_event && quick_event <= event_names.count) {
+		quick_record(quick_event - 1);
+	} else {
+		push_main_menu();
+	}
+	app_timer_register(0, &log_first_frame, 0);
 }
 
 static void
 deinit(void) {
+	metrics_report();
+	event_frequency_store();
+	event_stats_store();
+	outbox_deinit();
 	app_message_deregister_callbacks();
 }
 
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pebble.h>
+
+#include "bitarray.h"
+#include "global.h"
+#include "strset.h"
+
+static const char *no_event_message = "No event logged.";
+
+/* day of kept entries, newest first, from its first row among them */
+struct kept_day {
+	uint16_t day;
+	uint16_t first_row;
+};
+
+static Window *window;
+static MenuLayer *menu_layer;
+static uint8_t filter = INVALID_INDEX;
+static uint32_t log_begin = 0;
+static uint32_t log_end = 0;
+static uint16_t log_count = 0;
+static uint16_t kept_count = 0;	/* partition entries out of the ring */
+static uint16_t kept_row = UINT16_MAX;	/* row of kept_entry, if any */
+static struct log_entry kept_entry;
+static struct kept_day kept_days[LOG_PARTITION_CAPACITY];
+static uint16_t kept_day_count = 0;
+static bool kept_day_merged = false;	/* first one is the oldest ring day */
+static BITARRAY_DECLARE(matches, LOG_CAPACITY);
+
+static bool
+kept_matches(const struct log_entry *entry) {
+	return filter == INVALID_INDEX
+	    || (entry->id >= 128 ? entry->id - 128 : entry->id - 1) == filter;
+}
+
+/* newest kept entry shown by the menu older than *before */
+static bool
+next_kept(uint32_t *before, struct log_entry *entry) {
+	while (log_partition_next(before, entry)) {
+		if (kept_matches(entry)) return true;
+	}
+	return false;
+}
+
+/* oldest kept entry shown by the menu newer than *after */
+static bool
+prev_kept(uint32_t *after, struct log_entry *entry) {
+	while (log_partition_prev(after, entry)) {
+		if (kept_matches(entry)) return true;
+	}
+	return false;
+}
+
+/* number of day sections of the ring, newest first */
+static uint16_t
+day_section_count(void) {
+	return filter == INVALID_INDEX && log_count
+	    ? event_log_day_count() : 0;
+}
+
+static bool
+get_day(uint16_t section_index, struct log_day *day) {
+	const uint8_t day_count = event_log_day_count();
+
+	if (section_index >= day_section_count()) return false;
+	return event_log_day(day_count - 1 - section_index, day);
+}
+
+static void
+rebuild_menu(void) {
+	struct log_entry entry;
+	struct log_day day;
+	uint32_t seq;
+
+	log_begin = event_log_begin();
+	log_end = event_log_end();
+	kept_row = UINT16_MAX;
+
+	if (filter == INVALID_INDEX) {
+		log_count = log_end - log_begin;
+	} else {
+		log_count = event_log_filter(filter, matches);
+	}
+
+	kept_count = 0;
+	kept_day_count = 0;
+	seq = log_begin;
+	while (next_kept(&seq, &entry)) {
+		const uint16_t entry_day = local_day(entry.time);
+
+		if (filter == INVALID_INDEX
+		    && kept_day_count < LOG_PARTITION_CAPACITY
+		    && (!kept_day_count
+		     || kept_days[kept_day_count - 1].day != entry_day)) {
+			kept_days[kept_day_count++] = (struct kept_day){
+			    .day = entry_day,
+			    .first_row = kept_count,
+			};
+		}
+		kept_count += 1;
+	}
+
+	/* kept entries of the oldest day in the ring are shown with it */
+	kept_day_merged = kept_day_count && day_section_count()
+	    && get_day(day_section_count() - 1, &day)
+	    && day.day == kept_days[0].day;
+}
+
+/* kept day shown in the given section after its ring entries, or -1 */
+static int
+kept_day_of(uint16_t section_index) {
+	const uint16_t ring_sections = day_section_count();
+	uint16_t result;
+
+	if (filter != INVALID_INDEX || section_index + 1 < ring_sections)
+		return -1;
+	if (section_index < ring_sections) return kept_day_merged ? 0 : -1;
+
+	result = section_index - ring_sections + (kept_day_merged ? 1 : 0);
+	return result < kept_day_count ? result : -1;
+}
+
+static uint16_t
+kept_day_rows(int kept_day) {
+	if (kept_day < 0) return 0;
+	return (kept_day + 1 < kept_day_count
+	    ? kept_days[kept_day + 1].first_row : kept_count)
+	    - kept_days[kept_day].first_row;
+}
+
+static uint16_t
+ring_rows(uint16_t section_index) {
+	struct log_day day;
+
+	return get_day(section_index, &day) ? day.end - day.first : 0;
+}
+
+/* sequence number of the ring entry displayed in the given cell */
+static uint32_t
+cell_seq(const MenuIndex *cell_index) {
+	struct log_day day;
+	uint16_t row = cell_index->row;
+
+	if (filter == INVALID_INDEX) {
+		return get_day(cell_index->section, &day)
+		    ? day.end - 1 - row : UINT32_MAX;
+	}
+
+	for (int32_t i = log_end - log_begin - 1; i >= 0; i -= 1) {
+		if (!matches[BITARRAY_OFFSET(i)]) {
+			i -= i % CHAR_BIT;
+			continue;
+		}
+		if (BITARRAY_TEST(matches, i) && row-- == 0)
+			return log_begin + i;
+	}
+
+	return UINT32_MAX;
+}
+
+/*
+ * Kept entry of the given row, walking from the last row read, since
+ * scrolling draws neighbouring rows, or from the top when it is closer.
+ */
+static bool
+read_kept(uint16_t row, struct log_entry *entry) {
+	uint32_t seq;
+
+	if (kept_row == UINT16_MAX
+	    || (row < kept_row && row < kept_row - row)) {
+		seq = log_begin;
+		if (!next_kept(&seq, &kept_entry)) return false;
+		kept_row = 0;
+	}
+
+	seq = kept_entry.seq;
+	while (kept_row < row && next_kept(&seq, &kept_entry))
+		kept_row += 1;
+	while (kept_row > row && prev_kept(&seq, &kept_entry))
+		kept_row -= 1;
+
+	if (kept_row != row) {
+		kept_row = UINT16_MAX;
+		return false;
+	}
+
+	*entry = kept_entry;
+	return true;
+}
+
+/* entry displayed in the given cell, kept entries after the ring ones */
+static bool
+read_cell(const MenuIndex *cell_index, struct log_entry *entry) {
+	const int kept_day = kept_day_of(cell_index->section);
+	const uint16_t row = cell_index->row;
+	uint16_t ring;
+
+	if (filter != INVALID_INDEX) {
+		return row < log_count ? event_log_read(cell_seq(cell_index),
+		    entry) : read_kept(row - log_count, entry);
+	}
+
+	ring = ring_rows(cell_index->section);
+	if (row < ring) return event_log_read(cell_seq(cell_index), entry);
+	if (kept_day < 0) return false;
+	return read_kept(kept_days[kept_day].first_row + row - ring, entry);
+}
+
+static uint16_t
+get_num_sections(MenuLayer *menu_layer, void *context) {
+	(void)menu_layer;
+	(void)context;
+
+	if (filter != INVALID_INDEX || (!log_count && !kept_count)) return 1;
+	return day_section_count() + kept_day_count
+	    - (kept_day_merged ? 1 : 0);
+}
+
+static uint16_t
+get_num_rows(MenuLayer *menu_layer, uint16_t section_index, void *context) {
+	(void)menu_layer;
+	(void)context;
+
+	if (!log_count && !kept_count) return 1;
+	if (filter != INVALID_INDEX) return log_count + kept_count;
+	return ring_rows(section_index)
+	    + kept_day_rows(kept_day_of(section_index));
+}
+
+static int16_t
+get_header_height(MenuLayer *menu_layer, uint16_t section_index,
+    void *context) {
+	(void)menu_layer;
+	(void)section_index;
+	(void)context;
+
+	if (filter != INVALID_INDEX || (!log_count && !kept_count)) return 0;
+	return MENU_CELL_BASIC_HEADER_HEIGHT;
+}
+
+static void
+draw_header(GContext *ctx, const Layer *cell_layer, uint16_t section_index,
+    void *context) {
+	const int kept_day = kept_day_of(section_index);
+	struct log_day day;
+	char buffer[32];
+	time_t midnight;
+
+	(void)context;
+
+	/* day numbers are in local time, so no further offset is needed */
+	if (get_day(section_index, &day)) {
+		midnight = (time_t)day.day * 86400;
+	} else if (kept_day >= 0) {
+		midnight = (time_t)kept_days[kept_day].day * 86400;
+	} else {
+		return;
+	}
+
+	if (!strftime(buffer, sizeof buffer, "%a %Y-%m-%d", gmtime(&midnight)))
+		buffer[0] = 0;
+	menu_cell_basic_header_draw(ctx, cell_layer, buffer);
+}
+
+static void
+draw_row(GContext *ctx, const Layer *cell_layer, MenuIndex *cell_index,
+    void *context) {
+	char title_buffer[TITLE_LENGTH];
+	char subtitle[32];
+	const char *title;
+	struct log_entry entry;
+	size_t length;
+
+	(void)context;
+
+	if ((!log_count && !kept_count) || !read_cell(cell_index, &entry)) {
+		menu_cell_basic_draw(ctx, cell_layer, no_event_message, 0, 0);
+		return;
+	}
+
+	length = strftime(subtitle, sizeof subtitle,
+	    filter == INVALID_INDEX ? "%H:%M" : "%Y-%m-%d %H:%M",
+	    localtime(&entry.time));
+	if (entry.duration != LOG_NO_DURATION) {
+		snprintf(subtitle + length, sizeof subtitle - length,
+		    ", %" PRIu16 "h%02" PRIu16,
+		    entry.duration / 60, entry.duration % 60);
+	}
+
+	title = event_title(title_buffer, sizeof title_buffer, entry.id);
+	if (title) {
+		menu_cell_basic_draw(ctx, cell_layer, title, subtitle, 0);
+	} else {
+		menu_cell_basic_draw(ctx, cell_layer, subtitle, 0, 0);
+	}
+}
+
+static void
+window_load(Window *window) {
+	Layer *window_layer = window_get_root_layer(window);
+	GRect bounds = layer_get_bounds(window_layer);
+
+	rebuild_menu();
+
+	menu_layer = menu_layer_create(bounds);
+	menu_layer_set_callbacks(menu_layer, 0, (MenuLayerCallbacks) {
+	    .get_num_sections = &get_num_sections,
+	    .get_num_rows = &get_num_rows,
+	    .get_header_height = &get_header_height,
+	    .draw_header = &draw_header,
+	    .draw_row = &draw_row,
+	});
+	menu_layer_set_click_config_onto_window(menu_layer, window);
+	layer_add_child(window_layer, menu_layer_get_layer(menu_layer));
+	metrics_sample_heap();
+}
+
+static void
+window_unload(Window *window) {
+	menu_layer_destroy(menu_layer);
+	menu_layer = 0;
+}
+
+static void
+push_window(void) {
+	if (!window) {
+		window = window_create();
+		window_set_window_handlers(window, (WindowHandlers) {
+		    .load = &window_load,
+		    .unload = &window_unload,
+		});
+	}
+	window_stack_push(window, true);
+}
+
+void
+push_log_menu(void) {
+	filter = INVALID_INDEX;
+	push_window();
+}
+
+void
+push_event_log_menu(uint8_t index) {
+	filter = index;
+	push_window();
+}
@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pebble.h>
+
+#include "global.h"
+#include "storage.h"
+
+/*
+ * Log partitions keep the entries of selected events (e.g. every event
+ * under "Health/") in their own pages when they are evicted from the
+ * shared log ring, so that they outlive it when frequent events push
+ * them out. Pages are written with the rollups, once per evicted segment.
+ * Partitions are configured as a comma-separated list of name prefixes,
+ * each optionally followed by ":" and its number of pages.
+ */
+
+struct __attribute__((__packed__)) kept_entry {
+	uint32_t seq;
+	time_t time;
+	uint8_t id;
+	uint16_t duration;
+};
+
+_Static_assert(sizeof(struct kept_entry) == KEPT_ENTRY_SIZE,
+    "KEPT_ENTRY_SIZE does not match struct kept_entry");
+
+#define KEPT_PER_PAGE LOG_PARTITION_PAGE_LENGTH
+
+struct __attribute__((__packed__)) kept_page {
+	uint8_t used;
+	struct kept_entry entries[KEPT_PER_PAGE];
+};
+
+_Static_assert(sizeof(struct kept_page) <= PERSIST_DATA_MAX_LENGTH,
+    "kept_page does not fit in a persistent value");
+_Static_assert(LOG_PARTITION_PAGES * sizeof(struct kept_page)
+    == LOG_PARTITION_STORAGE_SIZE,
+    "LOG_PARTITION_STORAGE_SIZE does not match struct kept_page");
+
+struct partition {
+	const char *prefix;
+	uint8_t length;
+	uint8_t first_page;
+	uint8_t page_count;
+	uint8_t head;		/* page receiving new entries */
+};
+
+/* every partition owns at least one page */
+#define MAX_PARTITIONS LOG_PARTITION_PAGES
+
+static char spec[LOG_PARTITION_SPEC_LENGTH];
+static struct partition partitions[MAX_PARTITIONS];
+static uint8_t partition_count = 0;
+static struct kept_page pages[LOG_PARTITION_PAGES];
+static uint8_t dirty_pages = 0;
+static bool loaded = false;
+
+_Static_assert(LOG_PARTITION_PAGES <= 8,
+    "dirty pages do not fit in a byte");
+_Static_assert(LOG_PARTITION_PAGES <= LEGACY_PARTITION_PAGES,
+    "partition pages overlap other keys");
+
+static uint32_t
+last_seq(const struct kept_page *page) {
+	return page->used ? page->entries[page->used - 1].seq : 0;
+}
+
+/* splits spec in place and assigns pages to each partition in order */
+static void
+parse_spec(void) {
+	char *cursor = spec;
+	uint8_t next_page = 0;
+
+	partition_count = 0;
+
+	while (*cursor && partition_count < MAX_PARTITIONS
+	    && next_page < LOG_PARTITION_PAGES) {
+		const unsigned free_pages = LOG_PARTITION_PAGES - next_page;
+		struct partition *partition;
+		char *item = cursor;
+		char *end = strchr(cursor, ',');
+		char *budget;
+		unsigned page_count = 1;
+
+		if (end) {
+			*end = 0;
+			cursor = end + 1;
+		} else {
+			cursor = item + strlen(item);
+		}
+
+		budget = strrchr(item, ':');
+		if (budget) {
+			*budget = 0;
+			page_count = 0;
+			for (const char *c = budget + 1;
+			    *c >= '0' && *c <= '9' && page_count <= free_pages;
+			    c += 1)
+				page_count = page_count * 10 + (*c - '0');
+		}
+
+		if (!item[0] || !page_count) continue;
+		if (page_count > free_pages) page_count = free_pages;
+
+		partition = partitions + partition_count++;
+		*partition = (struct partition){
+		    .prefix = item,
+		    .length = strlen(item),
+		    .first_page = next_page,
+		    .page_count = page_count,
+		    .head = next_page,
+		};
+		next_page += page_count;
+
+		for (uint8_t i = 1; i < page_count; i += 1) {
+			const uint8_t page = partition->first_page + i;
+
+			if (last_seq(pages + page)
+			    > last_seq(pages + partition->head))
+				partition->head = page;
+		}
+	}
+}
+
+void
+log_partition_init(void) {
+	int ret;
+
+	if (loaded) return;
+	loaded = true;
+
+	for (uint8_t i = 0; i < LOG_PARTITION_PAGES; i += 1) {
+		ret = persist_read_data(KEY_PARTITION_LOG + i,
+		    pages + i, sizeof *pages);
+		ret = ret > 0 ? (ret - 1) / sizeof *pages[i].entries : 0;
+		if (pages[i].used > ret) pages[i].used = ret;
+	}
+
+	for (uint8_t i = LOG_PARTITION_PAGES; i < LEGACY_PARTITION_PAGES;
+	    i += 1) {
+		if (persist_exists(KEY_PARTITION_LOG + i))
+			storage_delete(KEY_PARTITION_LOG + i);
+	}
+
+	persist_read_string(KEY_LOG_PARTITIONS, spec, sizeof spec);
+	spec[sizeof spec - 1] = 0;
+	parse_spec();
+}
+
+/* pages are reassigned by a new spec, so their entries are dropped */
+void
+log_partition_configure(const char *new_spec) {
+	char old_spec[sizeof spec];
+
+	if (!loaded) log_partition_init();
+
+	if (persist_read_string(KEY_LOG_PARTITIONS,
+	    old_spec, sizeof old_spec) < 0)
+		old_spec[0] = 0;
+	old_spec[sizeof old_spec - 1] = 0;
+
+	strncpy(spec, new_spec, sizeof spec);
+	spec[sizeof spec - 1] = 0;
+	if (!strcmp(old_spec, spec)) {
+		parse_spec();
+		return;
+	}
+
+	dirty_pages = 0;
+	for (uint8_t i = 0; i < LOG_PARTITION_PAGES; i += 1) {
+		pages[i].used = 0;
+		if (persist_exists(KEY_PARTITION_LOG + i))
+			storage_delete(KEY_PARTITION_LOG + i);
+	}
+
+	storage_write_string(KEY_LOG_PARTITIONS, spec);
+	parse_spec();
+}
+
+static struct partition *
+find_partition(uint8_t id) {
+	const uint8_t index = id >= 128 ? id - 128 : id - 1;
+	const char *title;
+
+	if (!id || index >= event_names.count) return 0;
+
+	title = STRLIST_UNSAFE_ITEM(event_names, index);
+	if (title[0] == '+' || title[0] == '-') title += 1;
+
+	for (uint8_t i = 0; i < partition_count; i += 1) {
+		if (!strncmp(title, partitions[i].prefix, partitions[i].length))
+			return partitions + i;
+	}
+
+	return 0;
+}
+
+/* duration of an end from the begin kept before it, if any */
+static uint16_t
+kept_duration(const struct partition *partition,
+    const struct log_entry *end) {
+	const uint8_t index = end->id - 128;
+	const struct kept_entry *begin = 0;
+
+	for (uint8_t i = 0; i < partition->page_count; i += 1) {
+		const struct kept_page *page
+		    = pages + partition->first_page + i;
+
+		for (uint8_t j = page->used; j > 0; j -= 1) {
+			const struct kept_entry *entry = page->entries + j - 1;
+			const uint8_t id = entry->id;
+
+			if (entry->seq >= end->seq
+			    || (id >= 128 ? id - 128 : id - 1) != index)
+				continue;
+			if (!begin || entry->seq > begin->seq) begin = entry;
+			break;
+		}
+	}
+
+	if (!begin || begin->id >= 128 || end->time < begin->time)
+		return LOG_NO_DURATION;
+	return (end->time - begin->time) / 60 < LOG_NO_DURATION
+	    ? (end->time - begin->time) / 60 : LOG_NO_DURATION - 1;
+}
+
+/*
+ * Copies an entry evicted from the ring into its partition. When the
+ * partition is full, its oldest page is evicted, or its oldest entry when
+ * it has a single page. Changed pages are written by log_partition_store.
+ */
+void
+log_partition_keep(const struct log_entry *entry) {
+	struct partition *partition;
+	struct kept_page *page;
+	uint16_t duration = entry->duration;
+
+	if (!loaded) log_partition_init();
+
+	partition = find_partition(entry->id);
+	if (!partition) return;
+
+	/* entries copied when they were recorded are already there */
+	page = pages + partition->head;
+	if (page->used && last_seq(page) >= entry->seq) return;
+
+	if (entry->id >= 128 && duration == LOG_NO_DURATION)
+		duration = kept_duration(partition, entry);
+
+	if (page->used >= KEPT_PER_PAGE && partition->page_count > 1) {
+		partition->head = partition->first_page
+		    + (partition->head - partition->first_page + 1)
+		    % partition->page_count;
+		page = pages + partition->head;
+		page->used = 0;
+	} else if (page->used >= KEPT_PER_PAGE) {
+		memmove(page->entries, page->entries + 1,
+		    (KEPT_PER_PAGE - 1) * sizeof *page->entries);
+		page->used -= 1;
+	}
+
+	page->entries[page->used++] = (struct kept_entry){
+	    .seq = entry->seq,
+	    .time = entry->time,
+	    .id = entry->id,
+	    .duration = duration,
+	};
+	dirty_pages |= 1u << partition->head;
+}
+
+void
+log_partition_store(void) {
+	int ret;
+
+	for (uint8_t i = 0; i < LOG_PARTITION_PAGES; i += 1) {
+		if (!(dirty_pages & (1u << i))) continue;
+
+		ret = storage_write_data(KEY_PARTITION_LOG + i, pages + i,
+		    1 + pages[i].used * sizeof *pages[i].entries);
+		if (ret < 0) {
+			APP_LOG(APP_LOG_LEVEL_ERROR,
+			    "Error %d while writing log partition page %u",
+			    ret, (unsigned)i);
+		} else {
+			dirty_pages &= ~(1u << i);
+		}
+	}
+}
+
+/* number of kept entries older than the given sequence number */
+uint16_t
+log_partition_count(uint32_t before) {
+	uint16_t result = 0;
+
+	if (!loaded) log_partition_init();
+
+	for (uint8_t i = 0; i < LOG_PARTITION_PAGES; i += 1) {
+		for (uint8_t j = 0; j < pages[i].used; j += 1) {
+			if (pages[i].entries[j].seq < before) result += 1;
+		}
+	}
+
+	return result;
+}
+
+/* newest kept entry older than *before across all partitions */
+bool
+log_partition_next(uint32_t *before, struct log_entry *result) {
+	const struct kept_entry *best = 0;
+
+	if (!loaded) log_partition_init();
+
+	for (uint8_t i = 0; i < LOG_PARTITION_PAGES; i += 1) {
+		for (uint8_t j = pages[i].used; j > 0; j -= 1) {
+			const struct kept_entry *entry
+			    = pages[i].entries + j - 1;
+
+			/* entries are in increasing order within a page */
+			if (entry->seq >= *before) continue;
+			if (!best || entry->seq > best->seq) best = entry;
+			break;
+		}
+	}
+
+	if (!best) return false;
+
+	*before = best->seq;
+	result->seq = best->seq;
+	result->time = best->time;
+	result->id = best->id;
+	result->duration = best->duration;
+	return true;
+}
+
+/* oldest kept entry newer than *after, to walk back log_partition_next */
+bool
+log_partition_prev(uint32_t *after, struct log_entry *result) {
+	const struct kept_entry *best = 0;
+
+	if (!loaded) log_partition_init();
+
+	for (uint8_t i = 0; i < LOG_PARTITION_PAGES; i += 1) {
+		for (uint8_t j = 0; j < pages[i].used; j += 1) {
+			const struct kept_entry *entry = pages[i].entries + j;
+
+			if (entry->seq <= *after) continue;
+			if (!best || entry->seq < best->seq) best = entry;
+			break;
+		}
+	}
+
+	if (!best) return false;
+
+	*after = best->seq;
+	result->seq = best->seq;
+	result->time = best->time;
+	result->id = best->id;
+	result->duration = best->duration;
+	return true;
+}
@@ -0,0 +1,483 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pebble.h>
+
+#include "global.h"
+#include "storage.h"
+
+/*
+ * Per event totals of entries evicted from the log ring, over buckets of
+ * span days starting at day. Buckets start daily and, when the page is
+ * full, the oldest ones are merged into aligned weeks, then into 28-day
+ * and 112-day periods, so that the page covers months of events.
+ */
+struct rollup {
+	uint16_t day;
+	uint8_t index;
+	uint8_t span;
+	uint16_t count;		/* short events and starts of long events */
+	uint16_t duration;	/* in minutes, from ends of long events */
+};
+
+/*
+ * The page stores the last day rolled up, which bounds the bucket still
+ * being filled, then each bucket once followed by the non-zero totals of
+ * its events.
+ */
+struct __attribute__((__packed__)) bucket_header {
+	uint16_t day;
+	uint8_t span;
+	uint8_t item_count;
+};
+
+struct __attribute__((__packed__)) bucket_item {
+	uint8_t index;		/* with ITEM_DURATION for a duration */
+	uint16_t value;
+};
+
+#define ITEM_DURATION 0x80
+
+_Static_assert(STRLIST_MAX_SIZE <= ITEM_DURATION,
+    "event indices collide with the duration flag");
+
+/* room kept for a new bucket with both totals of an event */
+#define ROOM_FOR_RECORD \
+	(sizeof(struct bucket_header) + 2 * sizeof(struct bucket_item))
+
+#define MAX_ROLLUPS ((PERSIST_DATA_MAX_LENGTH - sizeof(uint16_t) \
+	- sizeof(struct bucket_header)) / sizeof(struct bucket_item))
+
+/* records of the first bucket format, one per bucket and per event */
+struct __attribute__((__packed__)) bucket_rollup {
+	uint16_t day;
+	uint8_t index;
+	uint8_t span;
+	uint16_t count;
+	uint16_t duration;
+};
+
+#define MAX_BUCKET_ROLLUPS ((PERSIST_DATA_MAX_LENGTH - sizeof(uint16_t)) \
+	/ sizeof(struct bucket_rollup))
+
+/* records of the previous format, one per day and per event */
+struct __attribute__((__packed__)) legacy_rollup {
+	uint16_t day;
+	uint8_t index;
+	uint8_t count;
+	uint16_t duration;
+};
+
+#define MAX_LEGACY_ROLLUPS \
+	(PERSIST_DATA_MAX_LENGTH / sizeof(struct legacy_rollup))
+
+static struct rollup rollups[MAX_ROLLUPS];
+static uint8_t rollup_count = 0;
+static uint16_t last_rolled = 0;
+static bool loaded = false;
+static bool warned = false;
+
+static uint16_t
+add_capped(uint16_t a, uint16_t b, uint16_t cap) {
+	return (uint32_t)a + b < cap ? a + b : cap - 1;
+}
+
+static bool
+same_bucket(const struct rollup *a, const struct rollup *b) {
+	return a->day == b->day && a->span == b->span;
+}
+
+/* whether the record is the first one of its bucket */
+static bool
+opens_bucket(uint8_t i) {
+	for (uint8_t j = 0; j < i; j += 1) {
+		if (same_bucket(rollups + j, rollups + i)) return false;
+	}
+	return true;
+}
+
+static uint8_t
+item_count(const struct rollup *rollup) {
+	return (rollup->count || !rollup->duration) + !!rollup->duration;
+}
+
+static size_t
+stored_size(void) {
+	size_t result = sizeof last_rolled;
+
+	for (uint8_t i = 0; i < rollup_count; i += 1) {
+		if (opens_bucket(i)) result += sizeof(struct bucket_header);
+		result += item_count(rollups + i) * sizeof(struct bucket_item);
+	}
+
+	return result;
+}
+
+/* whether merging the bucket starting at start saves room */
+static bool
+bucket_mergeable(uint8_t span, uint8_t into, uint16_t start) {
+	for (uint8_t i = 0; i < rollup_count; i += 1) {
+		if (rollups[i].span > into || rollups[i].day < start
+		    || rollups[i].day >= start + into)
+			continue;
+		for (uint8_t j = i + 1; j < rollup_count; j += 1) {
+			if (!same_bucket(rollups + i, rollups + j)
+			    && rollups[j].span <= into
+			    && rollups[j].day >= start
+			    && rollups[j].day < start + into
+			    && (rollups[i].span == span
+			     || rollups[j].span == span))
+				return true;
+		}
+	}
+	return false;
+}
+
+/* folds records of at most into days in [start, start + into) together */
+static void
+merge_bucket(uint8_t into, uint16_t start) {
+	uint8_t kept = 0;
+
+	for (uint8_t i = 0; i < rollup_count; i += 1) {
+		struct rollup *target = 0;
+
+		if (rollups[i].span <= into && rollups[i].day >= start
+		    && rollups[i].day < start + into) {
+			rollups[i].day = start;
+			rollups[i].span = into;
+			for (uint8_t j = 0; j < kept && !target; j += 1) {
+				if (rollups[j].day == start
+				    && rollups[j].span == into
+				    && rollups[j].index == rollups[i].index)
+					target = rollups + j;
+			}
+		}
+
+		if (!target) {
+			rollups[kept++] = rollups[i];
+			continue;
+		}
+
+		target->count = add_capped(target->count, rollups[i].count,
+		    UINT16_MAX);
+		target->duration = add_capped(target->duration,
+		    rollups[i].duration, LOG_NO_DURATION);
+	}
+
+	rollup_count = kept;
+}
+
+/* merges the oldest bucket of span days that saves room */
+static bool
+merge_oldest(uint8_t span, uint8_t into) {
+	uint16_t after = 0;
+
+	for (;;) {
+		uint16_t start = UINT16_MAX;
+
+		for (uint8_t i = 0; i < rollup_count; i += 1) {
+			const uint16_t bucket
+			    = rollups[i].day - rollups[i].day % into;
+
+			if (rollups[i].span == span && bucket >= after
+			    && bucket < start)
+				start = bucket;
+		}
+
+		if (start == UINT16_MAX) return false;
+		if (bucket_mergeable(span, into, start)) {
+			merge_bucket(into, start);
+			return true;
+		}
+		after = start + into;
+	}
+}
+
+/* drops every record starting on the oldest day present */
+static void
+drop_oldest_day(void) {
+	uint16_t oldest = UINT16_MAX;
+	uint8_t kept = 0;
+
+	for (uint8_t i = 0; i < rollup_count; i += 1) {
+		if (rollups[i].day < oldest) oldest = rollups[i].day;
+	}
+
+	for (uint8_t i = 0; i < rollup_count; i += 1) {
+		if (rollups[i].day != oldest) rollups[kept++] = rollups[i];
+	}
+
+	/* once a session is enough to tell the page is full */
+	APP_LOG(warned ? APP_LOG_LEVEL_DEBUG : APP_LOG_LEVEL_WARNING,
+	    "Log rollups full, dropping %u records of day %" PRIu16,
+	    (unsigned)(rollup_count - kept), oldest);
+	warned = true;
+	rollup_count = kept;
+}
+
+/* makes sure the page has room for any update of one record */
+static void
+make_room(void) {
+	while (rollup_count >= MAX_ROLLUPS
+	    || stored_size() + ROOM_FOR_RECORD > PERSIST_DATA_MAX_LENGTH) {
+		if (merge_oldest(1, 7) || merge_oldest(7, 28)
+		    || merge_oldest(28, 112))
+			continue;
+		drop_oldest_day();
+	}
+}
+
+/* adds a total read from storage to the record of its bucket */
+static void
+load_item(const struct bucket_header *header,
+    const struct bucket_item *item) {
+	const uint8_t index = item->index & ~ITEM_DURATION;
+	struct rollup *rollup = 0;
+
+	for (uint8_t i = rollup_count; i > 0 && !rollup; i -= 1) {
+		if (rollups[i - 1].day != header->day
+		    || rollups[i - 1].span != header->span)
+			break;
+		if (rollups[i - 1].index == index) rollup = rollups + i - 1;
+	}
+
+	if (!rollup) {
+		if (rollup_count >= MAX_ROLLUPS) return;
+		rollup = rollups + rollup_count++;
+		*rollup = (struct rollup){
+		    .day = header->day,
+		    .index = index,
+		    .span = header->span,
+		};
+	}
+
+	if (item->index & ITEM_DURATION) {
+		rollup->duration = item->value;
+	} else {
+		rollup->count = item->value;
+	}
+}
+
+static void
+load_page(void) {
+	uint8_t data[PERSIST_DATA_MAX_LENGTH];
+	struct bucket_header header;
+	struct bucket_item item;
+	size_t offset = sizeof last_rolled;
+	int ret;
+
+	ret = persist_read_data(KEY_EVENT_ROLLUP, data, sizeof data);
+	if (ret < (int)sizeof last_rolled) return;
+	memcpy(&last_rolled, data, sizeof last_rolled);
+
+	while (offset + sizeof header <= (size_t)ret) {
+		memcpy(&header, data + offset, sizeof header);
+		offset += sizeof header;
+		for (uint8_t i = 0; i < header.item_count
+		    && offset + sizeof item <= (size_t)ret; i += 1) {
+			memcpy(&item, data + offset, sizeof item);
+			offset += sizeof item;
+			load_item(&header, &item);
+		}
+	}
+}
+
+/* converts records of the first bucket format, then drops them */
+static void
+import_bucket_rollups(void) {
+	struct __attribute__((__packed__)) {
+		uint16_t last_day;
+		struct bucket_rollup records[MAX_BUCKET_ROLLUPS];
+	} old;
+	int ret;
+
+	ret = persist_read_data(KEY_LEGACY_BUCKETS, &old, sizeof old);
+	if (ret <= (int)sizeof old.last_day) {
+		storage_delete(KEY_LEGACY_BUCKETS);
+		return;
+	}
+
+	if (old.last_day > last_rolled) last_rolled = old.last_day;
+	for (uint8_t i = 0; i < (ret - sizeof old.last_day)
+	    / sizeof *old.records; i += 1) {
+		make_room();
+		rollups[rollup_count++] = (struct rollup){
+		    .day = old.records[i].day,
+		    .index = old.records[i].index,
+		    .span = old.records[i].span,
+		    .count = old.records[i].count,
+		    .duration = old.records[i].duration,
+		};
+	}
+
+	log_rollup_store();
+	storage_delete(KEY_LEGACY_BUCKETS);
+}
+
+/* converts daily records of the previous format, then drops them */
+static void
+import_legacy_rollups(void) {
+	struct legacy_rollup legacy[MAX_LEGACY_ROLLUPS];
+	int ret;
+
+	ret = persist_read_data(KEY_LEGACY_ROLLUP, legacy, sizeof legacy);
+	if (ret <= 0) return;
+
+	for (uint8_t i = 0; i < ret / sizeof *legacy; i += 1) {
+		make_room();
+		if (legacy[i].day > last_rolled)
+			last_rolled = legacy[i].day;
+		rollups[rollup_count++] = (struct rollup){
+		    .day = legacy[i].day,
+		    .index = legacy[i].index,
+		    .span = 1,
+		    .count = legacy[i].count,
+		    .duration = legacy[i].duration,
+		};
+	}
+
+	log_rollup_store();
+	storage_delete(KEY_LEGACY_ROLLUP);
+}
+
+static void
+load_rollups(void) {
+	loaded = true;
+	load_page();
+	if (persist_exists(KEY_LEGACY_BUCKETS)) import_bucket_rollups();
+	if (persist_exists(KEY_LEGACY_ROLLUP)) import_legacy_rollups();
+}
+
+void
+log_rollup_add(time_t time, uint8_t id, uint16_t duration) {
+	const bool is_end = (id >= 128);
+	const uint8_t index = is_end ? id - 128 : id - 1;
+	const uint16_t day = local_day(time);
+	struct rollup *rollup = 0;
+
+	if (!id) return;
+	if (!loaded) load_rollups();
+	if (day > last_rolled) last_rolled = day;
+	make_room();
+
+	for (uint8_t i = rollup_count; i > 0 && !rollup; i -= 1) {
+		const struct rollup *candidate = rollups + i - 1;
+
+		if (candidate->index == index && candidate->day <= day
+		    && day - candidate->day < candidate->span)
+			rollup = rollups + i - 1;
+	}
+
+	if (!rollup) {
+		rollup = rollups + rollup_count++;
+		*rollup = (struct rollup){
+		    .day = day,
+		    .index = index,
+		    .span = 1,
+		};
+	}
+
+	if (!is_end) {
+		rollup->count = add_capped(rollup->count, 1, UINT16_MAX);
+	} else if (duration != LOG_NO_DURATION) {
+		rollup->duration = add_capped(rollup->duration, duration,
+		    LOG_NO_DURATION);
+	}
+}
+
+void
+log_rollup_store(void) {
+	uint8_t data[ROLLUP_STORAGE_SIZE];
+	size_t size = sizeof last_rolled;
+	int ret;
+
+	memcpy(data, &last_rolled, sizeof last_rolled);
+	for (uint8_t i = 0; i < rollup_count; i += 1) {
+		struct bucket_header header = {
+		    .day = rollups[i].day,
+		    .span = rollups[i].span,
+		};
+		const size_t header_offset = size;
+
+		if (!opens_bucket(i)) continue;
+		size += sizeof header;
+
+		for (uint8_t j = i; j < rollup_count; j += 1) {
+			const struct rollup *rollup = rollups + j;
+			struct bucket_item item = { .index = rollup->index };
+
+			if (!same_bucket(rollups + i, rollup)) continue;
+			if (rollup->count || !rollup->duration) {
+				item.value = rollup->count;
+				memcpy(data + size, &item, sizeof item);
+				size += sizeof item;
+				header.item_count += 1;
+			}
+			if (rollup->duration) {
+				item.index |= ITEM_DURATION;
+				item.value = rollup->duration;
+				memcpy(data + size, &item, sizeof item);
+				size += sizeof item;
+				header.item_count += 1;
+			}
+		}
+
+		memcpy(data + header_offset, &header, sizeof header);
+	}
+
+	ret = storage_write_data(KEY_EVENT_ROLLUP, data, size);
+	if (ret < 0) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Error %d while writing log rollups", ret);
+	}
+}
+
+/*
+ * Occurrences of index rolled up on days from first_day to last_day.
+ * Buckets only partly within these days are counted in proportion of
+ * their days already rolled up.
+ */
+uint16_t
+log_rollup_count(uint8_t index, uint16_t first_day, uint16_t last_day,
+    uint32_t *duration) {
+	uint32_t result = 0;
+
+	if (!loaded) load_rollups();
+
+	for (uint8_t i = 0; i < rollup_count; i += 1) {
+		const struct rollup *rollup = rollups + i;
+		uint16_t end = rollup->day + rollup->span - 1;
+		uint16_t from, to, days, span;
+
+		if (end > last_rolled && last_rolled >= rollup->day)
+			end = last_rolled;
+		span = end - rollup->day + 1;
+		from = rollup->day > first_day ? rollup->day : first_day;
+		to = end < last_day ? end : last_day;
+
+		if (rollup->index != index || from > to) continue;
+
+		days = to - from + 1;
+		result += ((uint32_t)rollup->count * days + span / 2) / span;
+		if (duration) {
+			*duration += (uint32_t)rollup->duration * 60u
+			    * days / span;
+		}
+	}
+
+	return result < UINT16_MAX ? result : UINT16_MAX;
+}
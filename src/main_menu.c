@@ -21,7 +21,6 @@
 
 static Window *window;
 static struct event_menu_context *main_menu_context;
-static const char *show_log_message = "Show Event Log";
 
 static void
 do_show_log(int index, void *context) {
@@ -30,14 +29,54 @@ do_show_log(int index, void *context) {
 	push_log_menu();
 }
 
+static void
+do_show_stats(int index, void *context) {
+	(void)index;
+	(void)context;
+	push_stats_menu();
+}
+
+static void
+do_show_profiles(int index, void *context) {
+	(void)index;
+	(void)context;
+	push_profile_menu();
+}
+
+static void
+do_show_running(int index, void *context) {
+	(void)index;
+	(void)context;
+	push_running_menu();
+}
+
+static SimpleMenuItem extra_items[] = {
+	{ .callback = &do_show_running, .title = "Running Events" },
+	{ .callback = &do_show_log, .title = "Show Event Log" },
+	{ .callback = &do_show_stats, .title = "Show Statistics" },
+	{ .callback = &do_show_profiles, .title = "Event Profile" },
+};
+
+#define EXTRA_ITEM_COUNT (sizeof extra_items / sizeof *extra_items)
+
+/* the profile item, last, is only shown when profiles are configured */
+static unsigned
+update_extra_items(void) {
+	extra_items[EXTRA_ITEM_COUNT - 1].subtitle
+	    = event_profile_name(event_profile_active());
+	return EXTRA_ITEM_COUNT - (event_profile_count() ? 0 : 1);
+}
+
 static void
 window_load(Window *window) {
-	SimpleMenuItem item = {
-	    .callback = &do_show_log,
-	    .title = show_log_message
-	};
+	main_menu_context = event_menu_build(window, update_extra_items(),
+	    extra_items, INVALID_INDEX);
+}
 
-	main_menu_context = event_menu_build(window, 1, &item, INVALID_INDEX);
+static void
+window_appear(Window *window) {
+	(void)window;
+	if (main_menu_context) event_menu_refresh_frequent(main_menu_context);
 }
 
 static void
@@ -54,21 +93,18 @@ push_main_menu(void) {
 		window = window_create();
 		window_set_window_handlers(window, (WindowHandlers) {
 		    .load = &window_load,
+		    .appear = &window_appear,
 		    .unload = &window_unload,
 		});
 	}
 	window_stack_push(window, true);
 }
 
+/* reloads the menu data in place, so the selection is kept */
 void
 update_main_menu(void) {
-	SimpleMenuItem item = {
-	    .callback = &do_show_log,
-	    .title = show_log_message
-	};
-
 	if (!window || !main_menu_context) return;
 
-	event_menu_destroy(main_menu_context);
-	main_menu_context = event_menu_build(window, 1, &item, INVALID_INDEX);
+	event_menu_reload(main_menu_context, update_extra_items(),
+	    extra_items);
 }
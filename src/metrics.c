@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pebble.h>
+
+#include "global.h"
+#include "storage.h"
+
+/* upper bounds in milliseconds of the tap duration histogram buckets */
+static const uint16_t tap_bucket_limit[] = { 5, 10, 20, 50, 100, 200 };
+
+#define TAP_BUCKET_COUNT \
+	(sizeof tap_bucket_limit / sizeof *tap_bucket_limit + 1)
+
+static uint16_t tap_buckets[TAP_BUCKET_COUNT];
+static uint16_t tap_max_ms;
+static uint16_t switch_count;
+static uint16_t switch_max_ms;
+static size_t heap_peak;
+
+uint32_t
+metrics_now_ms(void) {
+	time_t now;
+	uint16_t now_ms;
+
+	time_ms(&now, &now_ms);
+	return (uint32_t)now * 1000u + now_ms;
+}
+
+void
+metrics_sample_heap(void) {
+	size_t used = heap_bytes_used();
+
+	if (used > heap_peak) heap_peak = used;
+}
+
+void
+metrics_tap(uint32_t start_ms) {
+	uint32_t elapsed = metrics_now_ms() - start_ms;
+	unsigned i;
+
+	for (i = 0; i + 1 < TAP_BUCKET_COUNT
+	    && elapsed >= tap_bucket_limit[i]; i += 1);
+
+	tap_buckets[i] += 1;
+	if (elapsed > tap_max_ms)
+		tap_max_ms = elapsed < UINT16_MAX ? elapsed : UINT16_MAX;
+	metrics_sample_heap();
+}
+
+void
+metrics_switch(uint32_t start_ms) {
+	uint32_t elapsed = metrics_now_ms() - start_ms;
+
+	switch_count += 1;
+	if (elapsed > switch_max_ms)
+		switch_max_ms = elapsed < UINT16_MAX ? elapsed : UINT16_MAX;
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Event profile switched in %" PRIu32 " ms", elapsed);
+	metrics_sample_heap();
+}
+
+void
+metrics_report(void) {
+	metrics_sample_heap();
+
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Taps (ms) <5:%u <10:%u <20:%u <50:%u <100:%u <200:%u more:%u"
+	    ", max %u",
+	    tap_buckets[0], tap_buckets[1], tap_buckets[2], tap_buckets[3],
+	    tap_buckets[4], tap_buckets[5], tap_buckets[6],
+	    (unsigned)tap_max_ms);
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Event profile switches %u, max %u ms",
+	    (unsigned)switch_count, (unsigned)switch_max_ms);
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Peak heap usage %u bytes, %u bytes free",
+	    (unsigned)heap_peak, (unsigned)heap_bytes_free());
+
+	storage_report(KEY_STORAGE_TOTALS);
+}
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pebble.h>
+
+#include "global.h"
+#include "strlist.h"
+
+#define MAX_BATCH_RECORDS PROFILE_BATCH_RECORDS
+#define RETRY_DELAY_MS 30000
+#define BUSY_RETRY_DELAY_MS 1000
+#define WIRE_VERSION 1
+
+/* fixed-size little-endian record, decoded by src/js/app.js */
+struct __attribute__((__packed__)) wire_record {
+	uint32_t seq;
+	uint32_t time;
+	uint8_t id;
+	uint8_t flags;
+	uint16_t duration;	/* in minutes */
+};
+
+#define WIRE_FLAG_DURATION 1
+
+/* dictionary header, record tuple with its version byte, epoch, pull range */
+_Static_assert(1 + 7 + 1 + MAX_BATCH_RECORDS * sizeof(struct wire_record)
+    + 4 * (7 + sizeof(uint32_t)) <= PROFILE_OUTBOX_SIZE,
+    "record batch does not fit in the outbox");
+
+struct pull_state {
+	uint32_t seq;
+	uint32_t end;
+	time_t from;
+	time_t to;
+};
+
+/* link counters of the session, logged when the app exits */
+struct link_stats {
+	uint16_t messages;
+	uint16_t acked;
+	uint16_t failed;
+	uint16_t busy;
+	uint16_t dropped;
+	uint32_t records;
+	uint32_t bytes;
+};
+
+static struct link_stats link_stats;
+static bool in_flight = false;
+static uint32_t in_flight_end = 0;
+static AppTimer *retry_timer = 0;
+static bool pull_active = false;
+static struct pull_state pull;
+static bool names_active = false;
+static uint8_t names_next = 0;
+
+static void
+retry_flush(void *data);
+
+static void
+schedule_retry(uint32_t delay_ms) {
+	if (!retry_timer)
+		retry_timer = app_timer_register(delay_ms, &retry_flush, 0);
+}
+
+/*
+ * Sends entries from seq up to end in one message, storing the end sent
+ * in sent_end, and returns whether a message is on its way.
+ * A pull chunk also carries the range it covers, entries outside the
+ * pull time range being skipped, and may hold no record at all.
+ */
+static bool
+send_records(uint32_t seq, uint32_t end, const struct pull_state *range,
+    uint32_t *sent_end) {
+	uint8_t payload[1 + MAX_BATCH_RECORDS * sizeof(struct wire_record)];
+	struct wire_record *records = (struct wire_record *)(payload + 1);
+	const uint32_t first = seq;
+	struct log_entry entry;
+	AppMessageResult msg_result;
+	DictionaryIterator *iter;
+	DictionaryResult dict_result;
+	uint8_t count = 0;
+
+	payload[0] = WIRE_VERSION;
+	while (seq < end && count < MAX_BATCH_RECORDS) {
+		if (!event_log_read(seq, &entry) || (range
+		    && (entry.time < range->from || entry.time >= range->to))) {
+			seq += 1;
+			continue;
+		}
+		records[count++] = (struct wire_record){
+		    .seq = entry.seq,
+		    .time = entry.time,
+		    .id = entry.id,
+		    .flags = entry.duration == LOG_NO_DURATION
+		      ? 0 : WIRE_FLAG_DURATION,
+		    .duration = entry.duration == LOG_NO_DURATION
+		      ? 0 : entry.duration,
+		};
+		seq += 1;
+	}
+
+	if (!count && !range) return false;
+
+	msg_result = app_message_outbox_begin(&iter);
+	if (msg_result == APP_MSG_BUSY) {
+		link_stats.busy += 1;
+		if (!range && transport != TRANSPORT_BATCHED) {
+			link_stats.dropped += count;
+		} else {
+			schedule_retry(BUSY_RETRY_DELAY_MS);
+		}
+		return false;
+	} else if (msg_result) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "outbox: app_message_outbox_begin returned %d",
+		    (int)msg_result);
+		return false;
+	}
+
+	dict_result = dict_write_data(iter,
+	    range ? KEY_PULL_BATCH : KEY_RECORD_BATCH,
+	    payload, 1 + count * sizeof *records);
+	if (dict_result == DICT_OK)
+		dict_result = dict_write_uint32(iter, KEY_RECORD_EPOCH,
+		    event_log_epoch());
+	if (dict_result == DICT_OK && range) {
+		dict_write_uint32(iter, KEY_PULL_BEGIN, first);
+		dict_write_uint32(iter, KEY_PULL_END, seq);
+		dict_result = dict_write_uint32(iter, KEY_PULL_TARGET,
+		    range->end);
+	}
+	if (dict_result != DICT_OK) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "outbox: [%d] unable to add %" PRIu8 " records",
+		    (int)dict_result, count);
+		return false;
+	}
+
+	msg_result = app_message_outbox_send();
+	if (msg_result) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "outbox: app_message_outbox_send returned %d",
+		    (int)msg_result);
+		return false;
+	}
+
+	link_stats.messages += 1;
+	link_stats.records += count;
+	link_stats.bytes += 1 + count * sizeof *records;
+	if (sent_end) *sent_end = seq;
+	return true;
+}
+
+/* immediate transport: best-effort send of the latest entry */
+void
+outbox_send_latest(void) {
+	const uint32_t end = event_log_end();
+
+	if (!end) return;
+	if (in_flight) {
+		link_stats.dropped += 1;
+		return;
+	}
+	send_records(end - 1, end, 0, 0);
+}
+
+/* bytes taken by a string tuple in a dictionary */
+#define CSTRING_TUPLE_SIZE(str) (7 + strlen(str) + 1)
+
+/*
+ * Sends event names from names_next in one message, with as many as fit,
+ * storing the index after the last one sent in sent_end.
+ * Every chunk carries the name count, the first one also the prefixes.
+ */
+static bool
+send_names(uint32_t *sent_end) {
+	size_t room = PROFILE_OUTBOX_SIZE - 1 - (7 + sizeof(uint32_t));
+	AppMessageResult msg_result;
+	DictionaryIterator *iter;
+	DictionaryResult dict_result;
+	const char *name;
+	uint8_t index = names_next;
+
+	msg_result = app_message_outbox_begin(&iter);
+	if (msg_result == APP_MSG_BUSY) {
+		link_stats.busy += 1;
+		schedule_retry(BUSY_RETRY_DELAY_MS);
+		return false;
+	} else if (msg_result) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "outbox: app_message_outbox_begin returned %d",
+		    (int)msg_result);
+		return false;
+	}
+
+	dict_result = dict_write_uint32(iter, KEY_EVENT_NAMES,
+	    event_names.count);
+	if (dict_result == DICT_OK && !index) {
+		room -= CSTRING_TUPLE_SIZE(begin_prefix)
+		    + CSTRING_TUPLE_SIZE(end_prefix);
+		dict_write_cstring(iter, KEY_BEGIN_PREFIX, begin_prefix);
+		dict_result = dict_write_cstring(iter, KEY_END_PREFIX,
+		    end_prefix);
+	}
+
+	while (dict_result == DICT_OK && index < event_names.count) {
+		name = STRLIST_UNSAFE_ITEM(event_names, index);
+		if (CSTRING_TUPLE_SIZE(name) > room) {
+			if (index > names_next) break;
+			APP_LOG(APP_LOG_LEVEL_WARNING,
+			    "outbox: event name %" PRIu8 " too long to send",
+			    index);
+			name = "";
+		}
+		room -= CSTRING_TUPLE_SIZE(name);
+		dict_result = dict_write_cstring(iter,
+		    KEY_EVENT_NAMES + 1 + index, name);
+		index += 1;
+	}
+
+	if (dict_result != DICT_OK) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "outbox: [%d] unable to add event names",
+		    (int)dict_result);
+		return false;
+	}
+
+	msg_result = app_message_outbox_send();
+	if (msg_result) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "outbox: app_message_outbox_send returned %d",
+		    (int)msg_result);
+		return false;
+	}
+
+	link_stats.messages += 1;
+	*sent_end = index;
+	return true;
+}
+
+/* names requested by the phone go before any pulled entry */
+static void
+pull_next(void) {
+	const uint32_t begin = event_log_begin();
+
+	if ((!pull_active && !names_active) || in_flight) return;
+	if (!connection_service_peek_pebble_app_connection()) return;
+
+	if (names_active) {
+		in_flight = send_names(&in_flight_end);
+		if (in_flight && in_flight_end >= event_names.count)
+			names_active = false;
+		return;
+	}
+
+	if (pull.seq < begin) pull.seq = begin;
+	in_flight = send_records(pull.seq, pull.end, &pull, &in_flight_end);
+	if (in_flight && in_flight_end >= pull.end) pull_active = false;
+}
+
+/* streams already sent entries from seq whose time is within [from, to) */
+void
+outbox_pull(uint32_t seq, time_t from, time_t to) {
+	pull = (struct pull_state){
+	    .seq = seq,
+	    .end = event_log_sent(),
+	    .from = from,
+	    .to = to,
+	};
+	pull_active = true;
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "outbox: pull requested from %" PRIu32 " to %" PRIu32,
+	    seq, pull.end);
+	pull_next();
+}
+
+/* sends the event names and prefixes, for a phone without them */
+void
+outbox_send_names(void) {
+	names_next = 0;
+	names_active = true;
+	APP_LOG(APP_LOG_LEVEL_INFO, "outbox: %" PRIu8 " event names requested",
+	    event_names.count);
+	pull_next();
+}
+
+void
+outbox_flush(void) {
+	const uint32_t begin = event_log_begin();
+	const uint32_t end = event_log_end();
+	uint32_t seq = event_log_sent();
+
+	if (transport != TRANSPORT_BATCHED || in_flight || seq >= end) return;
+	if (!connection_service_peek_pebble_app_connection()) return;
+
+	if (seq < begin) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "outbox: %" PRIu32 " records evicted before being sent",
+		    begin - seq);
+		seq = begin;
+	}
+
+	in_flight = send_records(seq, end, 0, &in_flight_end);
+}
+
+static void
+retry_flush(void *data) {
+	(void)data;
+	retry_timer = 0;
+	outbox_flush();
+	pull_next();
+}
+
+static void
+outbox_sent_handler(DictionaryIterator *iterator, void *context) {
+	(void)context;
+	if (!in_flight) return;
+
+	if (dict_find(iterator, KEY_RECORD_BATCH)) {
+		in_flight = false;
+		event_log_mark_sent(in_flight_end);
+	} else if (dict_find(iterator, KEY_PULL_BATCH)) {
+		in_flight = false;
+		pull.seq = in_flight_end;
+	} else if (dict_find(iterator, KEY_EVENT_NAMES)) {
+		in_flight = false;
+		names_next = in_flight_end;
+	} else {
+		return;
+	}
+
+	link_stats.acked += 1;
+	outbox_flush();
+	pull_next();
+}
+
+static void
+outbox_failed_handler(DictionaryIterator *iterator, AppMessageResult reason,
+    void *context) {
+	(void)context;
+	if (!in_flight) return;
+
+	if (dict_find(iterator, KEY_PULL_BATCH)) {
+		pull_active = true;
+	} else if (dict_find(iterator, KEY_EVENT_NAMES)) {
+		names_active = true;
+	} else if (!dict_find(iterator, KEY_RECORD_BATCH)) {
+		return;
+	}
+
+	APP_LOG(APP_LOG_LEVEL_WARNING,
+	    "outbox: batch failed with %d, retrying later", (int)reason);
+	link_stats.failed += 1;
+	if (reason == APP_MSG_BUSY) link_stats.busy += 1;
+	in_flight = false;
+	schedule_retry(reason == APP_MSG_BUSY
+	    ? BUSY_RETRY_DELAY_MS : RETRY_DELAY_MS);
+}
+
+static void
+connection_handler(bool connected) {
+	if (connected) {
+		outbox_flush();
+		pull_next();
+	}
+}
+
+void
+outbox_init(void) {
+	app_message_register_outbox_sent(&outbox_sent_handler);
+	app_message_register_outbox_failed(&outbox_failed_handler);
+	connection_service_subscribe((ConnectionHandlers) {
+	    .pebble_app_connection_handler = &connection_handler,
+	});
+}
+
+void
+outbox_deinit(void) {
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "outbox: %u messages (%" PRIu32 " records, %" PRIu32 " bytes), "
+	    "%u acked, %u failed, %u busy, %u records dropped",
+	    link_stats.messages, link_stats.records, link_stats.bytes,
+	    link_stats.acked, link_stats.failed, link_stats.busy,
+	    link_stats.dropped);
+	connection_service_unsubscribe();
+	if (retry_timer) app_timer_cancel(retry_timer);
+	retry_timer = 0;
+}
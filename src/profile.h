@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <pebble.h>
+
+/*
+ * Per-platform sizing of RAM buffers and caches, selected at build time.
+ * Aplite has about 24 KB of application heap, the other platforms have
+ * several times more, so buffers and caches are scaled accordingly.
+ * Nothing here may end up in persistent storage or in event ids: those
+ * sizes are defined in global.h, the same for every platform, and their
+ * total is checked against the storage budget in life-log.c.
+ */
+
+#if defined(PBL_PLATFORM_APLITE)
+
+#define PROFILE_NAME		"aplite"
+#define PROFILE_INBOX_SIZE	4096
+#define PROFILE_OUTBOX_SIZE	256
+#define PROFILE_BATCH_RECORDS	16
+#define PROFILE_LOG_CACHE	1
+#define PROFILE_TITLE_LENGTH	96
+
+#else
+
+#define PROFILE_NAME		"default"
+#define PROFILE_INBOX_SIZE	8192
+#define PROFILE_OUTBOX_SIZE	512
+#define PROFILE_BATCH_RECORDS	32
+#define PROFILE_LOG_CACHE	3
+#define PROFILE_TITLE_LENGTH	128
+
+#endif
+
+#define PROFILE_STRINGIFY_(x) #x
+#define PROFILE_STRINGIFY(x) PROFILE_STRINGIFY_(x)
+
+#define PROFILE_SUMMARY "profile " PROFILE_NAME \
+	": inbox " PROFILE_STRINGIFY(PROFILE_INBOX_SIZE) \
+	", outbox " PROFILE_STRINGIFY(PROFILE_OUTBOX_SIZE) \
+	", batch " PROFILE_STRINGIFY(PROFILE_BATCH_RECORDS) \
+	", log cache " PROFILE_STRINGIFY(PROFILE_LOG_CACHE) \
+	", title " PROFILE_STRINGIFY(PROFILE_TITLE_LENGTH)
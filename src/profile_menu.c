@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <pebble.h>
+
+#include "global.h"
+
+static Window *window;
+static MenuLayer *menu_layer;
+
+static uint16_t
+get_num_rows(MenuLayer *menu_layer, uint16_t section_index, void *context) {
+	(void)menu_layer;
+	(void)section_index;
+	(void)context;
+	return 1 + event_profile_count();
+}
+
+static void
+draw_row(GContext *ctx, const Layer *cell_layer, MenuIndex *cell_index,
+    void *context) {
+	(void)context;
+	menu_cell_basic_draw(ctx, cell_layer,
+	    event_profile_name(cell_index->row),
+	    cell_index->row == event_profile_active() ? "Active" : 0, 0);
+}
+
+static void
+select_click(MenuLayer *menu_layer, MenuIndex *cell_index, void *context) {
+	(void)menu_layer;
+	(void)context;
+	event_profile_activate(cell_index->row);
+	update_main_menu();
+	window_stack_remove(window, true);
+}
+
+static void
+window_load(Window *window) {
+	Layer *window_layer = window_get_root_layer(window);
+	GRect bounds = layer_get_bounds(window_layer);
+
+	menu_layer = menu_layer_create(bounds);
+	menu_layer_set_callbacks(menu_layer, 0, (MenuLayerCallbacks) {
+	    .get_num_rows = &get_num_rows,
+	    .draw_row = &draw_row,
+	    .select_click = &select_click,
+	});
+	menu_layer_set_selected_index(menu_layer,
+	    (MenuIndex){ .section = 0, .row = event_profile_active() },
+	    MenuRowAlignCenter, false);
+	menu_layer_set_click_config_onto_window(menu_layer, window);
+	layer_add_child(window_layer, menu_layer_get_layer(menu_layer));
+	metrics_sample_heap();
+}
+
+static void
+window_unload(Window *window) {
+	menu_layer_destroy(menu_layer);
+	menu_layer = 0;
+}
+
+void
+push_profile_menu(void) {
+	if (!window) {
+		window = window_create();
+		window_set_window_handlers(window, (WindowHandlers) {
+		    .load = &window_load,
+		    .unload = &window_unload,
+		});
+	}
+	window_stack_push(window, true);
+}
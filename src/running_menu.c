@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pebble.h>
+
+#include "global.h"
+
+static const char *no_running_message = "Nothing running.";
+
+static Window *window;
+static MenuLayer *menu_layer;
+static uint8_t row_index[STRLIST_MAX_SIZE];
+static uint8_t row_count = 0;
+
+static void
+rebuild_menu(void) {
+	uint8_t running[STRLIST_MAX_SIZE];
+	const uint8_t count = event_menu_running(running, STRLIST_MAX_SIZE);
+
+	row_count = 0;
+	for (uint8_t i = 0; i < count; i += 1) {
+		if (running[i] >= event_names.count
+		    || !long_event_id[running[i]])
+			continue;
+		row_index[row_count++] = running[i];
+	}
+}
+
+static uint16_t
+get_num_rows(MenuLayer *menu_layer, uint16_t section_index, void *context) {
+	(void)menu_layer;
+	(void)section_index;
+	(void)context;
+	return row_count ? row_count : 1;
+}
+
+static void
+draw_row(GContext *ctx, const Layer *cell_layer, MenuIndex *cell_index,
+    void *context) {
+	const time_t now = time(0);
+	char subtitle[32];
+	const char *name;
+	uint8_t index;
+	time_t since;
+	uint32_t minutes;
+
+	(void)context;
+
+	if (!row_count || cell_index->row >= row_count) {
+		menu_cell_basic_draw(ctx, cell_layer,
+		    no_running_message, 0, 0);
+		return;
+	}
+
+	index = row_index[cell_index->row];
+	name = STRLIST_UNSAFE_ITEM(event_names, index);
+	since = event_log_running_since(index);
+
+	if (!since || now < since) {
+		strncpy(subtitle, "since unknown", sizeof subtitle);
+	} else if ((minutes = (now - since) / 60) >= 24 * 60) {
+		snprintf(subtitle, sizeof subtitle,
+		    "%" PRIu32 "d %" PRIu32 ":%02" PRIu32 " elapsed",
+		    minutes / (24 * 60), minutes / 60 % 24, minutes % 60);
+	} else {
+		snprintf(subtitle, sizeof subtitle,
+		    "%" PRIu32 ":%02" PRIu32 " elapsed",
+		    minutes / 60, minutes % 60);
+	}
+
+	menu_cell_basic_draw(ctx, cell_layer,
+	    name[0] == '+' ? name + 1 : name, subtitle, 0);
+}
+
+/* only elapsed times change, so cells are redrawn without a rebuild */
+static void
+tick_handler(struct tm *tick_time, TimeUnits units_changed) {
+	(void)tick_time;
+	(void)units_changed;
+	if (menu_layer) layer_mark_dirty(menu_layer_get_layer(menu_layer));
+}
+
+static void
+window_load(Window *window) {
+	Layer *window_layer = window_get_root_layer(window);
+	GRect bounds = layer_get_bounds(window_layer);
+
+	menu_layer = menu_layer_create(bounds);
+	menu_layer_set_callbacks(menu_layer, 0, (MenuLayerCallbacks) {
+	    .get_num_rows = &get_num_rows,
+	    .draw_row = &draw_row,
+	});
+	menu_layer_set_click_config_onto_window(menu_layer, window);
+	layer_add_child(window_layer, menu_layer_get_layer(menu_layer));
+	metrics_sample_heap();
+}
+
+static void
+window_appear(Window *window) {
+	(void)window;
+	rebuild_menu();
+	menu_layer_reload_data(menu_layer);
+	tick_timer_service_subscribe(MINUTE_UNIT, &tick_handler);
+}
+
+static void
+window_disappear(Window *window) {
+	(void)window;
+	tick_timer_service_unsubscribe();
+}
+
+static void
+window_unload(Window *window) {
+	menu_layer_destroy(menu_layer);
+	menu_layer = 0;
+}
+
+void
+push_running_menu(void) {
+	if (!window) {
+		window = window_create();
+		window_set_window_handlers(window, (WindowHandlers) {
+		    .load = &window_load,
+		    .appear = &window_appear,
+		    .disappear = &window_disappear,
+		    .unload = &window_unload,
+		});
+	}
+	window_stack_push(window, true);
+}
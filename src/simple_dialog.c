@@ -111,3 +111,8 @@ push_simple_dialog(const char *message, bool is_static) {
 
 	window_stack_push(dialog_window, true);
 }
+
+void
+dismiss_simple_dialog(bool animated) {
+	if (dialog_window) window_stack_remove(dialog_window, animated);
+}
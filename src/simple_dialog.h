@@ -18,3 +18,6 @@
 
 void
 push_simple_dialog(const char *message, bool is_static);
+
+void
+dismiss_simple_dialog(bool animated);
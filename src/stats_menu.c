@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <pebble.h>
+
+#include "global.h"
+
+static const char *no_event_message = "No event configured.";
+
+static Window *window;
+static MenuLayer *menu_layer;
+static uint8_t row_index[STRLIST_MAX_SIZE];
+static uint16_t row_day_count[STRLIST_MAX_SIZE];
+static uint16_t row_week_count[STRLIST_MAX_SIZE];
+static uint16_t row_month_count[STRLIST_MAX_SIZE];
+static uint8_t row_count = 0;
+
+/* counts include rollups, so they are computed once per load */
+static void
+rebuild_menu(void) {
+	const time_t now = time(0);
+	const struct tm *tm = localtime(&now);
+	const time_t today = now
+	    - (tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec);
+
+	row_count = 0;
+
+	for (uint8_t i = 0; i < event_names.count; i += 1) {
+		if (STRLIST_UNSAFE_ITEM(event_names, i)[0] == '-') continue;
+		row_day_count[row_count] = event_log_count(i,
+		    today, now + 1, 0);
+		row_week_count[row_count] = event_log_count(i,
+		    today - 6 * 86400, now + 1, 0);
+		row_month_count[row_count] = event_log_count(i,
+		    now - 30 * 86400, now + 1, 0);
+		row_index[row_count++] = i;
+	}
+}
+
+static uint16_t
+get_num_rows(MenuLayer *menu_layer, uint16_t section_index, void *context) {
+	(void)menu_layer;
+	(void)section_index;
+	(void)context;
+	return row_count ? row_count : 1;
+}
+
+static void
+draw_row(GContext *ctx, const Layer *cell_layer, MenuIndex *cell_index,
+    void *context) {
+	const time_t now = time(0);
+	char subtitle[32];
+	const char *name;
+	uint8_t index;
+	time_t since;
+
+	(void)context;
+
+	if (!row_count || cell_index->row >= row_count) {
+		menu_cell_basic_draw(ctx, cell_layer, no_event_message, 0, 0);
+		return;
+	}
+
+	index = row_index[cell_index->row];
+	name = STRLIST_UNSAFE_ITEM(event_names, index);
+	since = event_log_running_since(index);
+
+	if (name[0] == '+' && since && now >= since) {
+		uint32_t minutes = (now - since) / 60;
+		snprintf(subtitle, sizeof subtitle,
+		    "running %" PRIu32 ":%02" PRIu32,
+		    minutes / 60, minutes % 60);
+	} else if (name[0] == '+') {
+		uint32_t minutes = event_stats_total_duration(index) / 60;
+		snprintf(subtitle, sizeof subtitle,
+		    "%" PRIu16 " today, %" PRIu32 "h%02" PRIu32 " total",
+		    row_day_count[cell_index->row],
+		    minutes / 60, minutes % 60);
+	} else {
+		snprintf(subtitle, sizeof subtitle,
+		    "%" PRIu16 " today, %" PRIu16 " in 7d, %" PRIu16 " in 30d",
+		    row_day_count[cell_index->row],
+		    row_week_count[cell_index->row],
+		    row_month_count[cell_index->row]);
+	}
+
+	menu_cell_basic_draw(ctx, cell_layer,
+	    name[0] == '+' ? name + 1 : name, subtitle, 0);
+}
+
+static void
+window_load(Window *window) {
+	Layer *window_layer = window_get_root_layer(window);
+	GRect bounds = layer_get_bounds(window_layer);
+
+	rebuild_menu();
+
+	menu_layer = menu_layer_create(bounds);
+	menu_layer_set_callbacks(menu_layer, 0, (MenuLayerCallbacks) {
+	    .get_num_rows = &get_num_rows,
+	    .draw_row = &draw_row,
+	});
+	menu_layer_set_click_config_onto_window(menu_layer, window);
+	layer_add_child(window_layer, menu_layer_get_layer(menu_layer));
+	metrics_sample_heap();
+}
+
+static void
+window_unload(Window *window) {
+	menu_layer_destroy(menu_layer);
+	menu_layer = 0;
+}
+
+void
+push_stats_menu(void) {
+	if (!window) {
+		window = window_create();
+		window_set_window_handlers(window, (WindowHandlers) {
+		    .load = &window_load,
+		    .unload = &window_unload,
+		});
+	}
+	window_stack_push(window, true);
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include <pebble.h>
+
+#include "storage.h"
+
+#define STORAGE_TRACKED_KEYS 32
+
+struct key_stats {
+	uint32_t key;
+	uint16_t writes;
+	uint32_t bytes;
+};
+
+struct __attribute__((__packed__)) storage_totals {
+	time_t since;
+	uint32_t writes;
+	uint32_t bytes;
+};
+
+_Static_assert(sizeof(struct storage_totals) == STORAGE_TOTALS_SIZE,
+    "STORAGE_TOTALS_SIZE does not match struct storage_totals");
+
+static const struct storage_range *ranges;
+static uint8_t range_count;
+static uint16_t range_used[STORAGE_MAX_RANGES];
+static bool usage_known = false;
+static struct key_stats key_stats[STORAGE_TRACKED_KEYS];
+static uint8_t key_stats_count;
+static uint32_t untracked_writes;
+static uint32_t untracked_bytes;
+
+static void
+account(uint32_t key, size_t size) {
+	unsigned i;
+
+	for (i = 0; i < key_stats_count && key_stats[i].key != key; i += 1);
+
+	if (i >= STORAGE_TRACKED_KEYS) {
+		untracked_writes += 1;
+		untracked_bytes += size;
+		return;
+	}
+
+	if (i == key_stats_count) {
+		key_stats[i].key = key;
+		key_stats_count += 1;
+	}
+
+	key_stats[i].writes += 1;
+	key_stats[i].bytes += size;
+}
+
+/* registers the key ranges, which must neither overlap nor be too many */
+bool
+storage_init(const struct storage_range *new_ranges, uint8_t count) {
+	uint32_t total = 0;
+
+	if (count > STORAGE_MAX_RANGES) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "storage: %u ranges registered, at most %u supported",
+		    (unsigned)count, (unsigned)STORAGE_MAX_RANGES);
+		return false;
+	}
+
+	for (unsigned i = 0; i < count; i += 1) {
+		for (unsigned j = 0; j < i; j += 1) {
+			if (new_ranges[i].first
+			    < new_ranges[j].first + new_ranges[j].count
+			    && new_ranges[j].first
+			    < new_ranges[i].first + new_ranges[i].count) {
+				APP_LOG(APP_LOG_LEVEL_ERROR,
+				    "storage: ranges %s and %s overlap",
+				    new_ranges[i].name, new_ranges[j].name);
+				return false;
+			}
+		}
+		total += new_ranges[i].size;
+	}
+
+	if (total > STORAGE_BUDGET) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "storage: ranges hold up to %" PRIu32 " bytes, over %u",
+		    total, (unsigned)STORAGE_BUDGET);
+		return false;
+	}
+
+	ranges = new_ranges;
+	range_count = count;
+	usage_known = false;
+	return true;
+}
+
+static int
+find_range(uint32_t key) {
+	for (unsigned i = 0; i < range_count; i += 1) {
+		if (key >= ranges[i].first
+		    && key - ranges[i].first < ranges[i].count)
+			return i;
+	}
+
+	return -1;
+}
+
+static uint16_t
+key_size(uint32_t key) {
+	int size = persist_get_size(key);
+	return size > 0 ? size : 0;
+}
+
+/* current usage is measured once, on the first write */
+static void
+measure_usage(void) {
+	for (unsigned i = 0; i < range_count; i += 1) {
+		range_used[i] = 0;
+		for (uint16_t k = 0; k < ranges[i].count; k += 1)
+			range_used[i] += key_size(ranges[i].first + k);
+	}
+	usage_known = true;
+}
+
+uint16_t
+storage_used(void) {
+	uint16_t result = 0;
+
+	if (!usage_known) measure_usage();
+	for (unsigned i = 0; i < range_count; i += 1)
+		result += range_used[i];
+	return result;
+}
+
+/* checks that size bytes can be stored under key within its range */
+static bool
+reserve(uint32_t key, size_t size) {
+	const int range = find_range(key);
+	uint16_t old_size;
+
+	if (range < 0) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "storage: key %" PRIu32 " outside of any range", key);
+		return false;
+	}
+
+	if (!usage_known) measure_usage();
+	old_size = key_size(key);
+
+	/* shrinking a range over its size is how it gets back within it */
+	if (size > old_size
+	    && range_used[range] - old_size + size > ranges[range].size) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "storage: no room for %zu bytes under key %" PRIu32
+		    " in %s (%u/%u bytes used)",
+		    size, key, ranges[range].name,
+		    (unsigned)range_used[range], (unsigned)ranges[range].size);
+		return false;
+	}
+
+	range_used[range] += size - old_size;
+	account(key, size);
+	return true;
+}
+
+int
+storage_write_data(uint32_t key, const void *data, size_t size) {
+	if (!reserve(key, size)) return E_OUT_OF_STORAGE;
+	return persist_write_data(key, data, size);
+}
+
+status_t
+storage_write_int(uint32_t key, int32_t value) {
+	if (!reserve(key, sizeof value)) return E_OUT_OF_STORAGE;
+	return persist_write_int(key, value);
+}
+
+int
+storage_write_string(uint32_t key, const char *cstring) {
+	if (!reserve(key, strlen(cstring) + 1)) return E_OUT_OF_STORAGE;
+	return persist_write_string(key, cstring);
+}
+
+status_t
+storage_delete(uint32_t key) {
+	if (!reserve(key, 0)) return E_RANGE;
+	return persist_delete(key);
+}
+
+/* log per-key counters of this session and update cumulative totals */
+void
+storage_report(uint32_t totals_key) {
+	struct storage_totals totals;
+	uint32_t writes = untracked_writes;
+	uint32_t bytes = untracked_bytes;
+	time_t now = time(0);
+	uint32_t per_day;
+	int ret;
+
+	for (unsigned i = 0; i < key_stats_count; i += 1) {
+		APP_LOG(APP_LOG_LEVEL_DEBUG,
+		    "key %" PRIu32 ": %u writes, %" PRIu32 " bytes",
+		    key_stats[i].key, (unsigned)key_stats[i].writes,
+		    key_stats[i].bytes);
+		writes += key_stats[i].writes;
+		bytes += key_stats[i].bytes;
+	}
+
+	if (untracked_writes) {
+		APP_LOG(APP_LOG_LEVEL_DEBUG,
+		    "other keys: %" PRIu32 " writes, %" PRIu32 " bytes",
+		    untracked_writes, untracked_bytes);
+	}
+
+	for (unsigned i = 0; usage_known && i < range_count; i += 1) {
+		APP_LOG(APP_LOG_LEVEL_DEBUG,
+		    "%s: %u/%u bytes stored", ranges[i].name,
+		    (unsigned)range_used[i], (unsigned)ranges[i].size);
+	}
+	if (usage_known) {
+		APP_LOG(APP_LOG_LEVEL_INFO,
+		    "Storage: %u/%u bytes used",
+		    (unsigned)storage_used(), (unsigned)STORAGE_BUDGET);
+	}
+
+	if (!writes) return;
+
+	ret = persist_read_data(totals_key, &totals, sizeof totals);
+	if (ret != sizeof totals || totals.since <= 0 || totals.since > now) {
+		totals.since = now;
+		totals.writes = 0;
+		totals.bytes = 0;
+	}
+
+	totals.writes += writes + 1;
+	totals.bytes += bytes + sizeof totals;
+	storage_write_data(totals_key, &totals, sizeof totals);
+
+	per_day = (now - totals.since < 86400) ? totals.bytes
+	    : (uint32_t)((uint64_t)totals.bytes * 86400
+	      / (uint32_t)(now - totals.since));
+
+	APP_LOG(APP_LOG_LEVEL_INFO,
+	    "Session wrote %" PRIu32 " bytes in %" PRIu32 " writes, "
+	    "%" PRIu32 " bytes per day since %" PRIu32,
+	    bytes, writes, per_day, (uint32_t)totals.since);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <pebble.h>
+
+/*
+ * Wrappers around persist_write_* and persist_delete. Every key belongs
+ * to a range registered with storage_init(), writes outside of them are
+ * refused, and each range declares the most bytes it may hold, their sum
+ * fitting the persistent storage budget of the application, so that a
+ * write growing a range past its size is a bug refused with an error
+ * rather than a shortage. The number of writes and bytes hitting each
+ * key are also counted, so that persistence strategies can be compared
+ * from the logs of a real watch.
+ */
+
+#define STORAGE_BUDGET 4096
+#define STORAGE_MAX_RANGES 24
+#define STORAGE_TOTALS_SIZE 12
+
+struct storage_range {
+	const char *name;
+	uint32_t first;
+	uint16_t count;
+	uint16_t size;		/* most bytes held, 0 for keys only deleted */
+};
+
+bool
+storage_init(const struct storage_range *ranges, uint8_t count);
+
+int
+storage_write_data(uint32_t key, const void *data, size_t size);
+
+status_t
+storage_write_int(uint32_t key, int32_t value);
+
+int
+storage_write_string(uint32_t key, const char *cstring);
+
+status_t
+storage_delete(uint32_t key);
+
+uint16_t
+storage_used(void);
+
+void
+storage_report(uint32_t totals_key);
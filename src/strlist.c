@@ -16,17 +16,16 @@
 
 #include <inttypes.h>
 
+#include "storage.h"
 #include "strlist.h"
 
-#define REALLOC_FASTER_THAN_FIND
-
 bool
 strlist_append(struct string_list *list, char *data) {
 	char *new_data;
 	size_t length;
 
 	if (!list || !data) return false;
-	if (list->count + 1 >= STRLIST_MAX_SIZE) return false;
+	if (list->count >= STRLIST_MAX_COUNT) return false;
 
 	if (!data[0]) {
 		if (!list->data || !list->size) {
@@ -72,6 +71,12 @@ strlist_load(struct string_list *list, uint32_t first_key) {
 	char *data;
 	unsigned page_count;
 
+	/* a missing size key, as after eviction, is not an empty list */
+	if (!persist_exists(first_key)) {
+		strlist_reset(list);
+		return false;
+	}
+
 	size = persist_read_int(first_key);
 	if (size <= 0) {
 		strlist_reset(list);
@@ -155,18 +160,22 @@ strlist_reset(struct string_list *list) {
 }
 
 
+/*
+ * Pages are written before the size key, which never announces pages
+ * that were not written, and pages left past the new size are deleted
+ * once it is stored.
+ */
 bool
 strlist_store(struct string_list *list, uint32_t first_key) {
 	unsigned page_count = (list->size + PERSIST_DATA_MAX_LENGTH - 1)
 	    / PERSIST_DATA_MAX_LENGTH;
 	int ret;
-	persist_write_int(first_key, list->size);
 
 	for (unsigned page = 0; page < page_count; page += 1) {
 		uint16_t chunk_size = (page == page_count - 1)
 		    ? (list->size - 1) % PERSIST_DATA_MAX_LENGTH + 1
 		    : PERSIST_DATA_MAX_LENGTH;
-		ret = persist_write_data(first_key + 1 + page,
+		ret = storage_write_data(first_key + 1 + page,
 		    list->data + page * PERSIST_DATA_MAX_LENGTH,
 		    chunk_size);
 		if (ret <= 0 || (uint16_t)ret != chunk_size) {
@@ -179,27 +188,63 @@ strlist_store(struct string_list *list, uint32_t first_key) {
 		}
 	}
 
+	ret = storage_write_int(first_key, list->size);
+	if (ret < 0) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Error %d while writing string list size", ret);
+		return false;
+	}
+
+	for (unsigned page = page_count;
+	    persist_exists(first_key + 1 + page); page += 1)
+		storage_delete(first_key + 1 + page);
+
 	return true;
 }
 
 
-#ifdef REALLOC_FASTER_THAN_FIND
+/* builds the list in a single allocation, skipping null items */
 bool
-strlist_set_from_dict(struct string_list *list, DictionaryIterator *iterator,
-    uint32_t first_key, uint8_t count) {
-	if (!strlist_reset(list)) return false;
+strlist_set(struct string_list *list, const char * const *items,
+    uint8_t count) {
+	size_t size = 1;
+	uint16_t position = 1;
+	char *data;
+
+	if (!list) return false;
+	if (count > STRLIST_MAX_COUNT) count = STRLIST_MAX_COUNT;
 
-	if (count >= STRLIST_MAX_SIZE) {
-		count = STRLIST_MAX_SIZE - 1;
+	for (uint8_t i = 0; i < count; i += 1) {
+		if (items[i] && items[i][0]) size += strlen(items[i]) + 1;
 	}
 
-	for (uint32_t i = 0; i < count; i += 1) {
-		Tuple *tuple = dict_find(iterator, first_key + i);
-		if (!tuple || tuple->type != TUPLE_CSTRING) continue;
+	if (size > UINT16_MAX) return false;
+	data = malloc(size);
+	if (!data) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "Unable to allocate %zu bytes for string list", size);
+		return false;
+	}
 
-		if (!strlist_append(list, tuple->value->cstring))
-			return false;
+	data[0] = 0;
+	list->count = 0;
+	for (uint8_t i = 0; i < count; i += 1) {
+		size_t length;
+
+		if (!items[i]) continue;
+		if (!items[i][0]) {
+			list->offsets[list->count++] = 0;
+			continue;
+		}
+
+		length = strlen(items[i]) + 1;
+		memcpy(data + position, items[i], length);
+		list->offsets[list->count++] = position;
+		position += length;
 	}
+
+	free(list->data);
+	list->data = data;
+	list->size = size;
 	return true;
 }
-#endif
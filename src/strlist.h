@@ -22,6 +22,9 @@
 
 #define STRLIST_MAX_SIZE 83
 
+/* most items a list accepts, from strlist_set() or strlist_append() */
+#define STRLIST_MAX_COUNT (STRLIST_MAX_SIZE - 1)
+
 struct string_list {
 	char		*data;
 	uint16_t	offsets[STRLIST_MAX_SIZE];
@@ -36,9 +39,8 @@ struct string_list {
 	((i) < (list).count ? STRLIST_UNSAFE_ITEM(list, i) : ((char *)0))
 
 bool
-strlist_set_from_dict(struct string_list *list, DictionaryIterator *iterator,
-    uint32_t first_key, uint8_t count);
-
+strlist_set(struct string_list *list, const char * const *items,
+    uint8_t count);
 
 bool
 strlist_append(struct string_list *list, char *data);
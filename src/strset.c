@@ -86,6 +86,30 @@ strset_include(struct string_list *set, const char *data, size_t size) {
 }
 
 
+/* strset_include() into data allocated with room for the new item */
+uint8_t
+strset_include_reserved(struct string_list *set, const char *data,
+    size_t size) {
+	uint8_t idx;
+
+	if (search (set, data, size, &idx)) {
+		return idx;
+	}
+
+	if (set->count >= STRLIST_MAX_COUNT) return INVALID_INDEX;
+
+	memcpy(set->data + set->size, data, size);
+	set->data[set->size + size] = 0;
+	memmove(set->offsets + idx + 1, set->offsets + idx,
+	    (set->count - idx) * sizeof *set->offsets);
+	set->offsets[idx] = set->size;
+	set->size += size + 1;
+	set->count += 1;
+
+	return idx;
+}
+
+
 uint8_t
 strset_search(const struct string_list *set, const char *data, size_t size) {
 	uint8_t idx;
@@ -23,5 +23,10 @@
 uint8_t
 strset_include(struct string_list *set, const char *data, size_t size);
 
+uint8_t
+strset_include_reserved(struct string_list *set, const char *data,
+    size_t size);
+
 uint8_t
 strset_search(const struct string_list *set, const char *data, size_t size);
+
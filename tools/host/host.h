@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pebble.h"
+
+/*
+ * Controls of the host stand-in for the Pebble SDK, used by the tools to
+ * drive the watch modules: a virtual clock running the app timers, an
+ * instrumented persistent storage, heap accounting and both ends of the
+ * AppMessage link.
+ */
+
+/* the watch entry point, renamed when building src/life-log.c */
+int
+life_log_main(void);
+
+/* virtual clock, app timers only fire from host_clock_advance() */
+
+void
+host_clock_set(time_t now, uint16_t ms);
+
+uint64_t
+host_clock_ms(void);
+
+void
+host_clock_advance(uint32_t ms);
+
+bool
+host_timer_next(uint64_t *when_ms);
+
+void
+host_utc_offset_set(int32_t seconds);
+
+/* app lifecycle, app_event_loop() runs the given function then exits */
+
+void
+host_launch_set(AppLaunchReason reason, uint32_t args);
+
+void
+host_run_set(void (*run)(void));
+
+void
+host_log_set(FILE *out, uint8_t max_level);
+
+/* draws the visible rows of the menus of the top window */
+void
+host_render(void);
+
+/* persistent storage, optionally shared with forked sessions */
+
+struct host_key_stats {
+	uint32_t key;
+	int16_t size;		/* -1 once deleted */
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t deletes;
+	uint64_t bytes;
+};
+
+struct host_persist_totals {
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t deletes;
+	uint64_t bytes;
+	uint32_t refused;
+};
+
+bool
+host_persist_setup(bool shared, uint32_t limit);
+
+uint32_t
+host_persist_used(void);
+
+unsigned
+host_persist_stats(struct host_key_stats *stats, unsigned max);
+
+void
+host_persist_totals(struct host_persist_totals *totals);
+
+/* heap of the watch modules, allocations failing over the limit */
+
+void
+host_heap_setup(size_t limit);
+
+size_t
+host_heap_peak(void);
+
+void
+host_heap_reset_peak(void);
+
+/*
+ * AppMessage link. The handler receives each message the watch sends and
+ * returns the result of app_message_outbox_send(). The message then stays
+ * in flight, with the outbox busy, until it is acknowledged or failed.
+ */
+
+typedef AppMessageResult (*host_outbox_handler)(const uint8_t *data,
+    uint16_t size, void *context);
+
+void
+host_outbox_set_handler(host_outbox_handler handler, void *context);
+
+/* makes app_message_outbox_begin() report the outbox as busy */
+void
+host_outbox_set_busy(bool busy);
+
+bool
+host_outbox_in_flight(void);
+
+void
+host_outbox_sent(void);
+
+void
+host_outbox_failed(AppMessageResult reason);
+
+AppMessageResult
+host_inbox_deliver(const uint8_t *data, uint16_t size);
+
+void
+host_connection_set(bool connected);
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Calendar conversions of the host C library, kept apart from pebble.h
+ * and its 32-bit time_t. The broken-down time mirrors struct tm there.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+struct pbl_tm {
+	int tm_sec;
+	int tm_min;
+	int tm_hour;
+	int tm_mday;
+	int tm_mon;
+	int tm_year;
+	int tm_wday;
+	int tm_yday;
+	int tm_isdst;
+	int tm_gmtoff;
+	const char *tm_zone;
+};
+
+void
+host_time_split(int64_t t, int32_t offset, struct pbl_tm *out);
+
+int64_t
+host_time_join(struct pbl_tm *tm);
+
+size_t
+host_time_format(char *s, size_t max, const char *format,
+    const struct pbl_tm *tm);
+
+static void
+to_host(struct tm *out, const struct pbl_tm *tm) {
+	memset(out, 0, sizeof *out);
+	out->tm_sec = tm->tm_sec;
+	out->tm_min = tm->tm_min;
+	out->tm_hour = tm->tm_hour;
+	out->tm_mday = tm->tm_mday;
+	out->tm_mon = tm->tm_mon;
+	out->tm_year = tm->tm_year;
+	out->tm_wday = tm->tm_wday;
+	out->tm_yday = tm->tm_yday;
+	out->tm_isdst = tm->tm_isdst;
+}
+
+static void
+from_host(struct pbl_tm *out, const struct tm *tm) {
+	out->tm_sec = tm->tm_sec;
+	out->tm_min = tm->tm_min;
+	out->tm_hour = tm->tm_hour;
+	out->tm_mday = tm->tm_mday;
+	out->tm_mon = tm->tm_mon;
+	out->tm_year = tm->tm_year;
+	out->tm_wday = tm->tm_wday;
+	out->tm_yday = tm->tm_yday;
+	out->tm_isdst = 0;
+}
+
+/* broken-down time of t shifted by offset seconds, in a fixed time zone */
+void
+host_time_split(int64_t t, int32_t offset, struct pbl_tm *out) {
+	time_t shifted = (time_t)(t + offset);
+	struct tm tm;
+
+	gmtime_r(&shifted, &tm);
+	from_host(out, &tm);
+	out->tm_gmtoff = offset;
+	out->tm_zone = offset ? "LOC" : "UTC";
+}
+
+/* normalizes tm and returns its time, without any offset */
+int64_t
+host_time_join(struct pbl_tm *tm) {
+	struct tm host;
+	time_t result;
+
+	to_host(&host, tm);
+	result = timegm(&host);
+	from_host(tm, &host);
+	return result;
+}
+
+size_t
+host_time_format(char *s, size_t max, const char *format,
+    const struct pbl_tm *tm) {
+	struct tm host;
+
+	to_host(&host, tm);
+	return strftime(s, max, format, &host);
+}
@@ -0,0 +1,1299 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+
+#include "host.h"
+
+/* the stand-in itself allocates from the host, see pbl_malloc() */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+void
+host_time_split(int64_t t, int32_t offset, struct tm *out);
+
+int64_t
+host_time_join(struct tm *tm);
+
+size_t
+host_time_format(char *s, size_t max, const char *format,
+    const struct tm *tm);
+
+/*************
+ * LOGGING
+ *************/
+
+static FILE *log_out;
+static uint8_t log_level = APP_LOG_LEVEL_WARNING;
+
+void
+host_log_set(FILE *out, uint8_t max_level) {
+	log_out = out;
+	log_level = max_level;
+}
+
+void
+app_log(uint8_t level, const char *src_filename, int src_line_number,
+    const char *fmt, ...) {
+	const char *base = strrchr(src_filename, '/');
+	FILE *out = log_out ? log_out : stderr;
+	va_list ap;
+
+	if (level > log_level) return;
+
+	fprintf(out, "[%s:%d] ", base ? base + 1 : src_filename,
+	    src_line_number);
+	va_start(ap, fmt);
+	vfprintf(out, fmt, ap);
+	va_end(ap);
+	fputc('\n', out);
+}
+
+/*************
+ * CLOCK AND TIMERS
+ *************/
+
+struct AppTimer {
+	uint64_t due;
+	uint64_t order;
+	AppTimerCallback callback;
+	void *data;
+	struct AppTimer *next;
+};
+
+static uint64_t clock_ms;
+static uint64_t timer_order;
+static int32_t utc_offset;
+static struct AppTimer *timers;
+static struct tm tm_buffer;
+
+static TickHandler tick_handler;
+static TimeUnits tick_units;
+
+void
+host_clock_set(time_t now, uint16_t ms) {
+	clock_ms = (uint64_t)now * 1000 + ms;
+}
+
+uint64_t
+host_clock_ms(void) {
+	return clock_ms;
+}
+
+void
+host_utc_offset_set(int32_t seconds) {
+	utc_offset = seconds;
+}
+
+time_t
+pbl_time(time_t *tloc) {
+	time_t result = clock_ms / 1000;
+
+	if (tloc) *tloc = result;
+	return result;
+}
+
+uint16_t
+time_ms(time_t *tloc, uint16_t *out_ms) {
+	const uint16_t ms = clock_ms % 1000;
+
+	pbl_time(tloc);
+	if (out_ms) *out_ms = ms;
+	return ms;
+}
+
+struct tm *
+pbl_localtime(const time_t *timep) {
+	host_time_split(*timep, utc_offset, &tm_buffer);
+	return &tm_buffer;
+}
+
+struct tm *
+pbl_gmtime(const time_t *timep) {
+	host_time_split(*timep, 0, &tm_buffer);
+	return &tm_buffer;
+}
+
+time_t
+pbl_mktime(struct tm *tm) {
+	const int64_t result = host_time_join(tm) - utc_offset;
+
+	tm->tm_gmtoff = utc_offset;
+	return (time_t)result;
+}
+
+size_t
+pbl_strftime(char *s, size_t max, const char *format, const struct tm *tm) {
+	return host_time_format(s, max, format, tm);
+}
+
+static void
+insert_timer(struct AppTimer *timer) {
+	struct AppTimer **link = &timers;
+
+	while (*link && (*link)->due <= timer->due) link = &(*link)->next;
+	timer->next = *link;
+	*link = timer;
+}
+
+static bool
+unlink_timer(struct AppTimer *timer) {
+	for (struct AppTimer **link = &timers; *link; link = &(*link)->next) {
+		if (*link == timer) {
+			*link = timer->next;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+AppTimer *
+app_timer_register(uint32_t timeout_ms, AppTimerCallback callback,
+    void *callback_data) {
+	struct AppTimer *timer = malloc(sizeof *timer);
+
+	if (!timer) return 0;
+	*timer = (struct AppTimer){
+	    .due = clock_ms + timeout_ms,
+	    .order = timer_order++,
+	    .callback = callback,
+	    .data = callback_data,
+	};
+	insert_timer(timer);
+	return timer;
+}
+
+bool
+app_timer_reschedule(AppTimer *timer, uint32_t new_timeout_ms) {
+	if (!timer || !unlink_timer(timer)) return false;
+	timer->due = clock_ms + new_timeout_ms;
+	insert_timer(timer);
+	return true;
+}
+
+void
+app_timer_cancel(AppTimer *timer) {
+	if (timer && unlink_timer(timer)) free(timer);
+}
+
+bool
+host_timer_next(uint64_t *when_ms) {
+	if (!timers) return false;
+	if (when_ms) *when_ms = timers->due;
+	return true;
+}
+
+void
+tick_timer_service_subscribe(TimeUnits units, TickHandler handler) {
+	tick_units = units;
+	tick_handler = handler;
+}
+
+void
+tick_timer_service_unsubscribe(void) {
+	tick_handler = 0;
+}
+
+/* units whose value differs between the two times */
+static TimeUnits
+changed_units(time_t before, time_t after) {
+	struct tm a, b;
+	TimeUnits result = 0;
+
+	host_time_split(before, utc_offset, &a);
+	host_time_split(after, utc_offset, &b);
+	if (a.tm_sec != b.tm_sec || before != after) result |= SECOND_UNIT;
+	if (after / 60 != before / 60) result |= MINUTE_UNIT;
+	if (a.tm_hour != b.tm_hour || after - before >= 3600)
+		result |= HOUR_UNIT;
+	if (a.tm_yday != b.tm_yday || a.tm_year != b.tm_year)
+		result |= DAY_UNIT;
+	if (a.tm_mon != b.tm_mon || a.tm_year != b.tm_year)
+		result |= MONTH_UNIT;
+	if (a.tm_year != b.tm_year) result |= YEAR_UNIT;
+	return result;
+}
+
+/* runs the timers due within ms, then a single tick for the whole step */
+void
+host_clock_advance(uint32_t ms) {
+	const uint64_t target = clock_ms + ms;
+	const time_t before = clock_ms / 1000;
+	TimeUnits units;
+
+	while (timers && timers->due <= target) {
+		struct AppTimer *timer = timers;
+
+		timers = timer->next;
+		if (timer->due > clock_ms) clock_ms = timer->due;
+		timer->callback(timer->data);
+		free(timer);
+	}
+
+	clock_ms = target;
+	units = changed_units(before, clock_ms / 1000);
+	if (tick_handler && (units & tick_units)) {
+		time_t now = clock_ms / 1000;
+		tick_handler(pbl_localtime(&now), units);
+	}
+}
+
+/*************
+ * HEAP
+ *************/
+
+/* bookkeeping of the watch allocator, counted against the heap */
+#define HEAP_BLOCK_OVERHEAD 8
+
+union heap_header {
+	size_t size;
+	max_align_t align;
+};
+
+#if defined(PBL_PLATFORM_APLITE)
+static size_t heap_limit = 24576;
+#else
+static size_t heap_limit = 65536;
+#endif
+static size_t heap_used;
+static size_t heap_peak;
+
+void
+host_heap_setup(size_t limit) {
+	heap_limit = limit;
+}
+
+size_t
+host_heap_peak(void) {
+	return heap_peak;
+}
+
+void
+host_heap_reset_peak(void) {
+	heap_peak = heap_used;
+}
+
+size_t
+heap_bytes_used(void) {
+	return heap_used;
+}
+
+size_t
+heap_bytes_free(void) {
+	return heap_used < heap_limit ? heap_limit - heap_used : 0;
+}
+
+void *
+pbl_malloc(size_t size) {
+	union heap_header *header;
+
+	if (heap_used + size + HEAP_BLOCK_OVERHEAD > heap_limit) return 0;
+	header = malloc(sizeof *header + size);
+	if (!header) return 0;
+
+	header->size = size;
+	heap_used += size + HEAP_BLOCK_OVERHEAD;
+	if (heap_used > heap_peak) heap_peak = heap_used;
+	return header + 1;
+}
+
+void *
+pbl_calloc(size_t count, size_t size) {
+	void *result;
+
+	if (size && count > SIZE_MAX / size) return 0;
+	result = pbl_malloc(count * size);
+	if (result) memset(result, 0, count * size);
+	return result;
+}
+
+void
+pbl_free(void *ptr) {
+	union heap_header *header = ptr;
+
+	if (!ptr) return;
+	header -= 1;
+	heap_used -= header->size + HEAP_BLOCK_OVERHEAD;
+	free(header);
+}
+
+void *
+pbl_realloc(void *ptr, size_t size) {
+	union heap_header *header = ptr;
+	void *result;
+
+	if (!ptr) return pbl_malloc(size);
+	header -= 1;
+	if (size <= header->size) {
+		heap_used -= header->size - size;
+		header->size = size;
+		return ptr;
+	}
+
+	/* like a block allocator, both blocks exist during the copy */
+	result = pbl_malloc(size);
+	if (!result) return 0;
+	memcpy(result, ptr, header->size);
+	pbl_free(ptr);
+	return result;
+}
+
+/*************
+ * PERSISTENT STORAGE
+ *************/
+
+#define PERSIST_SLOTS 1024
+
+struct persist_slot {
+	struct host_key_stats stats;
+	uint8_t data[PERSIST_DATA_MAX_LENGTH];
+};
+
+struct persist_store {
+	uint32_t limit;
+	uint32_t used;
+	unsigned count;
+	struct host_persist_totals totals;
+	struct persist_slot slots[PERSIST_SLOTS];
+};
+
+static struct persist_store *store;
+
+/* a shared store survives in the parent when sessions run in children */
+bool
+host_persist_setup(bool shared, uint32_t limit) {
+	void *area = mmap(0, sizeof *store, PROT_READ | PROT_WRITE,
+	    (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS, -1, 0);
+
+	if (area == MAP_FAILED) return false;
+	if (store) munmap(store, sizeof *store);
+	store = area;
+	store->limit = limit;
+	return true;
+}
+
+static struct persist_slot *
+find_slot(uint32_t key, bool create) {
+	if (!store) host_persist_setup(false, 4096);
+
+	for (unsigned i = 0; i < store->count; i += 1) {
+		if (store->slots[i].stats.key == key)
+			return &store->slots[i];
+	}
+
+	if (!create || store->count >= PERSIST_SLOTS) return 0;
+	store->slots[store->count].stats = (struct host_key_stats){
+	    .key = key,
+	    .size = -1,
+	};
+	return &store->slots[store->count++];
+}
+
+static struct persist_slot *
+read_slot(uint32_t key) {
+	struct persist_slot *slot = find_slot(key, false);
+
+	if (!slot || slot->stats.size < 0) return 0;
+	slot->stats.reads += 1;
+	store->totals.reads += 1;
+	return slot;
+}
+
+static int
+write_slot(uint32_t key, const void *data, size_t size) {
+	struct persist_slot *slot = find_slot(key, true);
+	uint32_t used;
+
+	if (!slot) return E_OUT_OF_RESOURCES;
+	if (size > PERSIST_DATA_MAX_LENGTH) size = PERSIST_DATA_MAX_LENGTH;
+
+	used = store->used - (slot->stats.size > 0 ? slot->stats.size : 0);
+	if (store->limit && used + size > store->limit) {
+		store->totals.refused += 1;
+		return E_OUT_OF_STORAGE;
+	}
+
+	memcpy(slot->data, data, size);
+	slot->stats.size = size;
+	slot->stats.writes += 1;
+	slot->stats.bytes += size;
+	store->used = used + size;
+	store->totals.writes += 1;
+	store->totals.bytes += size;
+	return size;
+}
+
+uint32_t
+host_persist_used(void) {
+	return store ? store->used : 0;
+}
+
+unsigned
+host_persist_stats(struct host_key_stats *stats, unsigned max) {
+	unsigned count = 0;
+
+	for (unsigned i = 0; store && i < store->count && count < max; i++)
+		stats[count++] = store->slots[i].stats;
+	return count;
+}
+
+void
+host_persist_totals(struct host_persist_totals *totals) {
+	if (store) {
+		*totals = store->totals;
+	} else {
+		*totals = (struct host_persist_totals){ 0 };
+	}
+}
+
+bool
+persist_exists(uint32_t key) {
+	const struct persist_slot *slot = find_slot(key, false);
+
+	return slot && slot->stats.size >= 0;
+}
+
+int
+persist_get_size(uint32_t key) {
+	const struct persist_slot *slot = find_slot(key, false);
+
+	return slot && slot->stats.size >= 0
+	    ? slot->stats.size : E_DOES_NOT_EXIST;
+}
+
+bool
+persist_read_bool(uint32_t key) {
+	const struct persist_slot *slot = read_slot(key);
+
+	return slot && slot->stats.size > 0 && slot->data[0];
+}
+
+int32_t
+persist_read_int(uint32_t key) {
+	const struct persist_slot *slot = read_slot(key);
+	int32_t result = 0;
+
+	if (slot && slot->stats.size >= (int)sizeof result)
+		memcpy(&result, slot->data, sizeof result);
+	return result;
+}
+
+int
+persist_read_data(uint32_t key, void *buffer, size_t buffer_size) {
+	const struct persist_slot *slot = read_slot(key);
+	size_t size;
+
+	if (!slot) return E_DOES_NOT_EXIST;
+	size = (size_t)slot->stats.size < buffer_size
+	    ? (size_t)slot->stats.size : buffer_size;
+	memcpy(buffer, slot->data, size);
+	return size;
+}
+
+int
+persist_read_string(uint32_t key, char *buffer, size_t buffer_size) {
+	const struct persist_slot *slot = read_slot(key);
+	size_t size;
+
+	if (!slot) return E_DOES_NOT_EXIST;
+	if (!buffer_size) return 0;
+	size = (size_t)slot->stats.size < buffer_size
+	    ? (size_t)slot->stats.size : buffer_size;
+	memcpy(buffer, slot->data, size);
+	buffer[size ? size - 1 : 0] = 0;
+	return size;
+}
+
+status_t
+persist_write_bool(uint32_t key, bool value) {
+	const uint8_t byte = value;
+
+	return write_slot(key, &byte, 1);
+}
+
+status_t
+persist_write_int(uint32_t key, int32_t value) {
+	return write_slot(key, &value, sizeof value);
+}
+
+int
+persist_write_data(uint32_t key, const void *data, size_t size) {
+	return write_slot(key, data, size);
+}
+
+int
+persist_write_string(uint32_t key, const char *cstring) {
+	return write_slot(key, cstring, strlen(cstring) + 1);
+}
+
+status_t
+persist_delete(uint32_t key) {
+	struct persist_slot *slot = find_slot(key, false);
+
+	if (!slot || slot->stats.size < 0) return E_DOES_NOT_EXIST;
+	store->used -= slot->stats.size;
+	slot->stats.size = -1;
+	slot->stats.deletes += 1;
+	store->totals.deletes += 1;
+	return S_SUCCESS;
+}
+
+/*************
+ * WINDOWS AND LAYERS
+ *************/
+
+#define LAYER_MAX_CHILDREN 8
+#define WINDOW_STACK_MAX 8
+#define VISIBLE_ROWS 5
+
+struct Layer {
+	GRect bounds;
+	MenuLayer *menu;
+	unsigned child_count;
+	Layer *children[LAYER_MAX_CHILDREN];
+};
+
+struct Window {
+	Layer root;
+	WindowHandlers handlers;
+	ClickConfigProvider click_config_provider;
+	void *user_data;
+	bool loaded;
+};
+
+struct TextLayer {
+	Layer layer;
+	const char *text;
+};
+
+struct MenuLayer {
+	Layer layer;
+	MenuLayerCallbacks callbacks;
+	void *context;
+	MenuIndex selected;
+	bool dirty;
+};
+
+static const GRect screen = { { 0, 0 }, { 144, 168 } };
+static Window *window_stack[WINDOW_STACK_MAX];
+static unsigned window_count;
+
+GFont
+fonts_get_system_font(const char *font_key) {
+	return (GFont)font_key;
+}
+
+Window *
+window_create(void) {
+	Window *window = pbl_calloc(1, sizeof *window);
+
+	if (window) window->root.bounds = screen;
+	return window;
+}
+
+void
+window_destroy(Window *window) {
+	if (!window) return;
+	window_stack_remove(window, false);
+	pbl_free(window);
+}
+
+void
+window_set_window_handlers(Window *window, WindowHandlers handlers) {
+	window->handlers = handlers;
+}
+
+void
+window_set_click_config_provider(Window *window,
+    ClickConfigProvider click_config_provider) {
+	window->click_config_provider = click_config_provider;
+}
+
+void
+window_single_click_subscribe(ButtonId button_id, ClickHandler handler) {
+	(void)button_id;
+	(void)handler;
+}
+
+Layer *
+window_get_root_layer(const Window *window) {
+	return (Layer *)&window->root;
+}
+
+void
+window_set_user_data(Window *window, void *data) {
+	window->user_data = data;
+}
+
+void *
+window_get_user_data(const Window *window) {
+	return window->user_data;
+}
+
+static void
+call_handler(Window *window, WindowHandler handler) {
+	if (handler) handler(window);
+}
+
+void
+window_stack_push(Window *window, bool animated) {
+	(void)animated;
+	if (!window || window_count >= WINDOW_STACK_MAX) return;
+	if (window_count)
+		call_handler(window_stack[window_count - 1],
+		    window_stack[window_count - 1]->handlers.disappear);
+
+	window_stack[window_count++] = window;
+	if (!window->loaded) {
+		window->loaded = true;
+		call_handler(window, window->handlers.load);
+	}
+	call_handler(window, window->handlers.appear);
+}
+
+bool
+window_stack_remove(Window *window, bool animated) {
+	unsigned i;
+
+	(void)animated;
+	for (i = 0; i < window_count && window_stack[i] != window; i += 1);
+	if (i >= window_count) return false;
+
+	if (i == window_count - 1)
+		call_handler(window, window->handlers.disappear);
+	memmove(window_stack + i, window_stack + i + 1,
+	    (window_count - i - 1) * sizeof *window_stack);
+	window_count -= 1;
+	window->loaded = false;
+	call_handler(window, window->handlers.unload);
+	if (i == window_count && window_count)
+		call_handler(window_stack[window_count - 1],
+		    window_stack[window_count - 1]->handlers.appear);
+	return true;
+}
+
+Window *
+window_stack_pop(bool animated) {
+	Window *window = window_stack_get_top_window();
+
+	if (window) window_stack_remove(window, animated);
+	return window;
+}
+
+bool
+window_stack_contains_window(Window *window) {
+	for (unsigned i = 0; i < window_count; i += 1) {
+		if (window_stack[i] == window) return true;
+	}
+
+	return false;
+}
+
+Window *
+window_stack_get_top_window(void) {
+	return window_count ? window_stack[window_count - 1] : 0;
+}
+
+GRect
+layer_get_bounds(const Layer *layer) {
+	return layer->bounds;
+}
+
+void
+layer_add_child(Layer *parent, Layer *child) {
+	if (parent->child_count < LAYER_MAX_CHILDREN)
+		parent->children[parent->child_count++] = child;
+}
+
+void
+layer_mark_dirty(Layer *layer) {
+	if (layer->menu) layer->menu->dirty = true;
+}
+
+/* detaches a destroyed layer from the windows still holding it */
+static void
+remove_child(Layer *child) {
+	for (unsigned w = 0; w < window_count; w += 1) {
+		Layer *root = &window_stack[w]->root;
+
+		for (unsigned i = 0; i < root->child_count; i += 1) {
+			if (root->children[i] != child) continue;
+			root->children[i] = root->children[--root->child_count];
+			break;
+		}
+	}
+}
+
+TextLayer *
+text_layer_create(GRect frame) {
+	TextLayer *text_layer = pbl_calloc(1, sizeof *text_layer);
+
+	if (text_layer) text_layer->layer.bounds = frame;
+	return text_layer;
+}
+
+void
+text_layer_destroy(TextLayer *text_layer) {
+	if (!text_layer) return;
+	remove_child(&text_layer->layer);
+	pbl_free(text_layer);
+}
+
+Layer *
+text_layer_get_layer(TextLayer *text_layer) {
+	return &text_layer->layer;
+}
+
+void
+text_layer_set_text(TextLayer *text_layer, const char *text) {
+	text_layer->text = text;
+}
+
+void
+text_layer_set_font(TextLayer *text_layer, GFont font) {
+	(void)text_layer;
+	(void)font;
+}
+
+void
+text_layer_set_text_alignment(TextLayer *text_layer,
+    GTextAlignment text_alignment) {
+	(void)text_layer;
+	(void)text_alignment;
+}
+
+MenuLayer *
+menu_layer_create(GRect frame) {
+	MenuLayer *menu_layer = pbl_calloc(1, sizeof *menu_layer);
+
+	if (!menu_layer) return 0;
+	menu_layer->layer.bounds = frame;
+	menu_layer->layer.menu = menu_layer;
+	menu_layer->dirty = true;
+	return menu_layer;
+}
+
+void
+menu_layer_destroy(MenuLayer *menu_layer) {
+	if (!menu_layer) return;
+	remove_child(&menu_layer->layer);
+	pbl_free(menu_layer);
+}
+
+Layer *
+menu_layer_get_layer(const MenuLayer *menu_layer) {
+	return (Layer *)&menu_layer->layer;
+}
+
+void
+menu_layer_set_callbacks(MenuLayer *menu_layer, void *callback_context,
+    MenuLayerCallbacks callbacks) {
+	menu_layer->context = callback_context;
+	menu_layer->callbacks = callbacks;
+	menu_layer->dirty = true;
+}
+
+void
+menu_layer_set_click_config_onto_window(MenuLayer *menu_layer,
+    Window *window) {
+	(void)menu_layer;
+	(void)window;
+}
+
+void
+menu_layer_reload_data(MenuLayer *menu_layer) {
+	menu_layer->dirty = true;
+}
+
+MenuIndex
+menu_layer_get_selected_index(const MenuLayer *menu_layer) {
+	return menu_layer->selected;
+}
+
+void
+menu_layer_set_selected_index(MenuLayer *menu_layer, MenuIndex index,
+    MenuRowAlign scroll_align, bool animated) {
+	(void)scroll_align;
+	(void)animated;
+	menu_layer->selected = index;
+}
+
+/* drawing only reads the strings, as the firmware would to lay them out */
+static volatile size_t drawn_chars;
+
+void
+menu_cell_basic_draw(GContext *ctx, const Layer *cell_layer,
+    const char *title, const char *subtitle, GBitmap *icon) {
+	(void)ctx;
+	(void)cell_layer;
+	(void)icon;
+	if (title) drawn_chars += strlen(title);
+	if (subtitle) drawn_chars += strlen(subtitle);
+}
+
+void
+menu_cell_title_draw(GContext *ctx, const Layer *cell_layer,
+    const char *title) {
+	menu_cell_basic_draw(ctx, cell_layer, title, 0, 0);
+}
+
+void
+menu_cell_basic_header_draw(GContext *ctx, const Layer *cell_layer,
+    const char *title) {
+	menu_cell_basic_draw(ctx, cell_layer, title, 0, 0);
+}
+
+static void
+render_menu(MenuLayer *menu) {
+	const MenuLayerCallbacks *cb = &menu->callbacks;
+	uint16_t sections = cb->get_num_sections
+	    ? cb->get_num_sections(menu, menu->context) : 1;
+	MenuIndex index = menu->selected;
+	Layer cell = { .bounds = GRect(0, 0, 144, 44) };
+	unsigned drawn = 0;
+
+	menu->dirty = false;
+	if (!cb->get_num_rows || !cb->draw_row) return;
+
+	for (; index.section < sections && drawn < VISIBLE_ROWS;
+	    index.section += 1, index.row = 0) {
+		const uint16_t rows = cb->get_num_rows(menu, index.section,
+		    menu->context);
+
+		if (index.row == 0 && cb->draw_header && cb->get_header_height
+		    && cb->get_header_height(menu, index.section,
+		      menu->context) > 0)
+			cb->draw_header(0, &cell, index.section,
+			    menu->context);
+
+		for (; index.row < rows && drawn < VISIBLE_ROWS;
+		    index.row += 1, drawn += 1)
+			cb->draw_row(0, &cell, &index, menu->context);
+	}
+}
+
+void
+host_render(void) {
+	Window *window = window_stack_get_top_window();
+
+	if (!window) return;
+	for (unsigned i = 0; i < window->root.child_count; i += 1) {
+		MenuLayer *menu = window->root.children[i]->menu;
+
+		if (menu && menu->dirty) render_menu(menu);
+	}
+}
+
+/*************
+ * APPLICATION MESSAGES
+ *************/
+
+#define TUPLE_HEADER_SIZE 7
+
+static uint8_t *
+tuple_end(const Tuple *tuple) {
+	return (uint8_t *)tuple + TUPLE_HEADER_SIZE + tuple->length;
+}
+
+DictionaryResult
+dict_write_begin(DictionaryIterator *iter, uint8_t *buffer, uint16_t size) {
+	if (!iter || !buffer) return DICT_INVALID_ARGS;
+	if (size < 1) return DICT_NOT_ENOUGH_STORAGE;
+
+	buffer[0] = 0;
+	iter->dictionary = buffer;
+	iter->end = buffer + size;
+	iter->cursor = (Tuple *)(buffer + 1);
+	return DICT_OK;
+}
+
+static DictionaryResult
+write_tuple(DictionaryIterator *iter, uint32_t key, TupleType type,
+    const void *data, uint16_t size) {
+	Tuple *tuple = iter->cursor;
+
+	if (!iter->dictionary) return DICT_INVALID_ARGS;
+	if ((uint8_t *)tuple + TUPLE_HEADER_SIZE + size > iter->end)
+		return DICT_NOT_ENOUGH_STORAGE;
+
+	tuple->key = key;
+	tuple->type = type;
+	tuple->length = size;
+	if (size) memcpy(tuple->value->data, data, size);
+	iter->cursor = (Tuple *)tuple_end(tuple);
+	iter->dictionary[0] += 1;
+	return DICT_OK;
+}
+
+DictionaryResult
+dict_write_data(DictionaryIterator *iter, uint32_t key,
+    const uint8_t *data, uint16_t size) {
+	return write_tuple(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult
+dict_write_cstring(DictionaryIterator *iter, uint32_t key,
+    const char *cstring) {
+	return write_tuple(iter, key, TUPLE_CSTRING, cstring,
+	    cstring ? strlen(cstring) + 1 : 0);
+}
+
+DictionaryResult
+dict_write_int(DictionaryIterator *iter, uint32_t key,
+    const void *integer, uint8_t width_bytes, bool is_signed) {
+	if (width_bytes != 1 && width_bytes != 2 && width_bytes != 4)
+		return DICT_INVALID_ARGS;
+	return write_tuple(iter, key, is_signed ? TUPLE_INT : TUPLE_UINT,
+	    integer, width_bytes);
+}
+
+DictionaryResult
+dict_write_uint8(DictionaryIterator *iter, uint32_t key, uint8_t value) {
+	return dict_write_int(iter, key, &value, sizeof value, false);
+}
+
+DictionaryResult
+dict_write_uint16(DictionaryIterator *iter, uint32_t key, uint16_t value) {
+	return dict_write_int(iter, key, &value, sizeof value, false);
+}
+
+DictionaryResult
+dict_write_uint32(DictionaryIterator *iter, uint32_t key, uint32_t value) {
+	return dict_write_int(iter, key, &value, sizeof value, false);
+}
+
+DictionaryResult
+dict_write_int32(DictionaryIterator *iter, uint32_t key, int32_t value) {
+	return dict_write_int(iter, key, &value, sizeof value, true);
+}
+
+uint32_t
+dict_write_end(DictionaryIterator *iter) {
+	if (!iter->dictionary) return 0;
+	iter->end = (uint8_t *)iter->cursor;
+	return iter->end - iter->dictionary;
+}
+
+Tuple *
+dict_read_begin_from_buffer(DictionaryIterator *iter,
+    const uint8_t *buffer, uint16_t size) {
+	if (!iter || !buffer || size < 1) return 0;
+	iter->dictionary = (uint8_t *)buffer;
+	iter->end = buffer + size;
+	return dict_read_first(iter);
+}
+
+Tuple *
+dict_read_next(DictionaryIterator *iter) {
+	Tuple *tuple = iter->cursor;
+
+	if ((const uint8_t *)tuple + TUPLE_HEADER_SIZE > iter->end
+	    || tuple_end(tuple) > iter->end)
+		return 0;
+	iter->cursor = (Tuple *)tuple_end(tuple);
+	return tuple;
+}
+
+Tuple *
+dict_read_first(DictionaryIterator *iter) {
+	iter->cursor = (Tuple *)(iter->dictionary + 1);
+	return dict_read_next(iter);
+}
+
+Tuple *
+dict_find(const DictionaryIterator *iter, uint32_t key) {
+	DictionaryIterator copy = *iter;
+
+	for (Tuple *tuple = dict_read_first(&copy); tuple;
+	    tuple = dict_read_next(&copy)) {
+		if (tuple->key == key) return tuple;
+	}
+
+	return 0;
+}
+
+struct app_link {
+	AppMessageInboxReceived inbox_received;
+	AppMessageInboxDropped inbox_dropped;
+	AppMessageOutboxSent outbox_sent;
+	AppMessageOutboxFailed outbox_failed;
+	host_outbox_handler handler;
+	void *handler_context;
+	uint32_t inbox_size;
+	uint32_t outbox_size;
+	uint8_t *outbox;
+	uint8_t *inbox;
+	uint8_t *in_flight_copy;
+	uint16_t in_flight_size;
+	DictionaryIterator outbox_iter;
+	bool open;
+	bool begun;
+	bool in_flight;
+	bool busy;
+	bool connected;
+	ConnectionHandlers connection_handlers;
+};
+
+static struct app_link app_link = { .connected = true };
+
+AppMessageResult
+app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+	if (app_link.open) return APP_MSG_INVALID_STATE;
+	app_link.inbox = malloc(size_inbound);
+	app_link.outbox = malloc(size_outbound);
+	app_link.in_flight_copy = malloc(size_outbound);
+	if (!app_link.inbox || !app_link.outbox || !app_link.in_flight_copy)
+		return APP_MSG_OUT_OF_MEMORY;
+
+	app_link.inbox_size = size_inbound;
+	app_link.outbox_size = size_outbound;
+	app_link.open = true;
+	return APP_MSG_OK;
+}
+
+void
+app_message_deregister_callbacks(void) {
+	app_link.inbox_received = 0;
+	app_link.inbox_dropped = 0;
+	app_link.outbox_sent = 0;
+	app_link.outbox_failed = 0;
+}
+
+AppMessageInboxReceived
+app_message_register_inbox_received(AppMessageInboxReceived callback) {
+	AppMessageInboxReceived previous = app_link.inbox_received;
+
+	app_link.inbox_received = callback;
+	return previous;
+}
+
+AppMessageInboxDropped
+app_message_register_inbox_dropped(AppMessageInboxDropped callback) {
+	AppMessageInboxDropped previous = app_link.inbox_dropped;
+
+	app_link.inbox_dropped = callback;
+	return previous;
+}
+
+AppMessageOutboxSent
+app_message_register_outbox_sent(AppMessageOutboxSent callback) {
+	AppMessageOutboxSent previous = app_link.outbox_sent;
+
+	app_link.outbox_sent = callback;
+	return previous;
+}
+
+AppMessageOutboxFailed
+app_message_register_outbox_failed(AppMessageOutboxFailed callback) {
+	AppMessageOutboxFailed previous = app_link.outbox_failed;
+
+	app_link.outbox_failed = callback;
+	return previous;
+}
+
+void
+host_outbox_set_handler(host_outbox_handler handler, void *context) {
+	app_link.handler = handler;
+	app_link.handler_context = context;
+}
+
+void
+host_outbox_set_busy(bool busy) {
+	app_link.busy = busy;
+}
+
+bool
+host_outbox_in_flight(void) {
+	return app_link.in_flight;
+}
+
+AppMessageResult
+app_message_outbox_begin(DictionaryIterator **iterator) {
+	if (!app_link.open) return APP_MSG_INVALID_STATE;
+	if (app_link.busy || app_link.begun || app_link.in_flight)
+		return APP_MSG_BUSY;
+
+	dict_write_begin(&app_link.outbox_iter, app_link.outbox,
+	    app_link.outbox_size);
+	app_link.begun = true;
+	*iterator = &app_link.outbox_iter;
+	return APP_MSG_OK;
+}
+
+static void
+fail_disconnected(void *data) {
+	(void)data;
+	host_outbox_failed(APP_MSG_NOT_CONNECTED);
+}
+
+static void
+acknowledge(void *data) {
+	(void)data;
+	host_outbox_sent();
+}
+
+AppMessageResult
+app_message_outbox_send(void) {
+	AppMessageResult result = APP_MSG_OK;
+
+	if (!app_link.begun) return APP_MSG_INVALID_STATE;
+	app_link.begun = false;
+	app_link.in_flight_size = dict_write_end(&app_link.outbox_iter);
+	memcpy(app_link.in_flight_copy, app_link.outbox,
+	    app_link.in_flight_size);
+
+	if (!app_link.connected) {
+		app_timer_register(0, &fail_disconnected, 0);
+	} else if (app_link.handler) {
+		result = app_link.handler(app_link.in_flight_copy,
+		    app_link.in_flight_size, app_link.handler_context);
+	} else {
+		app_timer_register(0, &acknowledge, 0);
+	}
+
+	if (result == APP_MSG_OK) app_link.in_flight = true;
+	return result;
+}
+
+static void
+complete(bool sent, AppMessageResult reason) {
+	DictionaryIterator iter;
+
+	if (!app_link.in_flight) return;
+	app_link.in_flight = false;
+	dict_read_begin_from_buffer(&iter, app_link.in_flight_copy,
+	    app_link.in_flight_size);
+
+	if (sent && app_link.outbox_sent) {
+		app_link.outbox_sent(&iter, 0);
+	} else if (!sent && app_link.outbox_failed) {
+		app_link.outbox_failed(&iter, reason, 0);
+	}
+}
+
+void
+host_outbox_sent(void) {
+	complete(true, APP_MSG_OK);
+}
+
+void
+host_outbox_failed(AppMessageResult reason) {
+	complete(false, reason);
+}
+
+AppMessageResult
+host_inbox_deliver(const uint8_t *data, uint16_t size) {
+	DictionaryIterator iter;
+
+	if (!app_link.open || !app_link.inbox_received)
+		return APP_MSG_APP_NOT_RUNNING;
+	if (size > app_link.inbox_size) {
+		if (app_link.inbox_dropped)
+			app_link.inbox_dropped(APP_MSG_BUFFER_OVERFLOW, 0);
+		return APP_MSG_BUFFER_OVERFLOW;
+	}
+
+	memcpy(app_link.inbox, data, size);
+	dict_read_begin_from_buffer(&iter, app_link.inbox, size);
+	app_link.inbox_received(&iter, 0);
+	return APP_MSG_OK;
+}
+
+void
+connection_service_subscribe(ConnectionHandlers conn_handlers) {
+	app_link.connection_handlers = conn_handlers;
+}
+
+void
+connection_service_unsubscribe(void) {
+	app_link.connection_handlers = (ConnectionHandlers){ 0 };
+}
+
+bool
+connection_service_peek_pebble_app_connection(void) {
+	return app_link.connected;
+}
+
+void
+host_connection_set(bool connected) {
+	if (connected == app_link.connected) return;
+	app_link.connected = connected;
+	if (app_link.connection_handlers.pebble_app_connection_handler)
+		app_link.connection_handlers.pebble_app_connection_handler(
+		    connected);
+}
+
+/*************
+ * LAUNCH AND WORKER
+ *************/
+
+static AppLaunchReason reason = APP_LAUNCH_USER;
+static uint32_t args;
+static void (*run)(void);
+static bool worker_running;
+
+void
+host_launch_set(AppLaunchReason new_reason, uint32_t new_args) {
+	reason = new_reason;
+	args = new_args;
+}
+
+void
+host_run_set(void (*new_run)(void)) {
+	run = new_run;
+}
+
+AppLaunchReason
+launch_reason(void) {
+	return reason;
+}
+
+uint32_t
+launch_get_args(void) {
+	return args;
+}
+
+/* runs the session, then leaves the app as with the back button */
+void
+app_event_loop(void) {
+	host_clock_advance(0);
+	if (run) run();
+	while (window_stack_pop(false));
+}
+
+bool
+app_worker_is_running(void) {
+	return worker_running;
+}
+
+AppWorkerResult
+app_worker_launch(void) {
+	if (worker_running) return APP_WORKER_RESULT_ALREADY_RUNNING;
+	worker_running = true;
+	return APP_WORKER_RESULT_SUCCESS;
+}
+
+AppWorkerResult
+app_worker_kill(void) {
+	if (!worker_running) return APP_WORKER_RESULT_NOT_RUNNING;
+	worker_running = false;
+	return APP_WORKER_RESULT_SUCCESS;
+}
@@ -0,0 +1,612 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * Host stand-in for the subset of the Pebble SDK used by src/, so that the
+ * watch modules build and run unmodified in the tools of this directory.
+ * Time is 32-bit and virtual, and the time functions are renamed so that
+ * they do not clash with the host C library. See host.h for the controls.
+ */
+
+#include <stdint.h>
+
+typedef int32_t time_t;
+#define __time_t_defined 1
+#define __struct_tm_defined 1
+
+struct tm {
+	int tm_sec;
+	int tm_min;
+	int tm_hour;
+	int tm_mday;
+	int tm_mon;
+	int tm_year;
+	int tm_wday;
+	int tm_yday;
+	int tm_isdst;
+	int tm_gmtoff;
+	const char *tm_zone;
+};
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define time(t) pbl_time(t)
+#define localtime(t) pbl_localtime(t)
+#define gmtime(t) pbl_gmtime(t)
+#define mktime(tm) pbl_mktime(tm)
+#define strftime(s, max, format, tm) pbl_strftime(s, max, format, tm)
+
+time_t
+pbl_time(time_t *tloc);
+
+struct tm *
+pbl_localtime(const time_t *timep);
+
+struct tm *
+pbl_gmtime(const time_t *timep);
+
+time_t
+pbl_mktime(struct tm *tm);
+
+size_t
+pbl_strftime(char *s, size_t max, const char *format, const struct tm *tm);
+
+uint16_t
+time_ms(time_t *tloc, uint16_t *out_ms);
+
+/* the app heap, accounted and limited like on the watch */
+
+#define malloc(size) pbl_malloc(size)
+#define calloc(count, size) pbl_calloc(count, size)
+#define realloc(ptr, size) pbl_realloc(ptr, size)
+#define free(ptr) pbl_free(ptr)
+
+void *
+pbl_malloc(size_t size);
+
+void *
+pbl_calloc(size_t count, size_t size);
+
+void *
+pbl_realloc(void *ptr, size_t size);
+
+void
+pbl_free(void *ptr);
+
+/* logging */
+
+#define APP_LOG_LEVEL_ERROR 1
+#define APP_LOG_LEVEL_WARNING 50
+#define APP_LOG_LEVEL_INFO 100
+#define APP_LOG_LEVEL_DEBUG 200
+#define APP_LOG_LEVEL_DEBUG_VERBOSE 255
+
+void
+app_log(uint8_t log_level, const char *src_filename, int src_line_number,
+    const char *fmt, ...) __attribute__((__format__(__printf__, 4, 5)));
+
+#define APP_LOG(level, fmt, ...) \
+	app_log(level, __FILE__, __LINE__, fmt, ## __VA_ARGS__)
+
+/* persistent storage */
+
+#define PERSIST_DATA_MAX_LENGTH 256
+#define PERSIST_STRING_MAX_LENGTH PERSIST_DATA_MAX_LENGTH
+
+typedef enum {
+	S_SUCCESS = 0,
+	E_ERROR = -1,
+	E_UNKNOWN = -2,
+	E_INTERNAL = -3,
+	E_INVALID_ARGUMENT = -4,
+	E_OUT_OF_MEMORY = -5,
+	E_OUT_OF_STORAGE = -6,
+	E_OUT_OF_RESOURCES = -7,
+	E_RANGE = -8,
+	E_DOES_NOT_EXIST = -9,
+	E_INVALID_OPERATION = -10,
+	E_BUSY = -11,
+	S_TRUE = 1,
+	S_FALSE = 0,
+	S_NO_MORE_ITEMS = 2,
+	S_NO_ACTION_REQUIRED = 3,
+} StatusCode;
+
+typedef int32_t status_t;
+
+bool
+persist_exists(uint32_t key);
+
+int
+persist_get_size(uint32_t key);
+
+bool
+persist_read_bool(uint32_t key);
+
+int32_t
+persist_read_int(uint32_t key);
+
+int
+persist_read_data(uint32_t key, void *buffer, size_t buffer_size);
+
+int
+persist_read_string(uint32_t key, char *buffer, size_t buffer_size);
+
+status_t
+persist_write_bool(uint32_t key, bool value);
+
+status_t
+persist_write_int(uint32_t key, int32_t value);
+
+int
+persist_write_data(uint32_t key, const void *data, size_t size);
+
+int
+persist_write_string(uint32_t key, const char *cstring);
+
+status_t
+persist_delete(uint32_t key);
+
+/* heap usage, as accounted by the allocation wrappers */
+
+size_t
+heap_bytes_used(void);
+
+size_t
+heap_bytes_free(void);
+
+/* graphics and windows, only keeping track of what the app asks */
+
+typedef struct {
+	int16_t x;
+	int16_t y;
+} GPoint;
+
+typedef struct {
+	int16_t w;
+	int16_t h;
+} GSize;
+
+typedef struct {
+	GPoint origin;
+	GSize size;
+} GRect;
+
+#define GRect(x, y, w, h) ((GRect){ { (x), (y) }, { (w), (h) } })
+
+typedef struct Layer Layer;
+typedef struct Window Window;
+typedef struct TextLayer TextLayer;
+typedef struct MenuLayer MenuLayer;
+typedef struct GContext GContext;
+typedef struct GBitmap GBitmap;
+typedef struct GFont *GFont;
+
+#define FONT_KEY_GOTHIC_18_BOLD "RESOURCE_ID_GOTHIC_18_BOLD"
+#define FONT_KEY_GOTHIC_24_BOLD "RESOURCE_ID_GOTHIC_24_BOLD"
+#define FONT_KEY_GOTHIC_28_BOLD "RESOURCE_ID_GOTHIC_28_BOLD"
+
+GFont
+fonts_get_system_font(const char *font_key);
+
+typedef void (*WindowHandler)(Window *window);
+
+typedef struct {
+	WindowHandler load;
+	WindowHandler appear;
+	WindowHandler disappear;
+	WindowHandler unload;
+} WindowHandlers;
+
+typedef void *ClickRecognizerRef;
+typedef void (*ClickHandler)(ClickRecognizerRef recognizer, void *context);
+typedef void (*ClickConfigProvider)(void *context);
+
+typedef enum {
+	BUTTON_ID_BACK,
+	BUTTON_ID_UP,
+	BUTTON_ID_SELECT,
+	BUTTON_ID_DOWN,
+	NUM_BUTTONS,
+} ButtonId;
+
+Window *
+window_create(void);
+
+void
+window_destroy(Window *window);
+
+void
+window_set_window_handlers(Window *window, WindowHandlers handlers);
+
+void
+window_set_click_config_provider(Window *window,
+    ClickConfigProvider click_config_provider);
+
+void
+window_single_click_subscribe(ButtonId button_id, ClickHandler handler);
+
+Layer *
+window_get_root_layer(const Window *window);
+
+void
+window_set_user_data(Window *window, void *data);
+
+void *
+window_get_user_data(const Window *window);
+
+void
+window_stack_push(Window *window, bool animated);
+
+Window *
+window_stack_pop(bool animated);
+
+bool
+window_stack_remove(Window *window, bool animated);
+
+bool
+window_stack_contains_window(Window *window);
+
+Window *
+window_stack_get_top_window(void);
+
+GRect
+layer_get_bounds(const Layer *layer);
+
+void
+layer_add_child(Layer *parent, Layer *child);
+
+void
+layer_mark_dirty(Layer *layer);
+
+typedef enum {
+	GTextAlignmentLeft,
+	GTextAlignmentCenter,
+	GTextAlignmentRight,
+} GTextAlignment;
+
+TextLayer *
+text_layer_create(GRect frame);
+
+void
+text_layer_destroy(TextLayer *text_layer);
+
+Layer *
+text_layer_get_layer(TextLayer *text_layer);
+
+void
+text_layer_set_text(TextLayer *text_layer, const char *text);
+
+void
+text_layer_set_font(TextLayer *text_layer, GFont font);
+
+void
+text_layer_set_text_alignment(TextLayer *text_layer,
+    GTextAlignment text_alignment);
+
+/* menus */
+
+typedef void (*SimpleMenuLayerSelectCallback)(int index, void *context);
+
+typedef struct {
+	const char *title;
+	const char *subtitle;
+	GBitmap *icon;
+	SimpleMenuLayerSelectCallback callback;
+} SimpleMenuItem;
+
+typedef struct {
+	uint16_t section;
+	uint16_t row;
+} MenuIndex;
+
+#define MenuIndex(s, r) ((MenuIndex){ .section = (s), .row = (r) })
+
+typedef enum {
+	MenuRowAlignNone,
+	MenuRowAlignCenter,
+	MenuRowAlignTop,
+	MenuRowAlignBottom,
+} MenuRowAlign;
+
+#define MENU_CELL_BASIC_HEADER_HEIGHT 16
+
+typedef struct {
+	uint16_t (*get_num_sections)(MenuLayer *menu_layer, void *context);
+	uint16_t (*get_num_rows)(MenuLayer *menu_layer,
+	    uint16_t section_index, void *context);
+	int16_t (*get_cell_height)(MenuLayer *menu_layer,
+	    MenuIndex *cell_index, void *context);
+	int16_t (*get_header_height)(MenuLayer *menu_layer,
+	    uint16_t section_index, void *context);
+	void (*draw_row)(GContext *ctx, const Layer *cell_layer,
+	    MenuIndex *cell_index, void *context);
+	void (*draw_header)(GContext *ctx, const Layer *cell_layer,
+	    uint16_t section_index, void *context);
+	void (*select_click)(MenuLayer *menu_layer, MenuIndex *cell_index,
+	    void *context);
+	void (*select_long_click)(MenuLayer *menu_layer,
+	    MenuIndex *cell_index, void *context);
+} MenuLayerCallbacks;
+
+MenuLayer *
+menu_layer_create(GRect frame);
+
+void
+menu_layer_destroy(MenuLayer *menu_layer);
+
+Layer *
+menu_layer_get_layer(const MenuLayer *menu_layer);
+
+void
+menu_layer_set_callbacks(MenuLayer *menu_layer, void *callback_context,
+    MenuLayerCallbacks callbacks);
+
+void
+menu_layer_set_click_config_onto_window(MenuLayer *menu_layer,
+    Window *window);
+
+void
+menu_layer_reload_data(MenuLayer *menu_layer);
+
+MenuIndex
+menu_layer_get_selected_index(const MenuLayer *menu_layer);
+
+void
+menu_layer_set_selected_index(MenuLayer *menu_layer, MenuIndex index,
+    MenuRowAlign scroll_align, bool animated);
+
+void
+menu_cell_basic_draw(GContext *ctx, const Layer *cell_layer,
+    const char *title, const char *subtitle, GBitmap *icon);
+
+void
+menu_cell_title_draw(GContext *ctx, const Layer *cell_layer,
+    const char *title);
+
+void
+menu_cell_basic_header_draw(GContext *ctx, const Layer *cell_layer,
+    const char *title);
+
+/* dictionaries, in the wire layout of the SDK */
+
+typedef enum {
+	TUPLE_BYTE_ARRAY = 0,
+	TUPLE_CSTRING = 1,
+	TUPLE_UINT = 2,
+	TUPLE_INT = 3,
+} TupleType;
+
+typedef struct __attribute__((__packed__)) {
+	uint32_t key;
+	uint8_t type;
+	uint16_t length;
+	union __attribute__((__packed__)) {
+		uint8_t data[0];
+		char cstring[0];
+		uint8_t uint8;
+		uint16_t uint16;
+		uint32_t uint32;
+		int8_t int8;
+		int16_t int16;
+		int32_t int32;
+	} value[];
+} Tuple;
+
+typedef struct {
+	uint8_t *dictionary;
+	const uint8_t *end;
+	Tuple *cursor;
+} DictionaryIterator;
+
+typedef enum {
+	DICT_OK = 0,
+	DICT_NOT_ENOUGH_STORAGE = 1 << 1,
+	DICT_INVALID_ARGS = 1 << 2,
+	DICT_INTERNAL_INCONSISTENCY = 1 << 3,
+	DICT_MALLOC_FAILED = 1 << 4,
+} DictionaryResult;
+
+DictionaryResult
+dict_write_begin(DictionaryIterator *iter, uint8_t *buffer, uint16_t size);
+
+DictionaryResult
+dict_write_data(DictionaryIterator *iter, uint32_t key,
+    const uint8_t *data, uint16_t size);
+
+DictionaryResult
+dict_write_cstring(DictionaryIterator *iter, uint32_t key,
+    const char *cstring);
+
+DictionaryResult
+dict_write_int(DictionaryIterator *iter, uint32_t key,
+    const void *integer, uint8_t width_bytes, bool is_signed);
+
+DictionaryResult
+dict_write_uint8(DictionaryIterator *iter, uint32_t key, uint8_t value);
+
+DictionaryResult
+dict_write_uint16(DictionaryIterator *iter, uint32_t key, uint16_t value);
+
+DictionaryResult
+dict_write_uint32(DictionaryIterator *iter, uint32_t key, uint32_t value);
+
+DictionaryResult
+dict_write_int32(DictionaryIterator *iter, uint32_t key, int32_t value);
+
+uint32_t
+dict_write_end(DictionaryIterator *iter);
+
+Tuple *
+dict_read_begin_from_buffer(DictionaryIterator *iter,
+    const uint8_t *buffer, uint16_t size);
+
+Tuple *
+dict_read_first(DictionaryIterator *iter);
+
+Tuple *
+dict_read_next(DictionaryIterator *iter);
+
+Tuple *
+dict_find(const DictionaryIterator *iter, uint32_t key);
+
+/* application messages */
+
+typedef enum {
+	APP_MSG_OK = 0,
+	APP_MSG_SEND_TIMEOUT = 1 << 1,
+	APP_MSG_SEND_REJECTED = 1 << 2,
+	APP_MSG_NOT_CONNECTED = 1 << 3,
+	APP_MSG_APP_NOT_RUNNING = 1 << 4,
+	APP_MSG_INVALID_ARGS = 1 << 5,
+	APP_MSG_BUSY = 1 << 6,
+	APP_MSG_BUFFER_OVERFLOW = 1 << 7,
+	APP_MSG_ALREADY_RELEASED = 1 << 9,
+	APP_MSG_CALLBACK_ALREADY_REGISTERED = 1 << 10,
+	APP_MSG_CALLBACK_NOT_REGISTERED = 1 << 11,
+	APP_MSG_OUT_OF_MEMORY = 1 << 12,
+	APP_MSG_CLOSED = 1 << 13,
+	APP_MSG_INTERNAL_ERROR = 1 << 14,
+	APP_MSG_INVALID_STATE = 1 << 15,
+} AppMessageResult;
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator,
+    void *context);
+typedef void (*AppMessageInboxDropped)(AppMessageResult reason,
+    void *context);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator *iterator,
+    void *context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator *iterator,
+    AppMessageResult reason, void *context);
+
+AppMessageResult
+app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+
+void
+app_message_deregister_callbacks(void);
+
+AppMessageInboxReceived
+app_message_register_inbox_received(AppMessageInboxReceived callback);
+
+AppMessageInboxDropped
+app_message_register_inbox_dropped(AppMessageInboxDropped callback);
+
+AppMessageOutboxSent
+app_message_register_outbox_sent(AppMessageOutboxSent callback);
+
+AppMessageOutboxFailed
+app_message_register_outbox_failed(AppMessageOutboxFailed callback);
+
+AppMessageResult
+app_message_outbox_begin(DictionaryIterator **iterator);
+
+AppMessageResult
+app_message_outbox_send(void);
+
+/* timers and services */
+
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void *data);
+
+AppTimer *
+app_timer_register(uint32_t timeout_ms, AppTimerCallback callback,
+    void *callback_data);
+
+bool
+app_timer_reschedule(AppTimer *timer, uint32_t new_timeout_ms);
+
+void
+app_timer_cancel(AppTimer *timer);
+
+typedef enum {
+	SECOND_UNIT = 1 << 0,
+	MINUTE_UNIT = 1 << 1,
+	HOUR_UNIT = 1 << 2,
+	DAY_UNIT = 1 << 3,
+	MONTH_UNIT = 1 << 4,
+	YEAR_UNIT = 1 << 5,
+} TimeUnits;
+
+typedef void (*TickHandler)(struct tm *tick_time, TimeUnits units_changed);
+
+void
+tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+
+void
+tick_timer_service_unsubscribe(void);
+
+typedef void (*ConnectionHandler)(bool connected);
+
+typedef struct {
+	ConnectionHandler pebble_app_connection_handler;
+	ConnectionHandler pebblekit_connection_handler;
+} ConnectionHandlers;
+
+void
+connection_service_subscribe(ConnectionHandlers conn_handlers);
+
+void
+connection_service_unsubscribe(void);
+
+bool
+connection_service_peek_pebble_app_connection(void);
+
+/* launch and worker */
+
+typedef enum {
+	APP_LAUNCH_SYSTEM,
+	APP_LAUNCH_USER,
+	APP_LAUNCH_PHONE,
+	APP_LAUNCH_WAKEUP,
+	APP_LAUNCH_WORKER,
+	APP_LAUNCH_QUICK_LAUNCH,
+	APP_LAUNCH_TIMELINE_ACTION,
+	APP_LAUNCH_SMARTSTRAP,
+} AppLaunchReason;
+
+AppLaunchReason
+launch_reason(void);
+
+uint32_t
+launch_get_args(void);
+
+typedef enum {
+	APP_WORKER_RESULT_SUCCESS = 0,
+	APP_WORKER_RESULT_NO_WORKER = 1,
+	APP_WORKER_RESULT_DIFFERENT_APP = 2,
+	APP_WORKER_RESULT_NOT_RUNNING = 3,
+	APP_WORKER_RESULT_ALREADY_RUNNING = 4,
+	APP_WORKER_RESULT_ASKING_CONFIRMATION = 5,
+} AppWorkerResult;
+
+bool
+app_worker_is_running(void);
+
+AppWorkerResult
+app_worker_launch(void);
+
+AppWorkerResult
+app_worker_kill(void);
+
+void
+app_event_loop(void);
@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Link simulator: the watch modules, run by build/linkwatch, and app.js,
+ * run in Node by pebblekit.js, exchange their AppMessages over a virtual
+ * Bluetooth link with latency, bandwidth, drops, outbox contention and
+ * disconnections. Both ends share a virtual clock, so that a run only
+ * depends on its options and seed. The report gives the end-to-end rate
+ * of events, lost and duplicate ones and the configuration transfer time.
+ */
+
+"use strict";
+
+var childProcess = require("child_process");
+var path = require("path");
+var readline = require("readline");
+var pebblekit = require("./pebblekit.js");
+
+const USAGE = "Usage: node linksim.js [--events N] [--rate PER_MIN]"
+ + " [--transport batched|immediate] [--latency MS] [--bandwidth B/S]"
+ + " [--drop P] [--timeout MS] [--busy-every S] [--busy-for MS]"
+ + " [--disconnect-every S] [--disconnect-for S] [--configs N]"
+ + " [--http-latency MS] [--drain S] [--seed N] [--watch PATH]"
+ + " [--verbose]";
+const NAMES = "Caffeine,Tea,Water,Headache,Run";
+const APP_MSG_SEND_TIMEOUT = 2;
+const APP_MSG_NOT_CONNECTED = 8;
+
+var options = {
+   events: 1000,          /* taps on the watch */
+   rate: 6,               /* mean taps per minute */
+   transport: "batched",
+   latency: 40,           /* one-way link latency in ms */
+   bandwidth: 2000,       /* link payload bytes per second */
+   drop: 0,               /* probability of losing a message or its ack */
+   timeout: 5000,         /* ms before an unacknowledged message fails */
+   "busy-every": 0,       /* mean seconds between outbox contentions */
+   "busy-for": 500,
+   "disconnect-every": 0, /* mean seconds between disconnections */
+   "disconnect-for": 60,
+   configs: 1,            /* configuration pages saved over the run */
+   "http-latency": 200,   /* ms for an upload to be answered */
+   drain: 3600,           /* seconds allowed after the last tap */
+   seed: 1,
+   watch: path.join(__dirname, "..", "build", "linkwatch"),
+   verbose: false,
+};
+
+for (var i = 2; i < process.argv.length; i += 1) {
+   var name = process.argv[i].replace(/^--/, "");
+   if (!(name in options) || name === process.argv[i]) {
+      console.error(USAGE);
+      process.exit(2);
+   }
+   if (typeof options[name] === "boolean") {
+      options[name] = true;
+   } else if (typeof options[name] === "number") {
+      options[name] = Number(process.argv[++i]);
+   } else {
+      options[name] = process.argv[++i];
+   }
+}
+
+var random = new pebblekit.Random(options.seed);
+
+function exponential(mean) {
+   return -mean * Math.log(1 - random.next());
+}
+
+/*************
+ * VIRTUAL CLOCK
+ *************/
+
+var now = 0;
+var queue = [];
+var queue_order = 0;
+
+/* runs action at the given virtual time, in order of scheduling on ties */
+function at(time, action) {
+   var item = { time: Math.max(Math.round(time), now), order: queue_order++,
+    action: action, cancelled: false };
+   var i = queue.length;
+
+   while (i > 0 && (queue[i - 1].time > item.time
+    || (queue[i - 1].time === item.time
+     && queue[i - 1].order > item.order))) {
+      i -= 1;
+   }
+   queue.splice(i, 0, item);
+   return item;
+}
+
+/*************
+ * DICTIONARIES
+ *************/
+
+/* Tuple types of the SDK */
+const TUPLE_BYTE_ARRAY = 0;
+const TUPLE_CSTRING = 1;
+const TUPLE_UINT = 2;
+const TUPLE_INT = 3;
+
+function decodeDict(buffer) {
+   var result = {};
+   var offset = 1;
+
+   for (var n = 0; n < buffer[0]; n += 1) {
+      var key = buffer.readUInt32LE(offset);
+      var type = buffer[offset + 4];
+      var length = buffer.readUInt16LE(offset + 5);
+      var value = buffer.subarray(offset + 7, offset + 7 + length);
+
+      if (type === TUPLE_BYTE_ARRAY) {
+         result[key] = Array.from(value);
+      } else if (type === TUPLE_CSTRING) {
+         result[key] = value.toString("utf8").replace(/\0.*$/, "");
+      } else if (type === TUPLE_UINT) {
+         result[key] = value.readUIntLE(0, length);
+      } else {
+         result[key] = value.readIntLE(0, length);
+      }
+      offset += 7 + length;
+   }
+   return result;
+}
+
+function encodeDict(dict) {
+   var tuples = [];
+
+   Object.keys(dict).forEach(function(key) {
+      var value = dict[key];
+      var type, data;
+
+      if (value === undefined || value === null) return;
+      if (typeof value === "number") {
+         type = TUPLE_INT;
+         data = Buffer.alloc(4);
+         data.writeInt32LE(value);
+      } else if (typeof value === "string") {
+         type = TUPLE_CSTRING;
+         data = Buffer.from(value + "\0", "utf8");
+      } else {
+         type = TUPLE_BYTE_ARRAY;
+         data = Buffer.from(value);
+      }
+
+      var header = Buffer.alloc(7);
+      header.writeUInt32LE(Number(key));
+      header[4] = type;
+      header.writeUInt16LE(data.length, 5);
+      tuples.push(header, data);
+   });
+
+   return Buffer.concat([Buffer.from([tuples.length / 2])].concat(tuples));
+}
+
+/*************
+ * WATCH
+ *************/
+
+var watch = childProcess.spawn(options.watch,
+ options.verbose ? ["-v"] : [], { stdio: ["pipe", "pipe", "inherit"] });
+var watch_lines = readline.createInterface({ input: watch.stdout })
+ [Symbol.asyncIterator]();
+var watch_next = -1;
+var watch_start = 0;
+
+/* sends a command, then handles the messages sent until its answer */
+async function command(line) {
+   var answer = { inbox: null };
+
+   watch.stdin.write(line + "\n");
+   for (;;) {
+      var next = await watch_lines.next();
+      if (next.done) throw new Error("linkwatch exited on " + line);
+
+      var words = next.value.split(" ");
+      if (words[0] === "send") {
+         watchSend(Buffer.from(words[1], "hex"));
+      } else if (words[0] === "inbox") {
+         answer.inbox = Number(words[1]);
+      } else if (words[0] === "ok") {
+         watch_next = Number(words[2]);
+         return answer;
+      }
+   }
+}
+
+/*************
+ * LINK
+ *************/
+
+var link = {
+   connected: true,
+   free: 0,               /* time when the link is next idle */
+   busy: 0,               /* reasons for the watch outbox to be busy */
+   watch_pending: null,   /* message of the watch in flight */
+   phone_queue: [],       /* messages of the phone, sent in order */
+   phone_pending: null,
+};
+var stats = {
+   watch_messages: 0,
+   phone_messages: 0,
+   dropped: 0,
+   acks_dropped: 0,
+   failures: 0,
+   disconnections: 0,
+   busy_windows: 0,
+   records: new Map(),
+};
+
+/* time at which a message of the given size is through the link */
+function transfer(size) {
+   var start = Math.max(now, link.free);
+   link.free = start + size * 1000 / options.bandwidth;
+   return link.free + options.latency;
+}
+
+/* fails the watch message in flight, once */
+function watchFail(pending, reason) {
+   if (link.watch_pending !== pending) return;
+   link.watch_pending = null;
+   stats.failures += 1;
+   pending.timer.cancelled = true;
+   return command("failed " + reason);
+}
+
+function watchSend(buffer) {
+   var pending = { buffer: buffer };
+   var lost = random.next() < options.drop;
+   var ack_lost = random.next() < options.drop;
+
+   stats.watch_messages += 1;
+   link.watch_pending = pending;
+   pending.timer = at(now + options.timeout, function() {
+      return watchFail(pending, APP_MSG_SEND_TIMEOUT);
+   });
+
+   if (lost) {
+      stats.dropped += 1;
+      return;
+   }
+
+   at(transfer(buffer.length), function() {
+      if (!link.connected) return;
+      var payload = decodeDict(buffer);
+      countRecords(payload[520] || payload[535]);
+      phone.emit("appmessage", { payload: payload });
+
+      if (ack_lost) {
+         stats.acks_dropped += 1;
+         return;
+      }
+      at(now + options.latency, function() {
+         if (link.watch_pending !== pending || !link.connected) return;
+         link.watch_pending = null;
+         pending.timer.cancelled = true;
+         return command("sent");
+      });
+   });
+}
+
+/* records seen by the phone, by sequence number */
+function countRecords(bytes) {
+   if (!bytes) return;
+   for (var i = 1; i + 12 <= bytes.length; i += 12) {
+      var seq = bytes[i] | bytes[i + 1] << 8 | bytes[i + 2] << 16
+       | bytes[i + 3] << 24;
+      stats.records.set(seq, (stats.records.get(seq) || 0) + 1);
+   }
+}
+
+function phoneNext() {
+   if (link.phone_pending || link.phone_queue.length < 1) return;
+
+   var message = link.phone_queue.shift();
+   var buffer = encodeDict(message.dict);
+   var lost = random.next() < options.drop;
+   var ack_lost = random.next() < options.drop;
+   var done = false;
+
+   function finish(ok) {
+      if (done) return;
+      done = true;
+      link.phone_pending = null;
+      at(now, phoneNext);
+      if (ok) message.ack(); else message.nack("timeout");
+   }
+
+   stats.phone_messages += 1;
+   link.phone_pending = message;
+   at(now + options.timeout, function() { finish(false); });
+   if (!link.connected) {
+      at(now + options.latency, function() { finish(false); });
+      return;
+   }
+   if (lost) {
+      stats.dropped += 1;
+      return;
+   }
+
+   /* an incoming message keeps the outbox of the watch busy */
+   var start = Math.max(now, link.free);
+   at(start, function() { return setBusy(1); });
+   at(transfer(buffer.length), async function() {
+      await setBusy(-1);
+      if (!link.connected) return;
+      var answer = await command("deliver " + buffer.toString("hex"));
+      if (answer.inbox !== 0 || ack_lost) {
+         if (ack_lost) stats.acks_dropped += 1;
+         return;
+      }
+      at(now + options.latency, function() { finish(true); });
+   });
+}
+
+async function setBusy(delta) {
+   var was = link.busy > 0;
+   link.busy += delta;
+   if (was !== link.busy > 0) {
+      await command("busy " + (link.busy > 0 ? 1 : 0));
+   }
+}
+
+async function setConnected(connected) {
+   link.connected = connected;
+   if (!connected) {
+      stats.disconnections += 1;
+      if (link.watch_pending) {
+         await watchFail(link.watch_pending, APP_MSG_NOT_CONNECTED);
+      }
+   }
+   await command("connected " + (connected ? 1 : 0));
+}
+
+function scheduleBusy() {
+   if (!options["busy-every"]) return;
+   at(now + exponential(options["busy-every"] * 1000), async function() {
+      stats.busy_windows += 1;
+      await setBusy(1);
+      at(now + options["busy-for"], function() { return setBusy(-1); });
+      scheduleBusy();
+   });
+}
+
+function scheduleDisconnect() {
+   if (!options["disconnect-every"]) return;
+   at(now + exponential(options["disconnect-every"] * 1000),
+    async function() {
+      await setConnected(false);
+      at(now + exponential(options["disconnect-for"] * 1000), function() {
+         scheduleDisconnect();
+         return setConnected(true);
+      });
+   });
+}
+
+/*************
+ * PHONE
+ *************/
+
+/* taps and uploads by line time and id, several taps sharing a second */
+var lines = new Map();
+var taps = 0;
+var delivered = 0;
+var config_times = [];
+var config_failures = 0;
+var config_started = [];
+
+var phone = new pebblekit.Phone({
+   clock: {
+      now: function() { return now; },
+      setTimeout: function(fn, ms) { return at(now + (ms || 0), fn); },
+      clearTimeout: function(item) { if (item) item.cancelled = true; },
+   },
+   http: function(request, done) {
+      at(now + options["http-latency"], function() {
+         var data = new URLSearchParams(request.body).get("data") || "";
+         data.split("\n").forEach(function(line) {
+            if (!line) return;
+            var entry = lineEntry(line.split(",").slice(0, 2).join(","));
+            if (entry.uploads.length < entry.taps.length) delivered += 1;
+            entry.uploads.push(now);
+         });
+         done(200, "OK");
+      });
+   },
+   appMessage: function(dict, ack, nack) {
+      link.phone_queue.push({ dict: dict, ack: ack, nack: nack });
+      at(now, phoneNext);
+   },
+   quota: 0,
+   log: function(line) {
+      var match = /^Configuration (sent in (\d+) ms|failed)/.exec(line);
+      if (match && match[2] !== undefined) {
+         config_times.push(Number(match[2]));
+      } else if (match) {
+         config_failures += 1;
+      }
+      if (options.verbose) {
+         console.log("[" + ((now - watch_start) / 1000).toFixed(3)
+          + "] app.js: " + line);
+      }
+   },
+});
+
+function saveConfiguration() {
+   config_started.push(now);
+   phone.emit("webviewclosed", { response: JSON.stringify({
+      "event-list": NAMES,
+      "begin-prefix": "",
+      "end-prefix": "",
+      "dir-sep": "/",
+      "transport": options.transport === "batched" ? "1" : "0",
+      "url": "http://uploads.invalid/",
+      "data-field": "data",
+   }) });
+}
+
+/*************
+ * RUN
+ *************/
+
+function lineEntry(key) {
+   var entry = lines.get(key);
+
+   if (!entry) {
+      entry = { taps: [], uploads: [] };
+      lines.set(key, entry);
+   }
+   return entry;
+}
+
+function scheduleTaps() {
+   var names = NAMES.split(",");
+   var time = now + 60000;
+   var last = time;
+
+   for (var n = 0; n < options.events; n += 1) {
+      last = time = Math.round(time);
+      (function(index) {
+         at(time, function() {
+            var key = new Date(Math.floor(now / 1000) * 1000).toISOString()
+             .replace(/\.\d+Z$/, "Z") + "," + (index + 1);
+            lineEntry(key).taps.push(now);
+            taps += 1;
+            return command("tap " + index);
+         });
+      })(Math.floor(random.next() * names.length));
+      time += exponential(60000 / options.rate);
+   }
+
+   for (n = 1; n < options.configs; n += 1) {
+      at(now + 60000 + (last - now - 60000) * n / options.configs,
+       saveConfiguration);
+   }
+   return last;
+}
+
+async function run() {
+   var first = await new Promise(function(resolve) {
+      watch_lines.next().then(function(next) {
+         var words = next.value.split(" ");
+         watch_next = Number(words[2]);
+         resolve(Number(words[1]));
+      });
+   });
+
+   now = watch_start = first;
+   phone.emit("ready");
+   saveConfiguration();
+   var last_tap = scheduleTaps();
+   var end = last_tap + options.drain * 1000;
+   scheduleBusy();
+   scheduleDisconnect();
+
+   while (now <= end) {
+      while (queue.length > 0 && queue[0].cancelled) queue.shift();
+      if (taps >= options.events && delivered >= options.events
+       && !link.watch_pending) break;
+
+      var next = queue.length > 0 ? queue[0].time : Infinity;
+      if (watch_next >= 0 && watch_next < next) next = watch_next;
+      if (next === Infinity || next > end) break;
+
+      if (next > now) {
+         await command("advance " + Math.round(next - now));
+         now = next;
+      }
+      while (queue.length > 0 && queue[0].time <= now) {
+         var item = queue.shift();
+         if (!item.cancelled) await item.action();
+      }
+   }
+
+   watch.stdin.end("quit\n");
+   report(last_tap);
+}
+
+function percentile(sorted, p) {
+   if (sorted.length < 1) return 0;
+   return sorted[Math.min(sorted.length - 1,
+    Math.floor(sorted.length * p))];
+}
+
+function report(last_tap) {
+   var delays = [];
+   var duplicates = 0;
+   var last_upload = 0;
+   var first_tap = Infinity;
+   var record_duplicates = 0;
+
+   lines.forEach(function(entry) {
+      var count = Math.min(entry.taps.length, entry.uploads.length);
+      for (var n = 0; n < count; n += 1) {
+         delays.push(entry.uploads[n] - entry.taps[n]);
+         if (entry.uploads[n] > last_upload) last_upload = entry.uploads[n];
+      }
+      if (entry.taps.length && entry.taps[0] < first_tap) {
+         first_tap = entry.taps[0];
+      }
+      duplicates += entry.uploads.length - count;
+   });
+   stats.records.forEach(function(count) {
+      if (count > 1) record_duplicates += count - 1;
+   });
+   delays.sort(function(a, b) { return a - b; });
+
+   var span = (last_upload - first_tap) / 1000;
+   var lost = taps - delivered;
+
+   console.log(taps + " taps over "
+    + ((last_tap - first_tap) / 1000).toFixed(0) + " s, " + delivered
+    + " uploaded" + (span > 0 ? ", " + (delivered / span).toFixed(3)
+      + " events/s end to end" : ""));
+   console.log("Lost: " + lost + ", duplicate uploads: " + duplicates
+    + ", records received twice by the phone: " + record_duplicates);
+   console.log("Tap to upload: median " + (percentile(delays, 0.5) / 1000)
+    .toFixed(1) + " s, p95 " + (percentile(delays, 0.95) / 1000).toFixed(1)
+    + " s, max " + (percentile(delays, 1) / 1000).toFixed(1) + " s");
+   console.log("Link: " + stats.watch_messages + " watch messages, "
+    + stats.phone_messages + " phone messages, " + stats.dropped
+    + " dropped, " + stats.acks_dropped + " acks dropped, "
+    + stats.failures + " failed on the watch, " + stats.busy_windows
+    + " busy windows, " + stats.disconnections + " disconnections");
+
+   var sorted = config_times.slice().sort(function(a, b) { return a - b; });
+   console.log("Configuration: " + config_times.length + "/"
+    + config_started.length + " transferred"
+    + (sorted.length ? ", median " + percentile(sorted, 0.5) + " ms, max "
+      + percentile(sorted, 1) + " ms" : "")
+    + (config_failures ? ", " + config_failures + " failed" : ""));
+
+   process.exitCode = lost || duplicates ? 1 : 0;
+}
+
+run().catch(function(error) {
+   console.error(error);
+   watch.kill();
+   process.exitCode = 2;
+});
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Stand-ins for the globals of PebbleKit JS, to run src/js/app.js in Node:
+ * Pebble, a quota-limited localStorage, XMLHttpRequest and FormData. The
+ * HTTP requests, the AppMessages to the watch and the clock are provided
+ * by the harness, so that they can be real or simulated.
+ */
+
+"use strict";
+
+var fs = require("fs");
+var path = require("path");
+var vm = require("vm");
+
+const ROOT = path.join(__dirname, "..", "..");
+
+/* web storage, counting the characters of keys and values as quota */
+function Storage(quota) {
+   this.items = new Map();
+   this.quota = quota;
+   this.size = 0;
+   this.stats = { writes: 0, chars_written: 0, peak_size: 0, refused: 0 };
+}
+
+Storage.prototype.getItem = function(key) {
+   key = String(key);
+   return this.items.has(key) ? this.items.get(key) : null;
+};
+
+Storage.prototype.setItem = function(key, value) {
+   key = String(key);
+   value = String(value);
+   var old = this.items.has(key) ? key.length + this.items.get(key).length : 0;
+   var size = this.size - old + key.length + value.length;
+
+   if (this.quota && size > this.quota) {
+      this.stats.refused += 1;
+      var error = new Error("localStorage quota of " + this.quota
+       + " characters exceeded");
+      error.name = "QuotaExceededError";
+      throw error;
+   }
+
+   this.items.set(key, value);
+   this.size = size;
+   this.stats.writes += 1;
+   this.stats.chars_written += key.length + value.length;
+   if (size > this.stats.peak_size) this.stats.peak_size = size;
+};
+
+Storage.prototype.removeItem = function(key) {
+   key = String(key);
+   if (!this.items.has(key)) return;
+   this.size -= key.length + this.items.get(key).length;
+   this.items.delete(key);
+};
+
+Storage.prototype.clear = function() {
+   this.items.clear();
+   this.size = 0;
+};
+
+Storage.prototype.key = function(index) {
+   var keys = Array.from(this.items.keys());
+   return index < keys.length ? keys[index] : null;
+};
+
+Object.defineProperty(Storage.prototype, "length", {
+   get: function() { return this.items.size; },
+});
+
+function FormData() {
+   this.fields = [];
+}
+
+FormData.prototype.append = function(name, value) {
+   this.fields.push([String(name), String(value)]);
+};
+
+FormData.prototype.encode = function() {
+   return this.fields.map(function(field) {
+      return encodeURIComponent(field[0]) + "=" + encodeURIComponent(field[1]);
+   }).join("&");
+};
+
+/*
+ * Creates a phone running app.js. The options are:
+ *   clock: { now(), setTimeout(fn, ms), clearTimeout(id) }, real by default
+ *   http(request, done): performs { method, url, body }, then calls
+ *     done(status, statusText) or done(null) for a network error
+ *   appMessage(dict, ack, nack): carries a message to the watch
+ *   quota: localStorage quota in characters, 0 for none
+ *   storage: initial localStorage items
+ *   localStorage: a Storage kept from a closed phone, instead of the above
+ *   log(line): console output of app.js
+ */
+function Phone(options) {
+   var phone = this;
+   var clock = options.clock || {
+      now: Date.now,
+      setTimeout: setTimeout,
+      clearTimeout: clearTimeout,
+   };
+
+   this.listeners = {};
+   this.urls = [];
+   this.closed = false;
+   this.localStorage = options.localStorage || new Storage(
+    options.quota === undefined ? 5 * 1024 * 1024 : options.quota);
+   for (var key in options.storage || {}) {
+      this.localStorage.setItem(key, options.storage[key]);
+   }
+
+   function XMLHttpRequest() {
+      this.listeners = {};
+      this.status = 0;
+      this.statusText = "";
+      this.request = null;
+   }
+
+   XMLHttpRequest.prototype.addEventListener = function(type, listener) {
+      (this.listeners[type] = this.listeners[type] || []).push(listener);
+   };
+
+   XMLHttpRequest.prototype.open = function(method, url) {
+      this.request = { method: method, url: url, body: "" };
+   };
+
+   XMLHttpRequest.prototype.send = function(body) {
+      var xhr = this;
+      var request = this.request;
+
+      request.body = body instanceof FormData ? body.encode()
+       : body === undefined || body === null ? "" : String(body);
+      options.http(request, function(status, statusText) {
+         /* a late answer to a request replaced by a newer one is lost */
+         if (phone.closed || xhr.request !== request) return;
+         xhr.status = status === null ? 0 : status;
+         xhr.statusText = statusText || "";
+         var type = status === null ? "error" : "load";
+         (xhr.listeners[type] || []).forEach(function(listener) {
+            listener.call(xhr, { type: type });
+         });
+      });
+   };
+
+   /* Date of the phone clock, the same objects as the real ones */
+   var ClockDate = function() {
+      if (!(this instanceof ClockDate)) {
+         return new Date(clock.now()).toString();
+      }
+      return arguments.length ? new Date(...arguments) : new Date(clock.now());
+   };
+   ClockDate.now = function() { return clock.now(); };
+   ClockDate.parse = Date.parse;
+   ClockDate.UTC = Date.UTC;
+   ClockDate.prototype = Date.prototype;
+
+   this.Pebble = {
+      addEventListener: function(type, listener) {
+         (phone.listeners[type] = phone.listeners[type] || []).push(listener);
+      },
+      removeEventListener: function(type, listener) {
+         phone.listeners[type] = (phone.listeners[type] || []).filter(
+          function(other) { return other !== listener; });
+      },
+      sendAppMessage: function(dict, ack, nack) {
+         options.appMessage(dict, function() {
+            if (ack && !phone.closed) ack({ data: { transactionId: 0 } });
+         }, function(error) {
+            if (nack && !phone.closed) {
+               nack({ data: { transactionId: 0 }, error: error });
+            }
+         });
+         return 0;
+      },
+      openURL: function(url) {
+         phone.urls.push(url);
+      },
+   };
+
+   var sandbox = {
+      Pebble: this.Pebble,
+      localStorage: this.localStorage,
+      XMLHttpRequest: XMLHttpRequest,
+      FormData: FormData,
+      Date: ClockDate,
+      setTimeout: function(fn, ms) {
+         return clock.setTimeout(function() {
+            if (!phone.closed) fn();
+         }, ms);
+      },
+      clearTimeout: clock.clearTimeout,
+      console: {
+         log: function() {
+            (options.log || function() {})(Array.prototype.join.call(
+             arguments, " "));
+         },
+      },
+      require: function(name) {
+         return require(path.join(ROOT, name));
+      },
+   };
+
+   var file = path.join(ROOT, "src", "js", "app.js");
+   vm.runInNewContext(fs.readFileSync(file, "utf8"), sandbox,
+    { filename: file });
+}
+
+/* stops app.js as when the phone app is killed, its storage is kept */
+Phone.prototype.close = function() {
+   this.closed = true;
+   this.listeners = {};
+};
+
+/* delivers an event to the listeners of app.js, as the phone app does */
+Phone.prototype.emit = function(type, event) {
+   (this.listeners[type] || []).forEach(function(listener) {
+      listener(event || {});
+   });
+};
+
+/* the record batch of src/outbox.c, as received by app.js */
+function encodeRecords(records) {
+   var bytes = [1];
+
+   records.forEach(function(record) {
+      [record.seq, record.time].forEach(function(value) {
+         for (var i = 0; i < 4; i += 1) {
+            bytes.push(Math.floor(value / Math.pow(256, i)) & 255);
+         }
+      });
+      bytes.push(record.id, record.duration === undefined ? 0 : 1,
+       (record.duration || 0) & 255, (record.duration || 0) >> 8);
+   });
+
+   return bytes;
+}
+
+/* xorshift32, so that simulations replay from their seed */
+function Random(seed) {
+   this.state = (seed >>> 0) || 1;
+}
+
+Random.prototype.next = function() {
+   var x = this.state;
+   x ^= x << 13;
+   x >>>= 0;
+   x ^= x >>> 17;
+   x ^= x << 5;
+   this.state = x >>> 0;
+   return this.state / 4294967296;
+};
+
+module.exports = {
+   Phone: Phone,
+   Storage: Storage,
+   Random: Random,
+   encodeRecords: encodeRecords,
+};
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Soak test of the upload queue of src/js/app.js: enqueues many records
+ * received from the watch, drains them to a local HTTP stand-in server
+ * with configurable latency, network errors and error statuses, and
+ * reports the drain throughput, the localStorage writes, the peak memory
+ * and whether every line arrived once with lastSent ending right.
+ */
+
+"use strict";
+
+var http = require("http");
+var pebblekit = require("./pebblekit.js");
+
+const USAGE = "Usage: node soak.js [--events N] [--batch N] [--rate N]"
+ + " [--latency MS] [--errors P] [--status CODE:P,...] [--quota CHARS]"
+ + " [--timer-scale F] [--restarts N] [--seed N] [--timeout S] [--verbose]";
+const NAMES = "Caffeine,Tea,+Sleep,Health/Headache,Health/Migraine";
+const START_TIME = 1451606400;
+
+var options = {
+   events: 10000,     /* records received from the watch */
+   batch: 32,         /* records per AppMessage */
+   rate: 0,           /* batches per second, 0 for all at once */
+   latency: 0,        /* server answer delay in ms */
+   errors: 0,         /* probability of a dropped connection */
+   status: "",        /* probabilities of error statuses */
+   quota: 5 * 1024 * 1024,
+   "timer-scale": 0.001,  /* app.js retry delays are scaled by this */
+   restarts: 0,       /* phone app kills spread over the drain */
+   seed: 1,
+   timeout: 600,      /* seconds without progress before giving up */
+   verbose: false,
+};
+
+for (var i = 2; i < process.argv.length; i += 1) {
+   var name = process.argv[i].replace(/^--/, "");
+   if (!(name in options) || name === process.argv[i]) {
+      console.error(USAGE);
+      process.exit(2);
+   }
+   if (typeof options[name] === "boolean") {
+      options[name] = true;
+   } else if (typeof options[name] === "number") {
+      options[name] = Number(process.argv[++i]);
+   } else {
+      options[name] = process.argv[++i];
+   }
+}
+
+var random = new pebblekit.Random(options.seed);
+var statuses = options.status ? options.status.split(",").map(function(s) {
+   var parts = s.split(":");
+   return { code: parseInt(parts[0], 10), p: Number(parts[1]) };
+}) : [];
+
+/*************
+ * SERVER
+ *************/
+
+var server_stats = { requests: 0, dropped: 0, errors: 0, lines: 0 };
+var received = new Map();
+var out_of_order = 0;
+var last_received = -1;
+
+function answer(request, response, body) {
+   var roll = random.next();
+
+   server_stats.requests += 1;
+   if (roll < options.errors) {
+      server_stats.dropped += 1;
+      request.socket.destroy();
+      return;
+   }
+
+   roll = random.next();
+   for (var s = 0; s < statuses.length; s += 1) {
+      if (roll < statuses[s].p) {
+         server_stats.errors += 1;
+         response.writeHead(statuses[s].code);
+         response.end();
+         return;
+      }
+      roll -= statuses[s].p;
+   }
+
+   var data = new URLSearchParams(body).get("data") || "";
+   data.split("\n").forEach(function(line) {
+      if (!line) return;
+      var time = Date.parse(line.split(",")[0]) / 1000;
+      server_stats.lines += 1;
+      received.set(line, (received.get(line) || 0) + 1);
+      if (time < last_received) out_of_order += 1;
+      last_received = time;
+   });
+   response.writeHead(200);
+   response.end("OK");
+}
+
+var server = http.createServer({ keepAlive: true }, function(req, res) {
+   var chunks = [];
+   req.on("data", function(chunk) { chunks.push(chunk); });
+   req.on("end", function() {
+      var body = Buffer.concat(chunks).toString();
+      if (options.latency > 0) {
+         setTimeout(answer, options.latency, req, res, body);
+      } else {
+         answer(req, res, body);
+      }
+   });
+});
+
+/*************
+ * PHONE
+ *************/
+
+var agent = new http.Agent({ keepAlive: true, maxSockets: 4 });
+
+function httpRequest(request, done) {
+   var url = new URL(request.url);
+   var req = http.request({
+      agent: agent,
+      hostname: url.hostname,
+      port: url.port,
+      path: url.pathname,
+      method: request.method,
+      headers: {
+         "Content-Type": "application/x-www-form-urlencoded",
+         "Content-Length": Buffer.byteLength(request.body),
+      },
+   }, function(res) {
+      res.resume();
+      res.on("end", function() { done(res.statusCode, res.statusMessage); });
+   });
+   req.on("error", function() { done(null); });
+   req.end(request.body);
+}
+
+var peak = { rss: 0, heap: 0 };
+
+function sampleMemory() {
+   var usage = process.memoryUsage();
+   if (usage.rss > peak.rss) peak.rss = usage.rss;
+   if (usage.heapUsed > peak.heap) peak.heap = usage.heapUsed;
+}
+
+function startPhone(port, storage) {
+   var phone = new pebblekit.Phone({
+      http: httpRequest,
+      appMessage: function(dict, ack) { setImmediate(ack); },
+      quota: options.quota,
+      clock: {
+         now: Date.now,
+         setTimeout: function(fn, ms) {
+            return setTimeout(fn, ms * options["timer-scale"]);
+         },
+         clearTimeout: clearTimeout,
+      },
+      localStorage: storage,
+      storage: {
+         "url": "http://127.0.0.1:" + port + "/",
+         "data-field": "data",
+         "event-list": NAMES,
+         "lastSeq": "-1",
+      },
+      log: function(line) {
+         if (options.verbose) console.log("app.js: " + line);
+      },
+   });
+
+   phone.emit("ready");
+   return phone;
+}
+
+function run(port) {
+   var names = NAMES.split(",");
+   var phone = startPhone(port);
+   var restarts = 0;
+   var expected = [];
+   var sent = 0;
+   var start = Date.now();
+   var last_progress = { time: start, lines: 0 };
+   var exception = null;
+
+   function sendBatch() {
+      var records = [];
+      while (records.length < options.batch && sent < options.events) {
+         var record = {
+            seq: sent,
+            time: START_TIME + sent * 60,
+            id: 1 + sent % names.length,
+         };
+         if (names[record.id - 1].charAt(0) === "+" && sent % 2) {
+            record.id += 127;
+            record.duration = 30;
+         }
+         records.push(record);
+         expected.push(record.time);
+         sent += 1;
+      }
+
+      try {
+         phone.emit("appmessage", { payload: {
+            520: pebblekit.encodeRecords(records),
+            521: 1,
+         } });
+      } catch (e) {
+         exception = exception || e;
+      }
+      sampleMemory();
+
+      if (sent < options.events) {
+         if (options.rate > 0) {
+            setTimeout(sendBatch, 1000 / options.rate);
+         } else {
+            setImmediate(sendBatch);
+         }
+      }
+   }
+
+   function check() {
+      var queue = phone.localStorage.getItem("toSend");
+      var drained = sent >= options.events && !queue;
+      var now = Date.now();
+
+      sampleMemory();
+      if (received.size > last_progress.lines) {
+         last_progress = { time: now, lines: received.size };
+      }
+      if (!drained && restarts < options.restarts && received.size
+       >= options.events * (restarts + 1) / (options.restarts + 1)) {
+         restarts += 1;
+         phone.close();
+         phone = startPhone(port, phone.localStorage);
+      }
+      if (!drained && now - last_progress.time < options.timeout * 1000) {
+         setTimeout(check, 20);
+         return;
+      }
+
+      report(phone, expected, (now - start) / 1000, drained, exception);
+      server.close();
+      agent.destroy();
+   }
+
+   sendBatch();
+   check();
+}
+
+/*************
+ * REPORT
+ *************/
+
+function report(phone, expected, elapsed, drained, exception) {
+   var storage = phone.localStorage.stats;
+   var last_sent = phone.localStorage.getItem("lastSent");
+   var missing = 0;
+   var duplicates = 0;
+
+   received.forEach(function(count) {
+      if (count > 1) duplicates += count - 1;
+   });
+   missing = expected.length - received.size;
+
+   console.log(options.events + " records, " + (drained ? "drained" :
+    "NOT drained") + " in " + elapsed.toFixed(1) + " s, "
+    + (received.size / elapsed).toFixed(0) + " lines/s");
+   console.log("Server: " + server_stats.requests + " requests, "
+    + server_stats.dropped + " dropped, " + server_stats.errors
+    + " error statuses, " + server_stats.lines + " lines");
+   console.log("Lines: " + received.size + " unique, " + missing
+    + " missing, " + duplicates + " duplicates, " + out_of_order
+    + " out of order");
+   console.log("localStorage: " + storage.writes + " writes, "
+    + storage.chars_written + " characters written, peak "
+    + storage.peak_size + " characters, " + storage.refused + " refused");
+   console.log("Peak memory: " + (peak.rss / 1048576).toFixed(1)
+    + " MiB resident, " + (peak.heap / 1048576).toFixed(1) + " MiB heap");
+
+   var last_ok = last_sent === String(expected[expected.length - 1]);
+   console.log("lastSent: " + last_sent + (last_ok ? " (correct)"
+    : " (expected " + expected[expected.length - 1] + ")"));
+   if (exception) {
+      console.log("app.js threw while enqueuing: " + exception.message);
+   }
+
+   /* a line in flight when the phone app is killed is sent again */
+   process.exitCode = drained && !missing && duplicates <= options.restarts
+    && last_ok && !exception ? 0 : 1;
+}
+
+server.listen(0, "127.0.0.1", function() {
+   run(server.address().port);
+});
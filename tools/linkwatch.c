@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Watch end of js/linksim.js: runs one session of the watch app, whose
+ * clock, taps and AppMessage link are driven by commands read on stdin,
+ * one per line, each answered by "ok <clock ms> <next timer ms or -1>":
+ *   advance <ms>       runs the app timers due in the next ms
+ *   tap <index>        records the event of the given index
+ *   deliver <hex>      hands a dictionary to the inbox, answering first
+ *                      "inbox <result>"
+ *   sent               acknowledges the message in flight
+ *   failed <reason>    fails the message in flight
+ *   busy <0|1>         forces the outbox busy, for contention
+ *   connected <0|1>    connects or disconnects the phone
+ *   quit               ends the session
+ * Messages sent by the app are written as "send <hex>" before the answer
+ * of the command during which they were sent.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "host.h"
+#include "global.h"
+#include "storage.h"
+
+#define DEFAULT_START 1451606400	/* 2016-01-01 */
+#define LINE_SIZE 4096
+
+static AppMessageResult
+print_message(const uint8_t *data, uint16_t size, void *context) {
+	(void)context;
+	fputs("send ", stdout);
+	for (uint16_t i = 0; i < size; i += 1)
+		printf("%02x", data[i]);
+	putchar('\n');
+	return APP_MSG_OK;
+}
+
+static int
+hex_value(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static uint16_t
+parse_hex(const char *hex, uint8_t *data, size_t max) {
+	uint16_t size = 0;
+
+	while (size < max && hex_value(hex[0]) >= 0 && hex_value(hex[1]) >= 0) {
+		data[size++] = hex_value(hex[0]) << 4 | hex_value(hex[1]);
+		hex += 2;
+	}
+	return size;
+}
+
+static void
+serve(void) {
+	static char line[LINE_SIZE];
+	static uint8_t data[LINE_SIZE / 2];
+	unsigned long value;
+	uint64_t next;
+
+	host_clock_advance(0);
+	for (;;) {
+		printf("ok %" PRIu64 " %" PRIi64 "\n", host_clock_ms(),
+		    host_timer_next(&next) ? (int64_t)next : (int64_t)-1);
+		fflush(stdout);
+
+		if (!fgets(line, sizeof line, stdin)
+		    || strncmp(line, "quit", 4) == 0)
+			return;
+
+		if (sscanf(line, "advance %lu", &value) == 1) {
+			host_clock_advance(value);
+		} else if (sscanf(line, "tap %lu", &value) == 1) {
+			event_menu_record(value);
+			host_clock_advance(0);
+		} else if (strncmp(line, "deliver ", 8) == 0) {
+			printf("inbox %d\n", (int)host_inbox_deliver(data,
+			    parse_hex(line + 8, data, sizeof data)));
+			host_clock_advance(0);
+		} else if (strncmp(line, "sent", 4) == 0) {
+			host_outbox_sent();
+			host_clock_advance(0);
+		} else if (sscanf(line, "failed %lu", &value) == 1) {
+			host_outbox_failed(value);
+			host_clock_advance(0);
+		} else if (sscanf(line, "busy %lu", &value) == 1) {
+			host_outbox_set_busy(value);
+		} else if (sscanf(line, "connected %lu", &value) == 1) {
+			host_connection_set(value);
+			host_clock_advance(0);
+		} else {
+			fprintf(stderr, "linkwatch: unknown command %s", line);
+		}
+	}
+}
+
+int
+main(int argc, char **argv) {
+	/* the link warnings are part of what is simulated */
+	host_log_set(stderr, argc > 1 && strcmp(argv[1], "-v") == 0
+	    ? APP_LOG_LEVEL_DEBUG : APP_LOG_LEVEL_ERROR);
+
+	if (!host_persist_setup(false, STORAGE_BUDGET)) {
+		perror("mmap");
+		return 1;
+	}
+
+	host_clock_set(DEFAULT_START, 0);
+	host_outbox_set_handler(&print_message, 0);
+	host_run_set(&serve);
+	life_log_main();
+	fflush(stdout);
+	return 0;
+}
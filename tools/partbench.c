@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Benchmarks the merged newest-first iteration over the log partitions:
+ * the full walk with log_partition_next(), the walk back with
+ * log_partition_prev(), log_partition_count(), and the rows drawn while
+ * scrolling through the kept entries of the log menu, both with the
+ * cursor of read_kept() in log_menu.c and by walking from the top for
+ * every row.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "host.h"
+#include "global.h"
+#include "storage.h"
+#include "strlist.h"
+
+#define DEFAULT_START 1451606400	/* 2016-01-01 */
+#define DEFAULT_ROUNDS 10000
+#define VISIBLE_ROWS 5
+
+static const char *const names[] = {
+	"Caffeine", "Tea", "Water", "Health/Headache", "Health/Migraine",
+	"Health/Medication", "Sport/Run", "Sport/Swim", "Mood/Good",
+	"Mood/Bad",
+};
+#define NAME_COUNT (sizeof names / sizeof *names)
+
+static const char *const default_specs[] = {
+	"Health/:2",
+	"Health/:1,Sport/:1",
+	"Health/,Mood/",
+};
+
+/* the ranges of life-log.c touched by the partitions */
+static const struct storage_range storage_ranges[] = {
+	{ "log partitions", KEY_PARTITION_LOG,
+	    LOG_PARTITION_PAGES, LOG_PARTITION_STORAGE_SIZE },
+	{ "settings", KEY_BEGIN_PREFIX,
+	    KEY_BACKGROUND_WORKER - KEY_BEGIN_PREFIX + 1,
+	    SETTINGS_STORAGE_SIZE },
+};
+
+static uint32_t rng_state = 1;
+static volatile uint16_t sink;
+
+static uint32_t
+rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static uint64_t
+host_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* keeps evicted entries of random events until the partitions are full */
+static uint32_t
+fill(unsigned entries) {
+	uint32_t seq;
+
+	for (seq = 0; seq < entries; seq += 1) {
+		log_partition_keep(&(struct log_entry){
+		    .seq = seq,
+		    .time = DEFAULT_START + seq * 600,
+		    .id = 1 + rng_next() % NAME_COUNT,
+		    .duration = LOG_NO_DURATION,
+		});
+	}
+	log_partition_store();
+
+	return seq;
+}
+
+/* cursor of read_kept() in log_menu.c */
+static uint16_t kept_row = UINT16_MAX;
+static struct log_entry kept_entry;
+
+static bool
+read_kept(uint32_t begin, uint16_t row, struct log_entry *entry) {
+	uint32_t seq;
+
+	if (kept_row == UINT16_MAX
+	    || (row < kept_row && row < kept_row - row)) {
+		seq = begin;
+		if (!log_partition_next(&seq, &kept_entry)) return false;
+		kept_row = 0;
+	}
+
+	seq = kept_entry.seq;
+	while (kept_row < row && log_partition_next(&seq, &kept_entry))
+		kept_row += 1;
+	while (kept_row > row && log_partition_prev(&seq, &kept_entry))
+		kept_row -= 1;
+
+	if (kept_row != row) {
+		kept_row = UINT16_MAX;
+		return false;
+	}
+
+	*entry = kept_entry;
+	return true;
+}
+
+/* the same row found by walking from the top */
+static bool
+read_from_top(uint32_t begin, uint16_t row, struct log_entry *entry) {
+	uint32_t seq = begin;
+
+	do {
+		if (!log_partition_next(&seq, entry)) return false;
+	} while (row-- > 0);
+
+	return true;
+}
+
+/* draws the visible rows at every scroll position, down then up */
+static uint64_t
+scroll(bool (*read)(uint32_t, uint16_t, struct log_entry *),
+    uint32_t begin, uint16_t count, unsigned rounds, unsigned *reads) {
+	struct log_entry entry;
+	uint64_t start = host_ns();
+
+	*reads = 0;
+	for (unsigned round = 0; round < rounds; round += 1) {
+		for (int top = 0; top < count; top += 1) {
+			for (int i = 0; i < VISIBLE_ROWS && top + i < count;
+			    i += 1) {
+				if (read(begin, top + i, &entry)) *reads += 1;
+			}
+		}
+		for (int top = count - 1; top >= 0; top -= 1) {
+			for (int i = 0; i < VISIBLE_ROWS && top + i < count;
+			    i += 1) {
+				if (read(begin, top + i, &entry)) *reads += 1;
+			}
+		}
+	}
+
+	return host_ns() - start;
+}
+
+static void
+bench(const char *spec, unsigned rounds) {
+	struct log_entry entry;
+	uint64_t start, walk_ns, back_ns, count_ns, cursor_ns, top_ns;
+	unsigned walked = 0, cursor_reads, top_reads;
+	uint32_t seq, end, first = UINT32_MAX, last = 0;
+	uint16_t count;
+
+	log_partition_configure(spec);
+	end = fill(2000);
+	count = log_partition_count(end);
+
+	start = host_ns();
+	for (unsigned round = 0; round < rounds; round += 1) {
+		seq = end;
+		while (log_partition_next(&seq, &entry)) {
+			walked += 1;
+			if (entry.seq < first) first = entry.seq;
+			if (entry.seq > last) last = entry.seq;
+		}
+	}
+	walk_ns = host_ns() - start;
+
+	start = host_ns();
+	for (unsigned round = 0; round < rounds; round += 1) {
+		seq = first;
+		while (log_partition_prev(&seq, &entry)) { }
+	}
+	back_ns = host_ns() - start;
+
+	start = host_ns();
+	for (unsigned round = 0; round < rounds; round += 1)
+		sink = log_partition_count(end - round % 2);
+	count_ns = host_ns() - start;
+
+	kept_row = UINT16_MAX;
+	cursor_ns = scroll(&read_kept, end, count, rounds / 10 + 1,
+	    &cursor_reads);
+	top_ns = scroll(&read_from_top, end, count, rounds / 10 + 1,
+	    &top_reads);
+
+	if (walked != rounds * count || cursor_reads != top_reads) {
+		fprintf(stderr, "%s: walked %u for %u kept entries, "
+		    "%u rows read with the cursor, %u from the top\n",
+		    spec, walked, rounds * count, cursor_reads, top_reads);
+		exit(1);
+	}
+
+	printf("\"%s\": %" PRIu16 " kept entries (seq %" PRIu32 "-%" PRIu32
+	    ")\n", spec, count, first, last);
+	printf("  newest-first walk  %8.1f ns per entry\n",
+	    (double)walk_ns / walked);
+	printf("  walk back          %8.1f ns per entry\n",
+	    (double)back_ns / walked);
+	printf("  count              %8.1f ns per call\n",
+	    (double)count_ns / rounds);
+	printf("  scrolling, cursor  %8.1f ns per row drawn\n",
+	    (double)cursor_ns / cursor_reads);
+	printf("  scrolling, top     %8.1f ns per row drawn\n",
+	    (double)top_ns / top_reads);
+}
+
+static void
+usage(const char *program) {
+	fprintf(stderr, "Usage: %s [-r rounds] [-s seed] [spec ...]\n"
+	    "  -r rounds  walks per measure (default %u)\n"
+	    "  -s seed    seed of the random events\n"
+	    "Each spec is a partition list as sent by the configuration page."
+	    "\n", program, DEFAULT_ROUNDS);
+}
+
+int
+main(int argc, char **argv) {
+	unsigned rounds = DEFAULT_ROUNDS;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:s:")) != -1) {
+		switch (opt) {
+		    case 'r':
+			rounds = strtoul(optarg, 0, 10);
+			break;
+		    case 's':
+			rng_state = strtoul(optarg, 0, 10);
+			if (!rng_state) rng_state = 1;
+			break;
+		    default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (!rounds) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (!host_persist_setup(false, STORAGE_BUDGET)
+	    || !storage_init(storage_ranges,
+	      sizeof storage_ranges / sizeof *storage_ranges)
+	    || !strlist_set(&event_names, names, NAME_COUNT)) {
+		fprintf(stderr, "Unable to set up the benchmark\n");
+		return 1;
+	}
+
+	printf("%u partition pages\n", (unsigned)LOG_PARTITION_PAGES);
+	if (optind < argc) {
+		for (int i = optind; i < argc; i += 1)
+			bench(argv[i], rounds);
+	} else {
+		for (size_t i = 0; i < sizeof default_specs
+		    / sizeof *default_specs; i += 1)
+			bench(default_specs[i], rounds);
+	}
+
+	return 0;
+}
@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Replays a year of taps and configuration edits against the watch app,
+ * each in its own app session as on the watch, and reports the writes to
+ * persistent storage, the time spent per tap and the peak heap usage.
+ *
+ * Sessions run in forked children, so that every launch starts from the
+ * static state of a fresh app, while persistent storage and results live
+ * in memory shared with the parent.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "global.h"
+#include "storage.h"
+
+#define DEFAULT_NAMES "Caffeine,Tea,Water,+Sleep,+Work,+Commute," \
+    "Health/Headache,Health/Migraine,Health/Medication," \
+    "Sport/Run,Sport/Swim,Mood/Good,Mood/Bad"
+#define DEFAULT_START 1451606400	/* 2016-01-01 */
+#define WAKE_HOUR 7
+#define SLEEP_HOUR 23
+#define SESSION_LINGER_MS 2000
+#define MAX_TAPS 200000
+#define MAX_KEYS 1024
+
+enum action_type {
+	ACTION_TAP,
+	ACTION_CONFIG,
+};
+
+struct action {
+	time_t time;
+	enum action_type type;
+	uint8_t index;		/* tapped event, or edit number */
+};
+
+/* filled by the sessions, in memory shared with the parent */
+struct results {
+	size_t peak_heap;
+	uint32_t taps;
+	uint32_t crashed;
+	uint64_t tap_writes;
+	uint64_t tap_bytes;
+	uint64_t tap_ns[MAX_TAPS];
+};
+
+static struct results *results;
+static const char *names[STRLIST_MAX_COUNT];
+static unsigned name_count;
+static bool batched;
+static const struct action *current;
+
+static const struct {
+	uint32_t first;
+	uint32_t count;
+	const char *name;
+} key_labels[] = {
+	{ KEY_EVENT_LOG, LOG_SEGMENT_COUNT, "event log" },
+	{ KEY_EVENT_LOG_HEADER, 1, "log header" },
+	{ KEY_OPEN_INTERVALS, 1, "open intervals" },
+	{ KEY_LEGACY_LOG_DAYS, 2, "legacy log" },
+	{ KEY_EVENT_LOG_DAYS, 4, "legacy day index" },
+	{ KEY_EVENT_LOG_EPOCH, 1, "log epoch" },
+	{ KEY_LEGACY_BUCKETS, 1, "legacy rollups" },
+	{ KEY_STORAGE_TOTALS, 1, "storage totals" },
+	{ KEY_EVENT_ROLLUP, 1, "rollups" },
+	{ KEY_PARTITION_LOG, LOG_PARTITION_PAGES, "log partitions" },
+	{ KEY_PARTITION_LOG + LOG_PARTITION_PAGES,
+	    LEGACY_PARTITION_PAGES - LOG_PARTITION_PAGES,
+	    "legacy partition pages" },
+	{ KEY_EVENT_LAST_SEEN, 1, "legacy last seen" },
+	{ KEY_LONG_EVENT_RUNNING, 1, "running events" },
+	{ KEY_EVENT_STATS, EVENT_STATS_PAGES, "event stats" },
+	{ KEY_EVENT_FREQUENCY, 1, "event frequency" },
+	{ KEY_BEGIN_PREFIX, KEY_BACKGROUND_WORKER - KEY_BEGIN_PREFIX + 1,
+	    "settings" },
+	{ KEY_EVENT_NAMES, STRLIST_KEY_COUNT, "event names" },
+	{ KEY_LEGACY_DERIVED, KEY_LEGACY_LONG_EVENT_ID - KEY_LEGACY_DERIVED + 1,
+	    "legacy derived tables" },
+	{ KEY_LEGACY_PREFIXES, STRLIST_KEY_COUNT, "legacy prefixes" },
+	{ KEY_EVENT_PROFILES, 1, "event profiles" },
+	{ KEY_LEGACY_PROFILE_PREFIXES, LEGACY_PROFILE_COUNT * STRLIST_KEY_COUNT,
+	    "legacy profile prefixes" },
+};
+
+static const char *
+key_label(uint32_t key) {
+	for (unsigned i = 0; i < sizeof key_labels / sizeof *key_labels; i++) {
+		if (key >= key_labels[i].first
+		    && key - key_labels[i].first < key_labels[i].count)
+			return key_labels[i].name;
+	}
+
+	return "?";
+}
+
+/*************
+ * WORKLOAD
+ *************/
+
+static uint32_t rng_state;
+
+static uint32_t
+rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static int
+compare_actions(const void *a, const void *b) {
+	const struct action *x = a, *y = b;
+
+	if (x->time != y->time) return x->time < y->time ? -1 : 1;
+	return (int)x->type - (int)y->type;
+}
+
+/* event ranks follow a Zipf law, the first names being the most tapped */
+static uint8_t
+pick_event(void) {
+	double total = 0, target;
+
+	for (unsigned i = 0; i < name_count; i += 1) total += 1.0 / (i + 1);
+	target = total * (rng_next() % 1000000) / 1000000.0;
+	for (unsigned i = 0; i < name_count; i += 1) {
+		target -= 1.0 / (i + 1);
+		if (target < 0) return i;
+	}
+
+	return name_count - 1;
+}
+
+static size_t
+synthetic_actions(struct action *actions, size_t max, time_t start,
+    unsigned days, unsigned taps_per_day, unsigned config_period) {
+	size_t count = 0;
+
+	for (unsigned day = 0; day < days; day += 1) {
+		const time_t midnight = start + (time_t)day * 86400;
+		const unsigned taps = rng_next() % (2 * taps_per_day + 1);
+
+		if (config_period && day % config_period == 0 && count < max)
+			actions[count++] = (struct action){
+			    .time = midnight + 6 * 3600,
+			    .type = ACTION_CONFIG,
+			    .index = day / config_period,
+			};
+
+		for (unsigned i = 0; i < taps && count < max; i += 1)
+			actions[count++] = (struct action){
+			    .time = midnight + WAKE_HOUR * 3600
+			      + rng_next() % ((SLEEP_HOUR - WAKE_HOUR) * 3600),
+			    .type = ACTION_TAP,
+			    .index = pick_event(),
+			};
+	}
+
+	qsort(actions, count, sizeof *actions, &compare_actions);
+	return count;
+}
+
+/* upload lines "2016-01-02T03:04:05Z,id,title[,seconds]" from app.js */
+static size_t
+recorded_actions(struct action *actions, size_t max, FILE *input) {
+	char line[512];
+	size_t count = 0;
+
+	while (count < max && fgets(line, sizeof line, input)) {
+		struct tm tm = { 0 };
+		unsigned id;
+
+		if (sscanf(line, "%d-%d-%dT%d:%d:%dZ,%u",
+		    &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+		    &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &id) != 7
+		    || id == 0 || (id > STRLIST_MAX_COUNT && id < 128)
+		    || id >= 128 + STRLIST_MAX_COUNT)
+			continue;
+
+		tm.tm_year -= 1900;
+		tm.tm_mon -= 1;
+		actions[count++] = (struct action){
+		    .time = mktime(&tm),
+		    .type = ACTION_TAP,
+		    .index = id >= 128 ? id - 128 : id - 1,
+		};
+	}
+
+	qsort(actions, count, sizeof *actions, &compare_actions);
+	return count;
+}
+
+/*************
+ * SESSIONS
+ *************/
+
+static uint64_t
+host_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* what the configuration page sends, the last name changing each edit */
+static void
+send_configuration(unsigned edit) {
+	static uint8_t buffer[PROFILE_INBOX_SIZE];
+	char renamed[32];
+	DictionaryIterator iter;
+
+	dict_write_begin(&iter, buffer, sizeof buffer);
+	dict_write_uint32(&iter, KEY_EVENT_NAMES, name_count);
+	for (unsigned i = 0; i < name_count; i += 1) {
+		if (edit && i + 1 == name_count) {
+			snprintf(renamed, sizeof renamed, "%s %u",
+			    names[i], edit);
+			dict_write_cstring(&iter, KEY_EVENT_NAMES + 1 + i,
+			    renamed);
+		} else {
+			dict_write_cstring(&iter, KEY_EVENT_NAMES + 1 + i,
+			    names[i]);
+		}
+	}
+	dict_write_cstring(&iter, KEY_DIRECTORY_SEPARATOR, "/");
+	dict_write_uint32(&iter, KEY_TRANSPORT,
+	    batched ? TRANSPORT_BATCHED : TRANSPORT_IMMEDIATE);
+	host_inbox_deliver(buffer, dict_write_end(&iter));
+}
+
+static void
+run_session(void) {
+	struct host_persist_totals before, after;
+	uint64_t start;
+
+	/* staged initialization and first frame */
+	host_clock_advance(100);
+	host_render();
+
+	if (current->type == ACTION_CONFIG) {
+		send_configuration(current->index);
+	} else if (results->taps < MAX_TAPS) {
+		host_persist_totals(&before);
+		start = host_ns();
+		event_menu_record(current->index);
+		host_clock_advance(0);
+		host_render();
+		results->tap_ns[results->taps] = host_ns() - start;
+		host_persist_totals(&after);
+		results->tap_writes += after.writes - before.writes;
+		results->tap_bytes += after.bytes - before.bytes;
+		results->taps += 1;
+	}
+
+	host_clock_advance(SESSION_LINGER_MS);
+	host_render();
+}
+
+static void
+replay(const struct action *actions, size_t count) {
+	for (size_t i = 0; i < count; i += 1) {
+		int status;
+		pid_t pid;
+
+		fflush(0);
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			exit(1);
+		}
+
+		if (pid == 0) {
+			current = &actions[i];
+			host_clock_set(current->time - 1, 0);
+			host_run_set(&run_session);
+			host_heap_reset_peak();
+			life_log_main();
+			if (host_heap_peak() > results->peak_heap)
+				results->peak_heap = host_heap_peak();
+			fflush(0);
+			_exit(0);
+		}
+
+		if (waitpid(pid, &status, 0) < 0
+		    || !WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "Session at %" PRIi32 " failed\n",
+			    (int32_t)actions[i].time);
+			results->crashed += 1;
+		}
+	}
+}
+
+/*************
+ * REPORT
+ *************/
+
+static int
+compare_u64(const void *a, const void *b) {
+	const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int
+compare_keys(const void *a, const void *b) {
+	const struct host_key_stats *x = a, *y = b;
+
+	return x->key < y->key ? -1 : x->key > y->key;
+}
+
+static void
+report(unsigned days, size_t actions) {
+	static struct host_key_stats stats[MAX_KEYS];
+	static const unsigned bucket_us[] = { 50, 100, 200, 500, 1000, 5000 };
+	unsigned buckets[sizeof bucket_us / sizeof *bucket_us + 1] = { 0 };
+	struct host_persist_totals totals;
+	const unsigned count = host_persist_stats(stats, MAX_KEYS);
+	const uint32_t taps = results->taps;
+
+	host_persist_totals(&totals);
+	printf("%u days, %zu sessions, %" PRIu32 " taps, %" PRIu32
+	    " failed sessions\n", days, actions, taps, results->crashed);
+	printf("Persistent storage: %" PRIu64 " writes, %" PRIu64
+	    " bytes, %" PRIu64 " deletes, %" PRIu32 " refused,"
+	    " %" PRIu32 " bytes used at the end\n",
+	    totals.writes, totals.bytes, totals.deletes, totals.refused,
+	    host_persist_used());
+	printf("Per day: %.1f writes, %.0f bytes\n",
+	    (double)totals.writes / days, (double)totals.bytes / days);
+	if (taps) {
+		printf("Per tap: %.2f writes, %.0f bytes\n",
+		    (double)results->tap_writes / taps,
+		    (double)results->tap_bytes / taps);
+	}
+
+	qsort(stats, count, sizeof *stats, &compare_keys);
+	printf("\n%6s  %-18s %8s %10s %8s %5s\n",
+	    "key", "range", "writes", "bytes", "deletes", "size");
+	for (unsigned i = 0; i < count; i += 1) {
+		if (!stats[i].writes && !stats[i].deletes) continue;
+		printf("%6" PRIu32 "  %-18s %8" PRIu32 " %10" PRIu64
+		    " %8" PRIu32 " %5d\n",
+		    stats[i].key, key_label(stats[i].key), stats[i].writes,
+		    stats[i].bytes, stats[i].deletes, stats[i].size);
+	}
+
+	printf("\nPeak heap: %zu bytes\n", results->peak_heap);
+	if (!taps) return;
+
+	qsort(results->tap_ns, taps, sizeof *results->tap_ns, &compare_u64);
+	printf("Tap time on this host (us): p50 %.1f, p90 %.1f, p99 %.1f,"
+	    " max %.1f\n",
+	    results->tap_ns[taps / 2] / 1e3,
+	    results->tap_ns[taps * 9 / 10] / 1e3,
+	    results->tap_ns[taps * 99 / 100] / 1e3,
+	    results->tap_ns[taps - 1] / 1e3);
+
+	for (uint32_t i = 0; i < taps; i += 1) {
+		unsigned b;
+
+		for (b = 0; b < sizeof bucket_us / sizeof *bucket_us
+		    && results->tap_ns[i] >= bucket_us[b] * 1000u; b += 1);
+		buckets[b] += 1;
+	}
+	printf("Tap time histogram (us):");
+	for (unsigned b = 0; b < sizeof bucket_us / sizeof *bucket_us; b++)
+		printf(" <%u:%u", bucket_us[b], buckets[b]);
+	printf(" more:%u\n", buckets[sizeof bucket_us / sizeof *bucket_us]);
+}
+
+static void
+usage(const char *program) {
+	fprintf(stderr,
+	    "Usage: %s [-b] [-v] [-c days] [-d days] [-n names] [-r file]"
+	    " [-s seed] [-t taps]\n"
+	    "  -b         use the batched transport\n"
+	    "  -c days    configuration edit period, 0 for none (30)\n"
+	    "  -d days    number of synthetic days (365)\n"
+	    "  -n names   comma-separated event names\n"
+	    "  -r file    replay upload lines instead of synthetic taps\n"
+	    "  -s seed    seed of the synthetic workload (1)\n"
+	    "  -t taps    mean taps per synthetic day (12)\n"
+	    "  -v         show the logs of the app\n", program);
+}
+
+int
+main(int argc, char **argv) {
+	static struct action actions[MAX_TAPS];
+	static char name_buffer[4096] = DEFAULT_NAMES;
+	unsigned days = 365, taps_per_day = 12, config_period = 30;
+	const char *recorded = 0;
+	size_t count;
+	int opt;
+
+	rng_state = 1;
+	while ((opt = getopt(argc, argv, "bc:d:n:r:s:t:v")) != -1) {
+		switch (opt) {
+		    case 'b':
+			batched = true;
+			break;
+		    case 'c':
+			config_period = strtoul(optarg, 0, 10);
+			break;
+		    case 'd':
+			days = strtoul(optarg, 0, 10);
+			break;
+		    case 'n':
+			snprintf(name_buffer, sizeof name_buffer, "%s",
+			    optarg);
+			break;
+		    case 'r':
+			recorded = optarg;
+			break;
+		    case 's':
+			rng_state = strtoul(optarg, 0, 10);
+			if (!rng_state) rng_state = 1;
+			break;
+		    case 't':
+			taps_per_day = strtoul(optarg, 0, 10);
+			break;
+		    case 'v':
+			host_log_set(stderr, APP_LOG_LEVEL_DEBUG);
+			break;
+		    default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	for (char *name = strtok(name_buffer, ",");
+	    name && name_count < STRLIST_MAX_COUNT;
+	    name = strtok(0, ","))
+		names[name_count++] = name;
+	if (!name_count || !days) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	/* the configuration comes first, so that taps find their events */
+	actions[0] = (struct action){
+	    .time = DEFAULT_START - 3600,
+	    .type = ACTION_CONFIG,
+	};
+
+	if (recorded) {
+		FILE *input = fopen(recorded, "r");
+
+		if (!input) {
+			perror(recorded);
+			return 1;
+		}
+		count = recorded_actions(actions + 1, MAX_TAPS - 1, input);
+		fclose(input);
+		if (count) {
+			actions[0].time = actions[1].time - 3600;
+			days = (actions[count].time - actions[1].time)
+			    / 86400 + 1;
+		}
+	} else {
+		count = synthetic_actions(actions + 1, MAX_TAPS - 1,
+		    DEFAULT_START, days, taps_per_day, config_period);
+	}
+
+	results = mmap(0, sizeof *results, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (results == MAP_FAILED
+	    || !host_persist_setup(true, STORAGE_BUDGET)) {
+		perror("mmap");
+		return 1;
+	}
+
+	replay(actions, count + 1);
+	report(days, count + 1);
+	return results->crashed ? 1 : 0;
+}
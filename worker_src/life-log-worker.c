@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2016, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <pebble_worker.h>
+
+#include "../src/keys.h"
+
+/*
+ * Background workers cannot use AppMessage, so the worker only watches
+ * the connection to the phone. When it comes back while batched entries
+ * are still waiting for an acknowledgement, the foreground app is
+ * launched to send them and exits on its own. This takes over the
+ * screen, so the worker only runs when turned on in the settings.
+ */
+
+/* minimum time between two launches, in case the phone keeps failing */
+#define LAUNCH_INTERVAL 600
+
+/* leading fields of the persisted log header */
+struct __attribute__((__packed__)) log_header_start {
+	uint32_t next_seq;
+	uint32_t sent_seq;
+};
+
+static time_t last_launch = 0;
+
+static bool
+has_pending_entries(void) {
+	struct log_header_start header;
+	int ret;
+
+	if (persist_read_int(KEY_TRANSPORT) != TRANSPORT_BATCHED) return false;
+
+	ret = persist_read_data(KEY_EVENT_LOG_HEADER, &header, sizeof header);
+	return ret >= (int)sizeof header && header.sent_seq < header.next_seq;
+}
+
+static void
+connection_handler(bool connected) {
+	const time_t now = time(0);
+
+	if (!connected || now - last_launch < LAUNCH_INTERVAL) return;
+	if (!has_pending_entries()) return;
+
+	APP_LOG(APP_LOG_LEVEL_INFO, "worker: launching app to send entries");
+	last_launch = now;
+	worker_launch_app();
+}
+
+static void
+init(void) {
+	connection_service_subscribe((ConnectionHandlers) {
+	    .pebble_app_connection_handler = &connection_handler,
+	});
+}
+
+static void
+deinit(void) {
+	connection_service_unsubscribe();
+}
+
+int
+main(void) {
+	init();
+	worker_event_loop();
+	deinit();
+}